@@ -133,8 +133,17 @@ int main(int argc, char * argv[])
 		GraphicsUpdate();
 		GraphicsAquireNextImage();
 		// Render code starts here
-		GraphicsBegin(frameBuffer);
-		GraphicsClearColor(ColorFromHex(0x204080ff));
+		// Clearing at the start of the pass and discarding the depth at the end avoids loading and storing them
+		RenderPassConfigure passConfig =
+		{
+			.ColorLoad = RenderPassLoadClear,
+			.ClearColor = ColorFromHex(0x204080ff),
+			.DepthLoad = RenderPassLoadClear,
+			.ClearDepth = 1.0,
+			.StencilLoad = RenderPassLoadDontCare,
+			.DiscardDepthStencil = true,
+		};
+		GraphicsBeginPass(frameBuffer, passConfig);
 		GraphicsBindPipeline(pipeline);
 		GraphicsRenderVertexBuffer(vertexBuffer);
 		GraphicsEnd();
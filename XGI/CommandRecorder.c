@@ -0,0 +1,625 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CommandRecorder.h"
+#include "Graphics.h"
+#include "StorageBuffer.h"
+#include "log.h"
+
+CommandRecorder CommandRecorderCreate()
+{
+	CommandRecorder recorder = malloc(sizeof(struct CommandRecorder));
+	*recorder = (struct CommandRecorder)
+	{
+		.Primary = false,
+		.CommandPools = malloc(Graphics.FrameResourceCount * sizeof(VkCommandPool)),
+		.CommandBuffers = malloc(Graphics.FrameResourceCount * sizeof(List)),
+		.UsedCount = calloc(Graphics.FrameResourceCount, sizeof(int)),
+		.ExecutedCount = calloc(Graphics.FrameResourceCount, sizeof(int)),
+		.Recording = false,
+		.CommandBuffer = VK_NULL_HANDLE,
+		.BoundPipeline = NULL,
+		.PipelinePending = false,
+		.Statistics = { 0 },
+		.PacketCount = 0,
+		.PacketCapacity = 0,
+		.Packets = NULL,
+		.SortedPackets = NULL,
+		.PacketDataSize = 0,
+		.PacketDataCapacity = 0,
+		.PacketData = NULL,
+	};
+	CommandRecorderResetState(recorder);
+	
+	VkCommandPoolCreateInfo createInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = Graphics.GraphicsQueueIndex,
+	};
+	for (int i = 0; i < Graphics.FrameResourceCount; i++)
+	{
+		VkResult result = vkCreateCommandPool(Graphics.Device, &createInfo, NULL, &recorder->CommandPools[i]);
+		if (result != VK_SUCCESS)
+		{
+			log_fatal("Trying to create a CommandRecorder, but failed to create VkCommandPool: %i\n", result);
+			exit(1);
+		}
+		recorder->CommandBuffers[i] = ListCreate();
+	}
+	
+	ListPush(Graphics.CommandRecorders, recorder);
+	return recorder;
+}
+
+static void ValidateRecording(CommandRecorder recorder)
+{
+	if (recorder == NULL)
+	{
+		log_fatal("Trying to record commands with an uninitialized CommandRecorder.\n");
+		exit(1);
+	}
+	if (!recorder->Recording)
+	{
+		log_fatal("Trying to record commands, but the CommandRecorder has not began recording.\n");
+		exit(1);
+	}
+}
+
+void CommandRecorderBegin(CommandRecorder recorder)
+{
+	if (recorder == NULL)
+	{
+		log_fatal("Trying to begin recording with an uninitialized CommandRecorder.\n");
+		exit(1);
+	}
+	if (recorder->Primary)
+	{
+		log_fatal("Trying to begin recording with the primary CommandRecorder, it is only recorded between GraphicsBegin and GraphicsEnd.\n");
+		exit(1);
+	}
+	if (recorder->Recording)
+	{
+		log_fatal("Trying to begin recording with a CommandRecorder, but CommandRecorderEnd was never called after the last CommandRecorderBegin.\n");
+		exit(1);
+	}
+	if (Graphics.BoundFrameBuffer == NULL || !Graphics.ParallelRendering)
+	{
+		log_fatal("Trying to begin recording with a CommandRecorder, but rendering has not began with GraphicsBeginParallel.\n");
+		exit(1);
+	}
+	
+	unsigned int i = Graphics.FrameIndex;
+	if (recorder->UsedCount[i] == recorder->CommandBuffers[i]->Count)
+	{
+		VkCommandBufferAllocateInfo allocateInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+			.commandPool = recorder->CommandPools[i],
+			.commandBufferCount = 1,
+		};
+		VkCommandBuffer commandBuffer;
+		vkAllocateCommandBuffers(Graphics.Device, &allocateInfo, &commandBuffer);
+		ListPush(recorder->CommandBuffers[i], commandBuffer);
+	}
+	recorder->CommandBuffer = ListIndex(recorder->CommandBuffers[i], recorder->UsedCount[i]);
+	
+	VkCommandBufferInheritanceInfo inheritanceInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.renderPass = Graphics.BoundRenderPass,
+		.subpass = 0,
+		.framebuffer = Graphics.BoundFrameBuffer->Instance,
+	};
+	VkCommandBufferBeginInfo beginInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+		.pInheritanceInfo = &inheritanceInfo,
+	};
+	VkResult result = vkBeginCommandBuffer(recorder->CommandBuffer, &beginInfo);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to begin recording with a CommandRecorder, but failed to begin command buffer: %i\n", result);
+		exit(1);
+	}
+	recorder->Recording = true;
+	recorder->BoundPipeline = NULL;
+	recorder->PipelinePending = false;
+	CommandRecorderResetState(recorder);
+}
+
+void CommandRecorderResetState(CommandRecorder recorder)
+{
+	recorder->State = (struct CommandRecorderState)
+	{
+		.Pipeline = VK_NULL_HANDLE,
+		.Layout = VK_NULL_HANDLE,
+		.Viewport = { 0, 0 },
+		.StencilSet = false,
+		.DescriptorSet = VK_NULL_HANDLE,
+		.VertexBuffer = VK_NULL_HANDLE,
+		.InstanceBuffer = VK_NULL_HANDLE,
+		.IndexBuffer = VK_NULL_HANDLE,
+		.PushConstantSize = 0,
+	};
+}
+
+static bool Elide(CommandRecorder recorder, bool redundant)
+{
+	if (redundant) { recorder->Statistics.Elided++; }
+	else { recorder->Statistics.Recorded++; }
+	return redundant;
+}
+
+static void Clear(CommandRecorder recorder, Color clearColor, float depth, int stencil, VkImageAspectFlagBits aspect)
+{
+	Vector4 color = ColorToVector4(clearColor);
+	VkClearRect rect =
+	{
+		.baseArrayLayer = 0,
+		.layerCount = 1,
+		.rect =
+		{
+			.offset = { 0, 0 },
+			.extent = { Graphics.BoundFrameBuffer->Width, Graphics.BoundFrameBuffer->Height },
+		},
+	};
+	
+	VkClearAttachment clear = aspect == VK_IMAGE_ASPECT_COLOR_BIT ? (VkClearAttachment)
+	{
+		.aspectMask = aspect,
+		.clearValue = { .color = { color.X, color.Y, color.Z, color.W } },
+	} : (VkClearAttachment)
+	{
+		.aspectMask = aspect,
+		.clearValue = { .depthStencil = { .depth = depth, .stencil = stencil }, }
+	};
+	vkCmdClearAttachments(recorder->CommandBuffer, 1, &clear, 1, &rect);
+}
+
+void CommandRecorderClearColor(CommandRecorder recorder, Color clearColor)
+{
+	ValidateRecording(recorder);
+	Clear(recorder, clearColor, 0.0, 0, VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+void CommandRecorderClearDepth(CommandRecorder recorder, Scalar depth)
+{
+	ValidateRecording(recorder);
+	Clear(recorder, ColorBlack, depth, 0, VK_IMAGE_ASPECT_DEPTH_BIT);
+}
+
+void CommandRecorderClearStencil(CommandRecorder recorder, unsigned int stencil)
+{
+	ValidateRecording(recorder);
+	Clear(recorder, ColorBlack, 0.0, stencil, VK_IMAGE_ASPECT_STENCIL_BIT);
+}
+
+void CommandRecorderClear(CommandRecorder recorder, Color clearColor, Scalar depth, int stencil)
+{
+	ValidateRecording(recorder);
+	Clear(recorder, clearColor, 0.0, 0, VK_IMAGE_ASPECT_COLOR_BIT);
+	Clear(recorder, clearColor, depth, stencil, VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+}
+
+void CommandRecorderBindPipeline(CommandRecorder recorder, Pipeline pipeline)
+{
+	ValidateRecording(recorder);
+	if (pipeline == NULL)
+	{
+		log_fatal("Trying to bind an uninitialized pipeline.\n");
+		exit(1);
+	}
+	if (pipeline->IsCompute)
+	{
+		log_fatal("Trying to bind a compute shader pipeline for rendering operations.\n");
+		exit(1);
+	}
+	
+	// A pipeline that's still being created draws with its fallback, or its draws are skipped until it's ready
+	pipeline = PipelineResolve(pipeline);
+	recorder->PipelinePending = pipeline == NULL;
+	recorder->BoundPipeline = pipeline;
+	if (pipeline == NULL) { return; }
+	struct CommandRecorderState * state = &recorder->State;
+	if (!Elide(recorder, state->Pipeline == pipeline->Instance))
+	{
+		vkCmdBindPipeline(recorder->CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->Instance);
+		state->Pipeline = pipeline->Instance;
+	}
+	if (state->Layout != pipeline->Layout)
+	{
+		// Bindings made with a different layout may be disturbed, so they are treated as unbound
+		state->Layout = pipeline->Layout;
+		state->DescriptorSet = VK_NULL_HANDLE;
+		state->PushConstantSize = 0;
+	}
+	
+	// Every pipeline has a dynamic viewport and scissor, so they stay set across pipeline binds
+	VkExtent2D extent = Graphics.Swapchain.Extent;
+	if (!Elide(recorder, state->Viewport.width == extent.width && state->Viewport.height == extent.height))
+	{
+		VkViewport viewport =
+		{
+			.x = 0.0f,
+			.y = 0.0f,
+			.width = extent.width,
+			.height = extent.height,
+			.minDepth = 0.0f,
+			.maxDepth = 1.0f,
+		};
+		VkRect2D scissor =
+		{
+			.offset = { 0, 0 },
+			.extent = extent,
+		};
+		vkCmdSetViewport(recorder->CommandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(recorder->CommandBuffer, 0, 1, &scissor);
+		state->Viewport = extent;
+	}
+}
+
+static void PushConstants(CommandRecorder recorder, Pipeline pipeline, const unsigned char * data)
+{
+	struct CommandRecorderState * state = &recorder->State;
+	VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	if (pipeline->PushConstantSize > CommandRecorderPushConstantMax)
+	{
+		Elide(recorder, false);
+		vkCmdPushConstants(recorder->CommandBuffer, pipeline->Layout, stages, 0, pipeline->PushConstantSize, data);
+		return;
+	}
+	
+	// Only the range between the first and last changed byte is pushed, rounded out to the 4 byte alignment push constants need
+	unsigned int begin = 0;
+	unsigned int end = pipeline->PushConstantSize;
+	if (state->PushConstantSize == pipeline->PushConstantSize)
+	{
+		while (begin < end && data[begin] == state->PushConstants[begin]) { begin++; }
+		while (end > begin && data[end - 1] == state->PushConstants[end - 1]) { end--; }
+	}
+	if (Elide(recorder, begin == end)) { return; }
+	begin = begin / 4 * 4;
+	end = end + 3 < pipeline->PushConstantSize ? (end + 3) / 4 * 4 : pipeline->PushConstantSize;
+	vkCmdPushConstants(recorder->CommandBuffer, pipeline->Layout, stages, begin, end - begin, data + begin);
+	memcpy(state->PushConstants + begin, data + begin, end - begin);
+	state->PushConstantSize = pipeline->PushConstantSize;
+}
+
+static void BindDrawState(CommandRecorder recorder, VertexBuffer vertexBuffer, VertexBuffer instanceBuffer, const unsigned char * pushConstants)
+{
+	Pipeline pipeline = recorder->BoundPipeline;
+	struct CommandRecorderState * state = &recorder->State;
+	bool stencilBound = state->StencilSet && state->FrontStencilReference == pipeline->FrontStencilReference && state->BackStencilReference == pipeline->BackStencilReference;
+	if (!Elide(recorder, stencilBound))
+	{
+		vkCmdSetStencilReference(recorder->CommandBuffer, VK_STENCIL_FACE_FRONT_BIT, pipeline->FrontStencilReference);
+		vkCmdSetStencilReference(recorder->CommandBuffer, VK_STENCIL_FACE_BACK_BIT, pipeline->BackStencilReference);
+		state->StencilSet = true;
+		state->FrontStencilReference = pipeline->FrontStencilReference;
+		state->BackStencilReference = pipeline->BackStencilReference;
+	}
+	
+	if (pipeline->UsesPushConstant) { PushConstants(recorder, pipeline, pushConstants); }
+	if (pipeline->UsesDescriptors && !Elide(recorder, state->DescriptorSet == pipeline->DescriptorSet[Graphics.FrameIndex]))
+	{
+		vkCmdBindDescriptorSets(recorder->CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->Layout, 0, 1, &pipeline->DescriptorSet[Graphics.FrameIndex], 0, NULL);
+		state->DescriptorSet = pipeline->DescriptorSet[Graphics.FrameIndex];
+	}
+	
+	if (!Elide(recorder, state->VertexBuffer == vertexBuffer->VertexBuffer))
+	{
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(recorder->CommandBuffer, 0, 1, &vertexBuffer->VertexBuffer, &offset);
+		state->VertexBuffer = vertexBuffer->VertexBuffer;
+	}
+	if (pipeline->VertexLayout->BindingCount > 1 && !Elide(recorder, state->InstanceBuffer == instanceBuffer->VertexBuffer))
+	{
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(recorder->CommandBuffer, 1, 1, &instanceBuffer->VertexBuffer, &offset);
+		state->InstanceBuffer = instanceBuffer->VertexBuffer;
+	}
+	if (vertexBuffer->IndexCount > 0)
+	{
+		VkDeviceSize offset = vertexBuffer->VertexCount * vertexBuffer->VertexSize;
+		if (!Elide(recorder, state->IndexBuffer == vertexBuffer->VertexBuffer && state->IndexOffset == offset))
+		{
+			vkCmdBindIndexBuffer(recorder->CommandBuffer, vertexBuffer->VertexBuffer, offset, VK_INDEX_TYPE_UINT32);
+			state->IndexBuffer = vertexBuffer->VertexBuffer;
+			state->IndexOffset = offset;
+		}
+	}
+}
+
+static void Draw(CommandRecorder recorder, VertexBuffer vertexBuffer, VertexBuffer instanceBuffer, int instanceCount, int firstInstance, const unsigned char * pushConstants)
+{
+	BindDrawState(recorder, vertexBuffer, instanceBuffer, pushConstants);
+	if (vertexBuffer->IndexCount > 0) { vkCmdDrawIndexed(recorder->CommandBuffer, vertexBuffer->IndexCount, instanceCount, 0, 0, firstInstance); }
+	else { vkCmdDraw(recorder->CommandBuffer, vertexBuffer->VertexCount, instanceCount, 0, firstInstance); }
+}
+
+static void ValidateDraw(CommandRecorder recorder, VertexBuffer vertexBuffer, VertexBuffer instanceBuffer)
+{
+	ValidateRecording(recorder);
+	if (vertexBuffer == NULL)
+	{
+		log_fatal("Trying to render an uninitialized VertexBuffer.\n");
+		exit(1);
+	}
+	if (recorder->BoundPipeline == NULL)
+	{
+		log_fatal("Trying to render a VertexBuffer, but no Pipeline object has been bound yet.\n");
+		exit(1);
+	}
+	if (recorder->BoundPipeline->VertexLayout->BindingCount > 1 && instanceBuffer == NULL)
+	{
+		log_fatal("Trying to render a VertexBuffer, but the bound Pipeline has instance attributes and no instance buffer was given.\n");
+		exit(1);
+	}
+}
+
+void CommandRecorderRenderVertexBuffer(CommandRecorder recorder, VertexBuffer vertexBuffer)
+{
+	if (recorder->PipelinePending) { return; }
+	ValidateDraw(recorder, vertexBuffer, NULL);
+	Draw(recorder, vertexBuffer, NULL, 1, 0, recorder->BoundPipeline->PushConstantData);
+}
+
+void CommandRecorderRenderVertexBufferInstanced(CommandRecorder recorder, VertexBuffer vertexBuffer, VertexBuffer instanceBuffer, int instanceCount, int firstInstance)
+{
+	if (recorder->PipelinePending) { return; }
+	ValidateDraw(recorder, vertexBuffer, instanceBuffer);
+	if (instanceCount < 0 || firstInstance < 0)
+	{
+		log_fatal("Trying to render a VertexBuffer, but the instance count or first instance is negative.\n");
+		exit(1);
+	}
+	Draw(recorder, vertexBuffer, instanceBuffer, instanceCount, firstInstance, recorder->BoundPipeline->PushConstantData);
+}
+
+static void ValidateIndirect(StorageBuffer buffer, unsigned long offset, unsigned long size)
+{
+	if (buffer == NULL)
+	{
+		log_fatal("Trying to render indirectly, but the StorageBuffer is uninitialized.\n");
+		exit(1);
+	}
+	if (offset % 4 != 0)
+	{
+		log_fatal("Trying to render indirectly, but the offset into the StorageBuffer is not a multiple of 4.\n");
+		exit(1);
+	}
+	if (offset + size > buffer->Size)
+	{
+		log_fatal("Trying to render indirectly, but %lu bytes at offset %lu go past the end of the StorageBuffer of size %lu.\n", size, offset, buffer->Size);
+		exit(1);
+	}
+}
+
+static void ValidateDrawCount(int drawCount, bool multiDraw)
+{
+	if (drawCount <= 0)
+	{
+		log_fatal("Trying to render indirectly, but the draw count %i is not positive.\n", drawCount);
+		exit(1);
+	}
+	if (multiDraw && (unsigned int)drawCount > Graphics.MaxDrawIndirectCount)
+	{
+		log_fatal("Trying to render indirectly, but the draw count %i is more than the device's limit of %u.\n", drawCount, Graphics.MaxDrawIndirectCount);
+		exit(1);
+	}
+}
+
+void CommandRecorderRenderIndirect(CommandRecorder recorder, VertexBuffer vertexBuffer, StorageBuffer arguments, unsigned long offset, int drawCount)
+{
+	if (recorder->PipelinePending) { return; }
+	ValidateDraw(recorder, vertexBuffer, NULL);
+	bool indexed = vertexBuffer->IndexCount > 0;
+	unsigned int stride = indexed ? sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand);
+	ValidateDrawCount(drawCount, Graphics.MultiDrawIndirectSupported);
+	ValidateIndirect(arguments, offset, (unsigned long)drawCount * stride);
+	BindDrawState(recorder, vertexBuffer, NULL, recorder->BoundPipeline->PushConstantData);
+	
+	// Without multiDrawIndirect only one draw can be read per command
+	int commandCount = Graphics.MultiDrawIndirectSupported ? 1 : drawCount;
+	int commandDrawCount = Graphics.MultiDrawIndirectSupported ? drawCount : 1;
+	for (int i = 0; i < commandCount; i++)
+	{
+		VkDeviceSize commandOffset = offset + i * stride;
+		if (indexed) { vkCmdDrawIndexedIndirect(recorder->CommandBuffer, arguments->Buffer, commandOffset, commandDrawCount, stride); }
+		else { vkCmdDrawIndirect(recorder->CommandBuffer, arguments->Buffer, commandOffset, commandDrawCount, stride); }
+	}
+}
+
+void CommandRecorderRenderIndexedIndirectCount(CommandRecorder recorder, VertexBuffer vertexBuffer, StorageBuffer arguments, unsigned long offset, StorageBuffer count, unsigned long countOffset, int maxDrawCount)
+{
+	if (recorder->PipelinePending) { return; }
+	ValidateDraw(recorder, vertexBuffer, NULL);
+	ValidateDrawCount(maxDrawCount, Graphics.DrawIndirectCountSupported || Graphics.MultiDrawIndirectSupported);
+	ValidateIndirect(arguments, offset, (unsigned long)maxDrawCount * sizeof(VkDrawIndexedIndirectCommand));
+	ValidateIndirect(count, countOffset, sizeof(uint32_t));
+	if (vertexBuffer->IndexCount == 0)
+	{
+		log_fatal("Trying to render indexed draws indirectly, but the VertexBuffer has no index buffer.\n");
+		exit(1);
+	}
+	if (!Graphics.DrawIndirectCountSupported)
+	{
+		// The count can't be read by the gpu, so every draw is recorded and unused draws have to be empty
+		CommandRecorderRenderIndirect(recorder, vertexBuffer, arguments, offset, maxDrawCount);
+		return;
+	}
+	
+	BindDrawState(recorder, vertexBuffer, NULL, recorder->BoundPipeline->PushConstantData);
+	Graphics.CmdDrawIndexedIndirectCount(recorder->CommandBuffer, arguments->Buffer, offset, count->Buffer, countOffset, maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+static uint64_t DepthBits(Scalar depth)
+{
+	// The bits of a non-negative float sort the same way as its value
+	float value = depth > 0.0f ? (float)depth : 0.0f;
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+void CommandRecorderQueueDraw(CommandRecorder recorder, Pipeline pipeline, VertexBuffer vertexBuffer, Scalar depth, bool transparent)
+{
+	ValidateRecording(recorder);
+	if (pipeline == NULL || vertexBuffer == NULL)
+	{
+		log_fatal("Trying to queue a draw with an uninitialized Pipeline or VertexBuffer.\n");
+		exit(1);
+	}
+	if (pipeline->IsCompute)
+	{
+		log_fatal("Trying to queue a draw with a compute shader pipeline.\n");
+		exit(1);
+	}
+	if (pipeline->VertexLayout->BindingCount > 1)
+	{
+		log_fatal("Trying to queue a draw with a pipeline that has instance attributes, use CommandRecorderRenderVertexBufferInstanced instead.\n");
+		exit(1);
+	}
+	pipeline = PipelineResolve(pipeline);
+	if (pipeline == NULL) { return; }
+	
+	if (recorder->PacketCount == recorder->PacketCapacity)
+	{
+		recorder->PacketCapacity = recorder->PacketCapacity == 0 ? 256 : 2 * recorder->PacketCapacity;
+		recorder->Packets = realloc(recorder->Packets, recorder->PacketCapacity * sizeof(DrawPacket));
+		recorder->SortedPackets = realloc(recorder->SortedPackets, recorder->PacketCapacity * sizeof(DrawPacket));
+	}
+	size_t pushConstantOffset = recorder->PacketDataSize;
+	if (pipeline->UsesPushConstant)
+	{
+		if (recorder->PacketDataSize + pipeline->PushConstantSize > recorder->PacketDataCapacity)
+		{
+			recorder->PacketDataCapacity = 2 * (recorder->PacketDataSize + pipeline->PushConstantSize);
+			recorder->PacketData = realloc(recorder->PacketData, recorder->PacketDataCapacity);
+		}
+		memcpy(recorder->PacketData + pushConstantOffset, pipeline->PushConstantData, pipeline->PushConstantSize);
+		recorder->PacketDataSize += pipeline->PushConstantSize;
+	}
+	
+	// Opaque keys group by pipeline then depth, transparent keys come after them with the depth inverted so the farthest draw is first.
+	// The top bit is the transparent flag, so both layouts keep the lower 31 bits of the pipeline id which is unique for the first 2^31 pipelines
+	uint64_t id = pipeline->Id & 0x7FFFFFFF;
+	uint64_t key = transparent ? (1ull << 63) | ((~DepthBits(depth) & 0xFFFFFFFF) << 31) | id : (id << 32) | DepthBits(depth);
+	recorder->Packets[recorder->PacketCount++] = (DrawPacket)
+	{
+		.Key = key,
+		.Pipeline = pipeline,
+		.VertexBuffer = vertexBuffer,
+		.PushConstantOffset = pushConstantOffset,
+	};
+}
+
+static void SortPackets(CommandRecorder recorder)
+{
+	int count = recorder->PacketCount;
+	DrawPacket * source = recorder->Packets;
+	DrawPacket * destination = recorder->SortedPackets;
+	for (int shift = 0; shift < 64; shift += CommandRecorderSortRadixBits)
+	{
+		int offsets[1 << CommandRecorderSortRadixBits] = { 0 };
+		for (int i = 0; i < count; i++) { offsets[(source[i].Key >> shift) & ((1 << CommandRecorderSortRadixBits) - 1)]++; }
+		// Digits that every key shares don't change the order, so the pass is skipped
+		if (offsets[(source[0].Key >> shift) & ((1 << CommandRecorderSortRadixBits) - 1)] == count) { continue; }
+		
+		int total = 0;
+		for (int i = 0; i < (1 << CommandRecorderSortRadixBits); i++)
+		{
+			int digitCount = offsets[i];
+			offsets[i] = total;
+			total += digitCount;
+		}
+		for (int i = 0; i < count; i++) { destination[offsets[(source[i].Key >> shift) & ((1 << CommandRecorderSortRadixBits) - 1)]++] = source[i]; }
+		DrawPacket * swap = source;
+		source = destination;
+		destination = swap;
+	}
+	recorder->Packets = source;
+	recorder->SortedPackets = destination;
+}
+
+void CommandRecorderFlushDraws(CommandRecorder recorder)
+{
+	if (recorder->PacketCount == 0) { return; }
+	SortPackets(recorder);
+	for (int i = 0; i < recorder->PacketCount; i++)
+	{
+		DrawPacket packet = recorder->Packets[i];
+		if (recorder->BoundPipeline != packet.Pipeline) { CommandRecorderBindPipeline(recorder, packet.Pipeline); }
+		Draw(recorder, packet.VertexBuffer, NULL, 1, 0, recorder->PacketData + packet.PushConstantOffset);
+	}
+	recorder->PacketCount = 0;
+	recorder->PacketDataSize = 0;
+}
+
+CommandRecorderStatistics CommandRecorderGetStatistics(CommandRecorder recorder)
+{
+	if (recorder == NULL)
+	{
+		log_fatal("Trying to get the statistics of an uninitialized CommandRecorder.\n");
+		exit(1);
+	}
+	return recorder->Statistics;
+}
+
+void CommandRecorderEnd(CommandRecorder recorder)
+{
+	ValidateRecording(recorder);
+	if (recorder->Primary)
+	{
+		log_fatal("Trying to end recording with the primary CommandRecorder, it is only ended with GraphicsEnd.\n");
+		exit(1);
+	}
+	
+	CommandRecorderFlushDraws(recorder);
+	VkResult result = vkEndCommandBuffer(recorder->CommandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to end recording with a CommandRecorder, but failed to record command buffer: %i\n", result);
+		exit(1);
+	}
+	recorder->UsedCount[Graphics.FrameIndex]++;
+	recorder->Recording = false;
+}
+
+void CommandRecorderDestroy(CommandRecorder recorder)
+{
+	if (recorder == NULL)
+	{
+		log_fatal("Trying to destroy an uninitialized CommandRecorder.\n");
+		exit(1);
+	}
+	if (recorder->Primary)
+	{
+		log_fatal("Trying to destroy the primary CommandRecorder, it is destroyed with Graphics.\n");
+		exit(1);
+	}
+	if (recorder->Recording)
+	{
+		log_fatal("Trying to destroy a CommandRecorder, but it is still recording.\n");
+		exit(1);
+	}
+	
+	vkDeviceWaitIdle(Graphics.Device);
+	ListRemoveFirst(Graphics.CommandRecorders, recorder);
+	for (int i = 0; i < Graphics.FrameResourceCount; i++)
+	{
+		vkDestroyCommandPool(Graphics.Device, recorder->CommandPools[i], NULL);
+		ListDestroy(recorder->CommandBuffers[i]);
+	}
+	free(recorder->CommandPools);
+	free(recorder->CommandBuffers);
+	free(recorder->UsedCount);
+	free(recorder->ExecutedCount);
+	free(recorder->Packets);
+	free(recorder->SortedPackets);
+	free(recorder->PacketData);
+	free(recorder);
+}
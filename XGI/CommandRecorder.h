@@ -0,0 +1,188 @@
+#ifndef CommandRecorder_h
+#define CommandRecorder_h
+
+#include <vulkan/vulkan.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "List.h"
+#include "LinearMath.h"
+#include "Pipeline.h"
+#include "VertexBuffer.h"
+
+#define CommandRecorderPushConstantMax 256
+#define CommandRecorderSortRadixBits 8
+
+struct Pipeline;
+struct StorageBuffer;
+
+typedef struct CommandRecorderStatistics
+{
+	/// The number of state commands that were recorded
+	unsigned long Recorded;
+	/// The number of state commands that were skipped because the same state was already bound
+	unsigned long Elided;
+} CommandRecorderStatistics;
+
+typedef struct DrawPacket
+{
+	/// The sort key, opaque draws are sorted by pipeline then front to back, transparent draws after them back to front
+	uint64_t Key;
+	struct Pipeline * Pipeline;
+	VertexBuffer VertexBuffer;
+	/// The offset of the push constant payload in the recorder's packet data
+	size_t PushConstantOffset;
+} DrawPacket;
+
+typedef struct CommandRecorder
+{
+	bool Primary;
+	VkCommandPool * CommandPools;
+	List * CommandBuffers;
+	int * UsedCount;
+	int * ExecutedCount;
+	bool Recording;
+	VkCommandBuffer CommandBuffer;
+	struct Pipeline * BoundPipeline;
+	/// Whether or not the bound pipeline and its fallbacks aren't ready, so draws are skipped
+	bool PipelinePending;
+	struct CommandRecorderState
+	{
+		VkPipeline Pipeline;
+		VkPipelineLayout Layout;
+		VkExtent2D Viewport;
+		bool StencilSet;
+		unsigned int FrontStencilReference;
+		unsigned int BackStencilReference;
+		VkDescriptorSet DescriptorSet;
+		VkBuffer VertexBuffer;
+		VkBuffer InstanceBuffer;
+		VkBuffer IndexBuffer;
+		VkDeviceSize IndexOffset;
+		unsigned int PushConstantSize;
+		unsigned char PushConstants[CommandRecorderPushConstantMax];
+	} State;
+	CommandRecorderStatistics Statistics;
+	int PacketCount;
+	int PacketCapacity;
+	DrawPacket * Packets;
+	DrawPacket * SortedPackets;
+	size_t PacketDataSize;
+	size_t PacketDataCapacity;
+	unsigned char * PacketData;
+} * CommandRecorder;
+
+/// Creates a recorder for recording render commands from another thread.
+/// Each recorder owns a command pool per frame resource, so a recorder should only be used by one thread at a time.
+/// This should be called from the main thread, the commands of each recorder are executed in the order that the recorders were created in.
+/// \return The created command recorder
+CommandRecorder CommandRecorderCreate(void);
+
+/// Begins recording commands into the currently bound framebuffer.
+/// This should only be called after GraphicsBeginParallel and before GraphicsEnd, it can be called from any thread.
+/// \param recorder The recorder to begin recording with
+void CommandRecorderBegin(CommandRecorder recorder);
+
+/// Clears the color of the currently bound framebuffer.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to record the clear with
+/// \param clearColor Color to clear to
+void CommandRecorderClearColor(CommandRecorder recorder, Color clearColor);
+
+/// Clears the depth of the currently bound framebuffer.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to record the clear with
+/// \param depth Depth value to clear to
+void CommandRecorderClearDepth(CommandRecorder recorder, Scalar depth);
+
+/// Clears the stencil of the currently bound framebuffer.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to record the clear with
+/// \param stencil Stencil value to clear to
+void CommandRecorderClearStencil(CommandRecorder recorder, unsigned int stencil);
+
+/// Clears the color, depth and stencil of the currently bound framebuffer.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to record the clear with
+/// \param clearColor Color to clear to
+/// \param depth Depth value to clear to
+/// \param stencil Stencil value to clear to
+void CommandRecorderClear(CommandRecorder recorder, Color clearColor, Scalar depth, int stencil);
+
+/// Binds a pipeline to use for rendering with this recorder.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to bind the pipeline to
+/// \param pipeline The pipeline to bind
+void CommandRecorderBindPipeline(CommandRecorder recorder, struct Pipeline * pipeline);
+
+/// Renders a vertexbuffer using the pipeline bound to the recorder.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to render with
+/// \param vertexBuffer The vertex buffer to render
+void CommandRecorderRenderVertexBuffer(CommandRecorder recorder, VertexBuffer vertexBuffer);
+
+/// Renders several instances of a vertexbuffer in one draw using the pipeline bound to the recorder.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to render with
+/// \param vertexBuffer The vertex buffer to render
+/// \param instanceBuffer The per-instance attributes, it's required if the pipeline's vertex layout was created with instance attributes, otherwise it's ignored
+/// \param instanceCount The number of instances to render
+/// \param firstInstance The first instance to render, instance attributes are read starting at this instance
+void CommandRecorderRenderVertexBufferInstanced(CommandRecorder recorder, VertexBuffer vertexBuffer, VertexBuffer instanceBuffer, int instanceCount, int firstInstance);
+
+/// Renders a vertexbuffer with draw parameters read by the gpu from a storage buffer, see GraphicsRenderIndirect.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to render with
+/// \param vertexBuffer The vertex buffer to render
+/// \param arguments The storage buffer that holds the draw commands
+/// \param offset The byte offset of the first draw command, it must be a multiple of 4
+/// \param drawCount The number of draw commands to read, the commands must fit in the storage buffer
+void CommandRecorderRenderIndirect(CommandRecorder recorder, VertexBuffer vertexBuffer, struct StorageBuffer * arguments, unsigned long offset, int drawCount);
+
+/// Renders a vertexbuffer with indexed draw parameters and the number of draws read by the gpu from storage buffers, see GraphicsRenderIndexedIndirectCount.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to render with
+/// \param vertexBuffer The vertex buffer to render, it must have an index buffer
+/// \param arguments The storage buffer that holds the VkDrawIndexedIndirectCommand records
+/// \param offset The byte offset of the first draw command, it must be a multiple of 4
+/// \param count The storage buffer that holds the number of draws
+/// \param countOffset The byte offset of the number of draws, it must be a multiple of 4
+/// \param maxDrawCount The maximum number of draws to read, that many commands must fit in the storage buffer
+void CommandRecorderRenderIndexedIndirectCount(CommandRecorder recorder, VertexBuffer vertexBuffer, struct StorageBuffer * arguments, unsigned long offset, struct StorageBuffer * count, unsigned long countOffset, int maxDrawCount);
+
+/// Queues a vertex buffer to be rendered with a pipeline, the queued draws are sorted to minimize state changes and recorded at CommandRecorderEnd.
+/// The pipeline's current push constants are captured, so the pipeline can be changed for the next draw.
+/// Opaque draws are recorded first grouped by pipeline and front to back, then transparent draws back to front.
+/// This should only be called after CommandRecorderBegin and before CommandRecorderEnd
+/// \param recorder The recorder to queue the draw with
+/// \param pipeline The pipeline to render with
+/// \param vertexBuffer The vertex buffer to render
+/// \param depth The distance from the camera, it must not be negative
+/// \param transparent Whether or not the draw is blended with what's behind it
+void CommandRecorderQueueDraw(CommandRecorder recorder, struct Pipeline * pipeline, VertexBuffer vertexBuffer, Scalar depth, bool transparent);
+
+/// Sorts and records every queued draw.
+/// This should not be called by the user, it's called in CommandRecorderEnd and GraphicsEnd.
+/// \param recorder The recorder to flush
+void CommandRecorderFlushDraws(CommandRecorder recorder);
+
+/// Gets the number of state commands the recorder recorded and skipped since the last GraphicsUpdate.
+/// \param recorder The recorder to get the statistics of
+/// \return The statistics of the recorder
+CommandRecorderStatistics CommandRecorderGetStatistics(CommandRecorder recorder);
+
+/// Forgets the state that is bound in the command buffer, so the next commands are all recorded.
+/// This should not be called by the user, it's called whenever the recorder starts a new command buffer.
+/// \param recorder The recorder to reset
+void CommandRecorderResetState(CommandRecorder recorder);
+
+/// Ends recording commands, the commands are executed at the next GraphicsEnd.
+/// Draws queued with CommandRecorderQueueDraw are recorded before ending.
+/// \param recorder The recorder to end
+void CommandRecorderEnd(CommandRecorder recorder);
+
+/// Destroys and frees a command recorder.
+/// This waits for the gpu to finish, so it shouldn't be called at render-time.
+/// \param recorder The recorder to destroy
+void CommandRecorderDestroy(CommandRecorder recorder);
+
+#endif
@@ -0,0 +1,325 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include "Culling.h"
+#include "Graphics.h"
+#include "Timeline.h"
+#include "log.h"
+
+/// The layout of the state buffer, it's written in the graphics commands before each dispatch
+struct CullingState
+{
+	Matrix4x4 ViewProjection;
+	Matrix4x4 PyramidViewProjection;
+	unsigned int InstanceCount;
+	unsigned int PyramidLevelCount;
+	unsigned int PyramidWidth;
+	unsigned int PyramidHeight;
+	unsigned int DrawCount;
+};
+
+static const char * CullShader =
+	"#version 450\n"
+	"layout (local_size_x = 64) in;\n"
+	"layout (std430, binding = 0) readonly buffer BoundsBuffer { vec4 Bounds[]; };\n"
+	"layout (std430, binding = 1) readonly buffer DrawsBuffer { uvec4 Draws[]; };\n"
+	"layout (std430, binding = 2) writeonly buffer ArgumentsBuffer { uint Arguments[]; };\n"
+	"layout (std430, binding = 3) buffer StateBuffer\n"
+	"{\n"
+	"	mat4 ViewProjection;\n"
+	"	mat4 PyramidViewProjection;\n"
+	"	uvec4 Counts;\n"
+	"	uint DrawCount;\n"
+	"};\n"
+	"layout (std430, binding = 4) readonly buffer PyramidBuffer { float Pyramid[]; };\n"
+	"\n"
+	"bool InFrustum(vec4 sphere)\n"
+	"{\n"
+	"	mat4 rows = transpose(ViewProjection);\n"
+	"	vec4 planes[6] = vec4[6](rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2]);\n"
+	"	for (int i = 0; i < 6; i++)\n"
+	"	{\n"
+	"		if (dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w * length(planes[i].xyz)) { return false; }\n"
+	"	}\n"
+	"	return true;\n"
+	"}\n"
+	"\n"
+	"bool Occluded(vec4 sphere)\n"
+	"{\n"
+	"	if (Counts.y == 0) { return false; }\n"
+	"	vec2 minUV = vec2(1.0);\n"
+	"	vec2 maxUV = vec2(0.0);\n"
+	"	float nearest = 1.0;\n"
+	"	for (int i = 0; i < 8; i++)\n"
+	"	{\n"
+	"		vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) == 0 ? -1.0 : 1.0, (i & 2) == 0 ? -1.0 : 1.0, (i & 4) == 0 ? -1.0 : 1.0);\n"
+	"		vec4 clip = PyramidViewProjection * vec4(corner, 1.0);\n"
+	"		if (clip.w <= 0.0) { return false; }\n"
+	"		vec3 ndc = clip.xyz / clip.w;\n"
+	"		minUV = min(minUV, ndc.xy * 0.5 + 0.5);\n"
+	"		maxUV = max(maxUV, ndc.xy * 0.5 + 0.5);\n"
+	"		nearest = min(nearest, ndc.z);\n"
+	"	}\n"
+	"	// Nothing is known about what was behind the near plane or outside of the previous view\n"
+	"	if (nearest <= 0.0 || any(lessThan(minUV, vec2(0.0))) || any(greaterThan(maxUV, vec2(1.0)))) { return false; }\n"
+	"	\n"
+	"	vec2 extent = (maxUV - minUV) * vec2(Counts.zw);\n"
+	"	uint level = uint(clamp(ceil(log2(max(max(extent.x, extent.y), 1.0))), 0.0, float(Counts.y - 1)));\n"
+	"	uint offset = 0;\n"
+	"	uvec2 size = Counts.zw;\n"
+	"	for (uint i = 0; i < level; i++)\n"
+	"	{\n"
+	"		offset += size.x * size.y;\n"
+	"		size = (size + 1) / 2;\n"
+	"	}\n"
+	"	uvec2 minTexel = min(uvec2(minUV * vec2(size)), size - 1);\n"
+	"	uvec2 maxTexel = min(uvec2(maxUV * vec2(size)), size - 1);\n"
+	"	float farthest = 0.0;\n"
+	"	for (uint y = minTexel.y; y <= maxTexel.y; y++)\n"
+	"	{\n"
+	"		for (uint x = minTexel.x; x <= maxTexel.x; x++) { farthest = max(farthest, Pyramid[offset + y * size.x + x]); }\n"
+	"	}\n"
+	"	return nearest > farthest;\n"
+	"}\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	uint index = gl_GlobalInvocationID.x;\n"
+	"	if (index >= Counts.x) { return; }\n"
+	"	vec4 sphere = Bounds[index];\n"
+	"	if (!InFrustum(sphere) || Occluded(sphere)) { return; }\n"
+	"	\n"
+	"	uvec4 draw = Draws[index];\n"
+	"	uint slot = atomicAdd(DrawCount, 1) * 5;\n"
+	"	Arguments[slot + 0] = draw.x;\n"
+	"	Arguments[slot + 1] = 1;\n"
+	"	Arguments[slot + 2] = draw.y;\n"
+	"	Arguments[slot + 3] = draw.z;\n"
+	"	Arguments[slot + 4] = index;\n"
+	"}\n";
+
+static const char * PyramidShader =
+	"#version 450\n"
+	"layout (local_size_x = 8, local_size_y = 8) in;\n"
+	"layout (binding = 0) uniform sampler2D DepthTexture;\n"
+	"layout (std430, binding = 1) buffer PyramidBuffer { float Pyramid[]; };\n"
+	"layout (push_constant) uniform Parameters\n"
+	"{\n"
+	"	uvec2 SourceSize;\n"
+	"	uvec2 Size;\n"
+	"	uint SourceOffset;\n"
+	"	uint Offset;\n"
+	"	uint FromDepth;\n"
+	"} Input;\n"
+	"\n"
+	"float Fetch(uvec2 texel)\n"
+	"{\n"
+	"	texel = min(texel, Input.SourceSize - 1);\n"
+	"	if (Input.FromDepth != 0) { return texelFetch(DepthTexture, ivec2(texel), 0).r; }\n"
+	"	return Pyramid[Input.SourceOffset + texel.y * Input.SourceSize.x + texel.x];\n"
+	"}\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	uvec2 texel = gl_GlobalInvocationID.xy;\n"
+	"	if (any(greaterThanEqual(texel, Input.Size))) { return; }\n"
+	"	uvec2 source = texel * 2;\n"
+	"	float farthest = max(max(Fetch(source), Fetch(source + uvec2(1, 0))), max(Fetch(source + uvec2(0, 1)), Fetch(source + uvec2(1, 1))));\n"
+	"	Pyramid[Input.Offset + texel.y * Input.Size.x + texel.x] = farthest;\n"
+	"}\n";
+
+static void CreatePyramid(Culling culling, unsigned int depthWidth, unsigned int depthHeight)
+{
+	// Each level keeps the farthest depth of the 2x2 texels below it, odd sizes round up so every texel is covered
+	culling->PyramidWidth = (depthWidth + 1) / 2;
+	culling->PyramidHeight = (depthHeight + 1) / 2;
+	culling->PyramidLevelCount = 1;
+	int texelCount = culling->PyramidWidth * culling->PyramidHeight;
+	for (unsigned int width = culling->PyramidWidth, height = culling->PyramidHeight; width > 1 || height > 1; culling->PyramidLevelCount++)
+	{
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		texelCount += width * height;
+	}
+	
+	if (culling->Pyramid != NULL) { StorageBufferQueueDestroy(culling->Pyramid); }
+	culling->Pyramid = StorageBufferCreate(culling->PyramidPipeline, 1, texelCount);
+	PipelineSetStorageBuffer(culling->PyramidPipeline, 1, 0, culling->Pyramid);
+	PipelineSetStorageBuffer(culling->CullPipeline, 4, 0, culling->Pyramid);
+	culling->PyramidValid = false;
+}
+
+Culling CullingCreate(int maxInstanceCount)
+{
+	if (maxInstanceCount <= 0)
+	{
+		log_fatal("Trying to create a Culling object, but the maximum instance count must be positive.\n");
+		exit(1);
+	}
+	
+	Culling culling = malloc(sizeof(struct Culling));
+	*culling = (struct Culling){ .MaxInstanceCount = maxInstanceCount };
+	
+	culling->CullPipeline = ComputePipelineCreate(ShaderDataFromMemory(ShaderTypeCompute, strlen(CullShader), (void *)CullShader, false));
+	culling->PyramidPipeline = ComputePipelineCreate(ShaderDataFromMemory(ShaderTypeCompute, strlen(PyramidShader), (void *)PyramidShader, false));
+	
+	culling->Bounds = StorageBufferCreate(culling->CullPipeline, 0, maxInstanceCount);
+	culling->Draws = StorageBufferCreate(culling->CullPipeline, 1, maxInstanceCount);
+	culling->Arguments = StorageBufferCreate(culling->CullPipeline, 2, 5 * maxInstanceCount);
+	culling->State = StorageBufferCreate(culling->CullPipeline, 3, 1);
+	PipelineSetStorageBuffer(culling->CullPipeline, 0, 0, culling->Bounds);
+	PipelineSetStorageBuffer(culling->CullPipeline, 1, 0, culling->Draws);
+	PipelineSetStorageBuffer(culling->CullPipeline, 2, 0, culling->Arguments);
+	PipelineSetStorageBuffer(culling->CullPipeline, 3, 0, culling->State);
+	// The pyramid binding has to be valid before there is a depth source
+	CreatePyramid(culling, 1, 1);
+	
+	return culling;
+}
+
+void CullingSetInstances(Culling culling, int instanceCount, const Vector4 * spheres, const CullingDraw * draws)
+{
+	if (instanceCount < 0 || instanceCount > culling->MaxInstanceCount)
+	{
+		log_fatal("Trying to set %i culling instances, but the Culling object was created for at most %i.\n", instanceCount, culling->MaxInstanceCount);
+		exit(1);
+	}
+	culling->InstanceCount = instanceCount;
+	if (instanceCount == 0) { return; }
+	
+	StorageBufferUploadVariable(culling->Bounds, "Bounds", spheres, instanceCount * sizeof(Vector4));
+	StorageBufferUploadVariable(culling->Draws, "Draws", draws, instanceCount * sizeof(CullingDraw));
+}
+
+void CullingSetDepthSource(Culling culling, FrameBuffer frameBuffer)
+{
+	if (frameBuffer == NULL)
+	{
+		log_fatal("Trying to set the depth source of a Culling object to an uninitialized FrameBuffer.\n");
+		exit(1);
+	}
+	culling->DepthSource = frameBuffer;
+	CreatePyramid(culling, frameBuffer->Width, frameBuffer->Height);
+	PipelineSetSampler(culling->PyramidPipeline, 0, 0, frameBuffer->DepthTexture);
+	// The descriptors are written at the next GraphicsUpdate, so a frame that's already being recorded can't build the pyramid
+	culling->DepthSourceFrame = Graphics.FrameCount;
+}
+
+void CullingDispatch(Culling culling, Matrix4x4 viewProjection)
+{
+	VkCommandBuffer commandBuffer = GraphicsCommandBuffer();
+	GraphicsBeginTiming("Culling");
+	
+	// The draws and the culling of the previous frame are done with the state before it's overwritten
+	VkMemoryBarrier barrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = 0,
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	
+	struct CullingState state =
+	{
+		.ViewProjection = viewProjection,
+		.PyramidViewProjection = culling->PyramidViewProjection,
+		.InstanceCount = culling->InstanceCount,
+		.PyramidLevelCount = culling->PyramidValid ? culling->PyramidLevelCount : 0,
+		.PyramidWidth = culling->PyramidWidth,
+		.PyramidHeight = culling->PyramidHeight,
+		.DrawCount = 0,
+	};
+	vkCmdUpdateBuffer(commandBuffer, culling->State->Buffer, 0, sizeof(state), &state);
+	if (!Graphics.DrawIndirectCountSupported && culling->InstanceCount > 0)
+	{
+		// Every draw is recorded without the count, so the draws that aren't written must be empty
+		vkCmdFillBuffer(commandBuffer, culling->Arguments->Buffer, 0, culling->InstanceCount * sizeof(VkDrawIndexedIndirectCommand), 0);
+	}
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	
+	if (culling->InstanceCount > 0)
+	{
+		GraphicsDispatchInline(culling->CullPipeline, (culling->InstanceCount + CullingGroupSize - 1) / CullingGroupSize, 1, 1);
+	}
+	GraphicsEndTiming();
+}
+
+void CullingRender(Culling culling, VertexBuffer vertexBuffer)
+{
+	if (culling->InstanceCount == 0) { return; }
+	GraphicsRenderIndexedIndirectCount(vertexBuffer, culling->Arguments, 0, culling->State, offsetof(struct CullingState, DrawCount), culling->InstanceCount);
+}
+
+void CullingBuildDepthPyramid(Culling culling, Matrix4x4 viewProjection)
+{
+	if (culling->DepthSource == NULL)
+	{
+		log_fatal("Trying to build the depth pyramid of a Culling object, but no depth source was set with CullingSetDepthSource.\n");
+		exit(1);
+	}
+	VkCommandBuffer commandBuffer = GraphicsCommandBuffer();
+	if (culling->DepthSourceFrame == Graphics.FrameCount) { return; }
+	GraphicsBeginTiming("DepthPyramid");
+	
+	// The depth is read after the rendering has written it, and the pyramid is overwritten after the culling has read it
+	VkMemoryBarrier barrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+	};
+	VkPipelineStageFlags depthStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	vkCmdPipelineBarrier(commandBuffer, depthStages | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	
+	unsigned int sourceSize[2] = { culling->DepthSource->Width, culling->DepthSource->Height };
+	unsigned int size[2] = { culling->PyramidWidth, culling->PyramidHeight };
+	unsigned int sourceOffset = 0;
+	unsigned int offset = 0;
+	unsigned int fromDepth = 1;
+	for (int i = 0; i < culling->PyramidLevelCount; i++)
+	{
+		PipelineSetPushConstant(culling->PyramidPipeline, "SourceSize", sourceSize);
+		PipelineSetPushConstant(culling->PyramidPipeline, "Size", size);
+		PipelineSetPushConstant(culling->PyramidPipeline, "SourceOffset", &sourceOffset);
+		PipelineSetPushConstant(culling->PyramidPipeline, "Offset", &offset);
+		PipelineSetPushConstant(culling->PyramidPipeline, "FromDepth", &fromDepth);
+		// Each dispatch waits on the level before it
+		GraphicsDispatchInline(culling->PyramidPipeline, (size[0] + CullingPyramidGroupSize - 1) / CullingPyramidGroupSize, (size[1] + CullingPyramidGroupSize - 1) / CullingPyramidGroupSize, 1);
+	
+		sourceOffset = offset;
+		offset += size[0] * size[1];
+		sourceSize[0] = size[0];
+		sourceSize[1] = size[1];
+		size[0] = (size[0] + 1) / 2;
+		size[1] = (size[1] + 1) / 2;
+		fromDepth = 0;
+	}
+	
+	// The next rendering to the depth source waits until the pyramid has read it
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, depthStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+	
+	culling->PyramidViewProjection = viewProjection;
+	culling->PyramidValid = true;
+	GraphicsEndTiming();
+}
+
+void CullingQueueDestroy(Culling culling)
+{
+	TimelineRetire(culling, (TimelineDestroyFunction)CullingDestroy);
+}
+
+void CullingDestroy(Culling culling)
+{
+	StorageBufferDestroy(culling->Bounds);
+	StorageBufferDestroy(culling->Draws);
+	StorageBufferDestroy(culling->Arguments);
+	StorageBufferDestroy(culling->State);
+	StorageBufferDestroy(culling->Pyramid);
+	ComputePipelineDestroy(culling->CullPipeline);
+	ComputePipelineDestroy(culling->PyramidPipeline);
+	free(culling);
+}
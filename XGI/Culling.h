@@ -0,0 +1,108 @@
+#ifndef Culling_h
+#define Culling_h
+
+#include <vulkan/vulkan.h>
+#include <stdbool.h>
+#include "LinearMath.h"
+#include "Pipeline.h"
+#include "StorageBuffer.h"
+#include "FrameBuffer.h"
+#include "VertexBuffer.h"
+
+#define CullingGroupSize 64
+#define CullingPyramidGroupSize 8
+
+typedef struct CullingDraw
+{
+	/// The number of indices of the instance's mesh
+	unsigned int IndexCount;
+	/// The first index of the instance's mesh in the index buffer
+	unsigned int FirstIndex;
+	/// The value added to the indices before reading from the vertex buffer
+	int VertexOffset;
+	/// Unused, it keeps the draw the size of a uvec4 in the shader
+	unsigned int Padding;
+} CullingDraw;
+
+typedef struct Culling
+{
+	int MaxInstanceCount;
+	int InstanceCount;
+	ComputePipeline CullPipeline;
+	ComputePipeline PyramidPipeline;
+	StorageBuffer Bounds;
+	StorageBuffer Draws;
+	StorageBuffer Arguments;
+	StorageBuffer State;
+	StorageBuffer Pyramid;
+	FrameBuffer DepthSource;
+	unsigned long DepthSourceFrame;
+	unsigned int PyramidWidth, PyramidHeight;
+	int PyramidLevelCount;
+	bool PyramidValid;
+	Matrix4x4 PyramidViewProjection;
+} * Culling;
+
+/// Creates a gpu culling pass.
+/// Each frame the instances are tested against the view frustum and against a depth pyramid built from the previous frame's depth,
+/// and the visible instances are compacted into indexed indirect draws that are rendered with CullingRender.
+/// Each visible instance is drawn once with its instance index as gl_InstanceIndex, so the vertex shader can read per-instance data from a storage buffer.
+/// \param maxInstanceCount The maximum number of instances that can be culled
+/// \return The culling object
+Culling CullingCreate(int maxInstanceCount);
+
+/// Gets a bounding sphere that contains an axis aligned bounding box, for use with CullingSetInstances.
+/// \param min The minimum corner of the box
+/// \param max The maximum corner of the box
+/// \return The sphere, the center is in xyz and the radius is in w
+static inline Vector4 CullingSphereFromBox(Vector3 min, Vector3 max)
+{
+	Vector3 center = Vector3MultiplyScalar(Vector3Add(min, max), 0.5);
+	Scalar radius = Vector3Length(Vector3Subtract(max, center));
+	return (Vector4){ center.X, center.Y, center.Z, radius };
+}
+
+/// Sets the instances to cull, the previous instances are replaced.
+/// This uploads every instance, so it should only be called when the instances change.
+/// \param culling The culling object
+/// \param instanceCount The number of instances, it must not be more than the maximum instance count
+/// \param spheres The world space bounding sphere of each instance, the center is in xyz and the radius is in w
+/// \param draws The part of the vertex buffer's index buffer to draw for each instance
+void CullingSetInstances(Culling culling, int instanceCount, const Vector4 * spheres, const CullingDraw * draws);
+
+/// Sets the framebuffer whose depth is used to build the depth pyramid.
+/// This must be called again whenever the framebuffer is resized, occlusion culling is skipped until the next pyramid is built.
+/// \param culling The culling object
+/// \param frameBuffer The framebuffer to read the depth from
+void CullingSetDepthSource(Culling culling, FrameBuffer frameBuffer);
+
+/// Culls the instances and records the visible draws.
+/// This should only be called after GraphicsAquireNextImage and outside of GraphicsBegin and GraphicsEnd, before CullingRender.
+/// \param culling The culling object
+/// \param viewProjection The view projection matrix of the camera the instances are rendered with
+void CullingDispatch(Culling culling, Matrix4x4 viewProjection);
+
+/// Renders the draws that survived the last CullingDispatch.
+/// This shoud only be called after GraphicsBegin and before GraphicsEnd.
+/// A pipeline must be bound before calling this
+/// \param culling The culling object
+/// \param vertexBuffer The vertex buffer that every instance's mesh is in, it must have an index buffer
+void CullingRender(Culling culling, VertexBuffer vertexBuffer);
+
+/// Builds the depth pyramid from the depth source, the next CullingDispatch tests the instances against it.
+/// This should be called after the depth source has been rendered to and GraphicsEnd has been called.
+/// \param culling The culling object
+/// \param viewProjection The view projection matrix that the depth was rendered with
+void CullingBuildDepthPyramid(Culling culling, Matrix4x4 viewProjection);
+
+/// Places the culling object into a queue to be destroyed.
+/// This should only be called if the culling object needs to be destroyed at render-time
+/// \param culling The culling object to destroy
+void CullingQueueDestroy(Culling culling);
+
+/// Destroys and frees the culling object
+/// Don't call this unless it's at the initialize or the deinitialize of the application, otherwise use CullingQueueDestroy
+/// \param culling The culling object to destroy
+void CullingDestroy(Culling culling);
+
+#endif
@@ -83,6 +83,7 @@ void EventHandlerPoll()
 		log_error("Trying to poll events, but EventHandler isn't initialized.\n");
 		exit(1);
 	}
+	GraphicsSampleInput();
 	SDL_Event event;
 	while (SDL_PollEvent(&event))
 	{
@@ -218,8 +219,7 @@ void EventHandlerCallbackWindowMoved(int x, int y)
 
 void EventHandlerCallbackWindowResized(int width, int height)
 {
-	GraphicsDestroySwapchain();
-	GraphicsCreateSwapchain(width, height);
+	GraphicsResizeSwapchain(width, height);
 	List list = CallbackLists[EventTypeWindowResized];
 	for (int i = 0; i < list->Count; i++)
 	{
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include "FrameBuffer.h"
 #include "Graphics.h"
+#include "Timeline.h"
 #include "log.h"
 
 static void ValidateFrameBufferObject(FrameBuffer frameBuffer)
@@ -13,6 +14,28 @@ static void ValidateFrameBufferObject(FrameBuffer frameBuffer)
 	}
 }
 
+static void CreateInstance(FrameBuffer frameBuffer)
+{
+	VkImageView attachments[] = { frameBuffer->ColorTexture->ImageView, frameBuffer->DepthTexture->ImageView };
+	VkFramebufferCreateInfo createInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		// Only the formats need to match for the render pass to be compatible, so every variant of it can be used with the framebuffer
+		.renderPass = frameBuffer->ColorTexture->Format == TextureFormatColor ? Graphics.RenderPass : Graphics.SwapchainRenderPass,
+		.attachmentCount = 2,
+		.pAttachments = attachments,
+		.width = frameBuffer->Width,
+		.height = frameBuffer->Height,
+		.layers = 1,
+	};
+	VkResult result = vkCreateFramebuffer(Graphics.Device, &createInfo, NULL, &frameBuffer->Instance);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to create FrameBuffer object, but failed to create VkFramebuffer: %i\n", result);
+		exit(1);
+	}
+}
+
 FrameBuffer FrameBufferCreate(FrameBufferConfigure config)
 {
 	if (config.Width <= 0 || config.Height <= 0)
@@ -47,32 +70,51 @@ FrameBuffer FrameBufferCreate(FrameBufferConfigure config)
 		.AddressMode = config.AddressMode,
 		.AnisotropicFiltering = false,
 		.LoadFromData = false,
+		.Unbound = config.Unbound,
 	};
 	frameBuffer->ColorTexture = TextureCreate(textureConfig);
 	textureConfig.Format = TextureFormatDepthStencil;
 	frameBuffer->DepthTexture = TextureCreate(textureConfig);
+	
+	// The VkFramebuffer needs the image views, which can only be created once the memory is bound
+	if (!config.Unbound) { CreateInstance(frameBuffer); }
+	return frameBuffer;
+}
 
-	VkImageView attachments[] = { frameBuffer->ColorTexture->ImageView, frameBuffer->DepthTexture->ImageView };
-	VkFramebufferCreateInfo createInfo =
+FrameBuffer FrameBufferCreateFromImage(VkImage image, VkFormat format, unsigned int width, unsigned int height, VkImageLayout idleLayout)
+{
+	FrameBuffer frameBuffer = malloc(sizeof(struct FrameBuffer));
+	*frameBuffer = (struct FrameBuffer)
 	{
-		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-		.renderPass = Graphics.RenderPass,
-		.attachmentCount = 2,
-		.pAttachments = attachments,
-		.width = config.Width,
-		.height = config.Height,
-		.layers = 1,
+		.Width = width,
+		.Height = height,
+		.Filter = TextureFilterNearest,
+		.AddressMode = TextureAddressModeClamp,
 	};
-	VkResult result = vkCreateFramebuffer(Graphics.Device, &createInfo, NULL, &frameBuffer->Instance);
-	if (result != VK_SUCCESS)
+	TextureConfigure depthConfig =
 	{
-		log_fatal("Trying to create FrameBuffer object, but failed to create VkFramebuffer: %i\n", result);
-		exit(1);
-	}
-	
+		.Width = width,
+		.Height = height,
+		.Format = TextureFormatDepthStencil,
+		.Filter = TextureFilterNearest,
+		.AddressMode = TextureAddressModeClamp,
+		.AnisotropicFiltering = false,
+		.LoadFromData = false,
+	};
+	frameBuffer->ColorTexture = TextureCreateFromImage(image, format, width, height, idleLayout);
+	frameBuffer->DepthTexture = TextureCreate(depthConfig);
+	CreateInstance(frameBuffer);
 	return frameBuffer;
 }
 
+void FrameBufferBindMemory(FrameBuffer frameBuffer, VmaAllocation colorAllocation, VmaAllocation depthAllocation)
+{
+	ValidateFrameBufferObject(frameBuffer);
+	TextureBindMemory(frameBuffer->ColorTexture, colorAllocation);
+	TextureBindMemory(frameBuffer->DepthTexture, depthAllocation);
+	CreateInstance(frameBuffer);
+}
+
 unsigned int FrameBufferWidth(FrameBuffer frameBuffer)
 {
 	ValidateFrameBufferObject(frameBuffer);
@@ -105,7 +147,6 @@ FrameBuffer FrameBufferResize(FrameBuffer frameBuffer, unsigned int width, unsig
 		log_fatal("Trying to resize FrameBuffer object into a negative width or height.\n");
 		exit(1);
 	}
-	GraphicsStopOperations();
 	FrameBufferConfigure config =
 	{
 		.Width = width,
@@ -121,12 +162,12 @@ FrameBuffer FrameBufferResize(FrameBuffer frameBuffer, unsigned int width, unsig
 void FrameBufferQueueDestroy(FrameBuffer frameBuffer)
 {
 	ValidateFrameBufferObject(frameBuffer);
-	if (ListContains(Graphics.FrameResources[Graphics.FrameIndex].Queues[GraphicsQueueDestroyFrameBuffer], frameBuffer))
+	if (TimelineRetiring(frameBuffer))
 	{
 		log_fatal("Trying to queue destroy a FrameBuffer that was already placed into the queue to be destroyed.\n");
 		exit(1);
 	}
-	ListPush(Graphics.FrameResources[Graphics.FrameIndex].Queues[GraphicsQueueDestroyFrameBuffer], frameBuffer);
+	TimelineRetire(frameBuffer, (TimelineDestroyFunction)FrameBufferDestroy);
 }
 
 void FrameBufferDestroy(FrameBuffer frameBuffer)
@@ -16,6 +16,9 @@ typedef struct FrameBufferConfigure
 	TextureFilter Filter;
 	/// How the texture should be sampled outside the (0, 1) bounds
 	TextureAddressMode AddressMode;
+	/// Whether or not the textures are created without memory, so the memory can be shared with other framebuffers.
+	/// The framebuffer can't be used until its memory is bound with FrameBufferBindMemory.
+	bool Unbound;
 } FrameBufferConfigure;
 
 typedef struct FrameBuffer
@@ -33,6 +36,23 @@ typedef struct FrameBuffer
 /// \return The framebuffer object
 FrameBuffer FrameBufferCreate(FrameBufferConfigure config);
 
+/// Creates a framebuffer object that renders into an image owned by something else, like a swapchain image, with its own depth-stencil texture.
+/// The image isn't destroyed with the framebuffer.
+/// \param image The color image to render into
+/// \param format The format of the image
+/// \param width The width of the image
+/// \param height The height of the image
+/// \param idleLayout The layout the image is in now, and that it's left in after rendering
+/// \return The framebuffer object
+FrameBuffer FrameBufferCreateFromImage(VkImage image, VkFormat format, unsigned int width, unsigned int height, VkImageLayout idleLayout);
+
+/// Binds memory to a framebuffer that was created unbound.
+/// The memory is still owned by the caller, and the contents and layouts of the textures are undefined until they're transitioned.
+/// \param frameBuffer The framebuffer object
+/// \param colorAllocation The memory for the color texture
+/// \param depthAllocation The memory for the depth-stencil texture
+void FrameBufferBindMemory(FrameBuffer frameBuffer, VmaAllocation colorAllocation, VmaAllocation depthAllocation);
+
 /// Gets the width from a framebuffer object
 /// \param frameBuffer The framebuffer object
 /// \return The width
@@ -1,4 +1,5 @@
 #include <SDL2/SDL_vulkan.h>
+#include <SDL2/SDL_timer.h>
 #include <string.h>
 #include <stdio.h>
 #include "log.h"
@@ -6,6 +7,10 @@
 #include "Window.h"
 #include "VertexBuffer.h"
 #include "LinearMath.h"
+#include "Upload.h"
+#include "Timeline.h"
+#include "File.h"
+#include "Worker.h"
 
 struct Graphics Graphics = { 0 };
 
@@ -15,7 +20,7 @@ static bool CheckValidationLayerSupport()
 	vkEnumerateInstanceLayerProperties(&availableLayerCount, NULL);
 	VkLayerProperties * availableLayers = malloc(availableLayerCount * sizeof(VkLayerProperties));
 	vkEnumerateInstanceLayerProperties(&availableLayerCount, availableLayers);
-
+	
 	bool supported = false;
 	for (int i = 0; i < availableLayerCount; i++)
 	{
@@ -77,10 +82,14 @@ static void CreateInstance(bool vulkanValidation)
 		.apiVersion = VK_API_VERSION_1_0,
 	};
 	
-	unsigned int extensionCount;
-	SDL_Vulkan_GetInstanceExtensions(Window.Handle, &extensionCount, NULL);
-	char ** extensionNames = (char ** )malloc(extensionCount * sizeof(char * ));
-	SDL_Vulkan_GetInstanceExtensions(Window.Handle, &extensionCount, (const char ** )extensionNames);
+	unsigned int extensionCount = 0;
+	char ** extensionNames = NULL;
+	if (!Graphics.Headless)
+	{
+		SDL_Vulkan_GetInstanceExtensions(Window.Handle, &extensionCount, NULL);
+		extensionNames = (char ** )malloc(extensionCount * sizeof(char * ));
+		SDL_Vulkan_GetInstanceExtensions(Window.Handle, &extensionCount, (const char ** )extensionNames);
+	}
 	
 	VkInstanceCreateInfo createInfo =
 	{
@@ -123,18 +132,23 @@ static void ChoosePhysicalDevice(bool useIntegrated)
 	
 	Graphics.PhysicalDevice = devices[0];
 	
-	struct
-	{
-		bool GraphicsFound;
-		int Graphics;
-		bool PresentFound;
-		int Present;
-		bool ComputeFound;
-		int Compute;
-	} queues = { .GraphicsFound = false, .PresentFound = false, .ComputeFound = false };
 	bool suitableDevice = false;
 	for (int i = 0; i < deviceCount; i++)
 	{
+		struct
+		{
+			bool GraphicsFound;
+			bool GraphicsCompute;
+			int Graphics;
+			bool PresentFound;
+			int Present;
+			bool ComputeFound;
+			bool ComputeDedicated;
+			int Compute;
+			bool TransferFound;
+			int Transfer;
+		} queues = { .GraphicsFound = false, .GraphicsCompute = false, .PresentFound = false, .ComputeFound = false, .ComputeDedicated = false, .TransferFound = false };
+		
 		VkPhysicalDeviceProperties deviceProperties;
 		vkGetPhysicalDeviceProperties(devices[i], &deviceProperties);
 		
@@ -147,15 +161,27 @@ static void ChoosePhysicalDevice(bool useIntegrated)
 			if (queueFamilies[j].queueCount > 0 && queueFamilies[j].queueFlags & VK_QUEUE_GRAPHICS_BIT && !queues.GraphicsFound)
 			{
 				queues.GraphicsFound = true;
+				queues.GraphicsCompute = queueFamilies[j].queueFlags & VK_QUEUE_COMPUTE_BIT;
 				queues.Graphics = j;
 			}
-			if (queueFamilies[j].queueCount > 0 && queueFamilies[j].queueFlags & VK_QUEUE_COMPUTE_BIT && !queues.ComputeFound)
+			// A compute family without graphics support runs asynchronously to rendering, so it is preferred
+			bool computeDedicated = !(queueFamilies[j].queueFlags & VK_QUEUE_GRAPHICS_BIT);
+			if (queueFamilies[j].queueCount > 0 && queueFamilies[j].queueFlags & VK_QUEUE_COMPUTE_BIT && (!queues.ComputeFound || (computeDedicated && !queues.ComputeDedicated)))
 			{
 				queues.ComputeFound = true;
+				queues.ComputeDedicated = computeDedicated;
 				queues.Compute = j;
 			}
+			// A transfer only family is usually backed by the copy engine, so uploads don't take time from rendering
+			bool transferDedicated = !(queueFamilies[j].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+			if (queueFamilies[j].queueCount > 0 && queueFamilies[j].queueFlags & VK_QUEUE_TRANSFER_BIT && transferDedicated && !queues.TransferFound)
+			{
+				queues.TransferFound = true;
+				queues.Transfer = j;
+			}
 			VkBool32 presentSupported = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], j, Graphics.Surface, &presentSupported);
+			if (Graphics.Headless) { presentSupported = queueFamilies[j].queueFlags & VK_QUEUE_GRAPHICS_BIT; }
+			else { vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], j, Graphics.Surface, &presentSupported); }
 			if (queueFamilies[j].queueCount > 0 && presentSupported && !queues.PresentFound)
 			{
 				queues.PresentFound = true;
@@ -178,17 +204,16 @@ static void ChoosePhysicalDevice(bool useIntegrated)
 		}
 		free(availableExtensions);
 		
-		Graphics.ComputeQueueSupported = false;
-		if (queues.ComputeFound)
-		{
-			Graphics.ComputeQueueSupported = true;
-			Graphics.ComputeQueueIndex = queues.Compute;
-		}
-		if (queues.GraphicsFound && queues.PresentFound && swapchainSupported)
+		if (queues.GraphicsFound && queues.PresentFound && queues.ComputeFound && (swapchainSupported || Graphics.Headless))
 		{
 			suitableDevice = true;
 			Graphics.GraphicsQueueIndex = queues.Graphics;
 			Graphics.PresentQueueIndex = queues.Present;
+			// Without a dedicated family compute shares the graphics family, unless it doesn't support compute, then the first family that does is used
+			Graphics.ComputeQueueSupported = queues.ComputeDedicated || !queues.GraphicsCompute;
+			Graphics.ComputeQueueIndex = Graphics.ComputeQueueSupported ? queues.Compute : queues.Graphics;
+			Graphics.TransferQueueSupported = queues.TransferFound;
+			Graphics.TransferQueueIndex = Graphics.TransferQueueSupported ? queues.Transfer : queues.Graphics;
 			Graphics.PhysicalDevice = devices[i];
 			if (!useIntegrated && deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
 			{
@@ -209,13 +234,25 @@ static void ChoosePhysicalDevice(bool useIntegrated)
 	vkGetPhysicalDeviceProperties(Graphics.PhysicalDevice, &deviceProperties);
 	log_info("Using graphics device: %s\n", deviceProperties.deviceName);
 	free(devices);
+	
+	// Buffers that are used on more than one queue family are shared concurrently between these families
+	Graphics.SharedQueueCount = 0;
+	Graphics.SharedQueueIndices[Graphics.SharedQueueCount++] = Graphics.GraphicsQueueIndex;
+	if (Graphics.ComputeQueueIndex != Graphics.GraphicsQueueIndex)
+	{
+		Graphics.SharedQueueIndices[Graphics.SharedQueueCount++] = Graphics.ComputeQueueIndex;
+	}
+	if (Graphics.TransferQueueIndex != Graphics.GraphicsQueueIndex && Graphics.TransferQueueIndex != Graphics.ComputeQueueIndex)
+	{
+		Graphics.SharedQueueIndices[Graphics.SharedQueueCount++] = Graphics.TransferQueueIndex;
+	}
 }
 
 static void CreateLogicalDevice()
 {
 	float queuePriority = 1.0f;
 	int queueCount = 0;
-	VkDeviceQueueCreateInfo queueInfos[3];
+	VkDeviceQueueCreateInfo queueInfos[4];
 	
 	VkDeviceQueueCreateInfo graphicsQueueInfo =
 	{
@@ -249,19 +286,60 @@ static void CreateLogicalDevice()
 			.queueCount = 1,
 			.pQueuePriorities = &queuePriority,
 		};
-		if (Graphics.ComputeQueueIndex != Graphics.GraphicsQueueIndex && Graphics.ComputeQueueIndex != Graphics.ComputeQueueIndex)
+		if (Graphics.ComputeQueueIndex != Graphics.GraphicsQueueIndex && Graphics.ComputeQueueIndex != Graphics.PresentQueueIndex)
 		{
 			queueInfos[queueCount] = computeQueueInfo;
 			queueCount++;
 		}
 	}
 	
+	if (Graphics.TransferQueueSupported)
+	{
+		VkDeviceQueueCreateInfo transferQueueInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = Graphics.TransferQueueIndex,
+			.queueCount = 1,
+			.pQueuePriorities = &queuePriority,
+		};
+		if (Graphics.TransferQueueIndex != Graphics.PresentQueueIndex)
+		{
+			queueInfos[queueCount] = transferQueueInfo;
+			queueCount++;
+		}
+	}
+	
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(Graphics.PhysicalDevice, &supportedFeatures);
+	Graphics.MultiDrawIndirectSupported = supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance;
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(Graphics.PhysicalDevice, &deviceProperties);
+	Graphics.MaxDrawIndirectCount = deviceProperties.limits.maxDrawIndirectCount;
 	VkPhysicalDeviceFeatures deviceFeatures =
 	{
 		.fillModeNonSolid = true,
 		.samplerAnisotropy = true,
+		.multiDrawIndirect = Graphics.MultiDrawIndirectSupported,
+		.drawIndirectFirstInstance = Graphics.MultiDrawIndirectSupported,
 	};
-	const char * extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	
+	int extensionCount = 0;
+	const char * extensions[2];
+	if (!Graphics.Headless) { extensions[extensionCount++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME; }
+	Graphics.DrawIndirectCountSupported = false;
+	unsigned int availableExtensionCount;
+	vkEnumerateDeviceExtensionProperties(Graphics.PhysicalDevice, NULL, &availableExtensionCount, NULL);
+	VkExtensionProperties * availableExtensions = malloc(availableExtensionCount * sizeof(VkExtensionProperties));
+	vkEnumerateDeviceExtensionProperties(Graphics.PhysicalDevice, NULL, &availableExtensionCount, availableExtensions);
+	for (int i = 0; i < availableExtensionCount; i++)
+	{
+		if (strcmp(availableExtensions[i].extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+		{
+			Graphics.DrawIndirectCountSupported = true;
+			extensions[extensionCount++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+		}
+	}
+	free(availableExtensions);
 	
 	VkDeviceCreateInfo deviceInfo =
 	{
@@ -269,7 +347,7 @@ static void CreateLogicalDevice()
 		.queueCreateInfoCount = queueCount,
 		.pQueueCreateInfos = queueInfos,
 		.pEnabledFeatures = &deviceFeatures,
-		.enabledExtensionCount = 1,
+		.enabledExtensionCount = extensionCount,
 		.ppEnabledExtensionNames = extensions,
 		.enabledLayerCount = 0,
 		.ppEnabledLayerNames = NULL,
@@ -284,10 +362,159 @@ static void CreateLogicalDevice()
 	
 	vkGetDeviceQueue(Graphics.Device, Graphics.GraphicsQueueIndex, 0, &Graphics.GraphicsQueue);
 	vkGetDeviceQueue(Graphics.Device, Graphics.PresentQueueIndex, 0, &Graphics.PresentQueue);
-	if (Graphics.ComputeQueueSupported) { vkGetDeviceQueue(Graphics.Device, Graphics.ComputeQueueIndex, 0, &Graphics.ComputeQueue); }
+	vkGetDeviceQueue(Graphics.Device, Graphics.ComputeQueueIndex, 0, &Graphics.ComputeQueue);
+	vkGetDeviceQueue(Graphics.Device, Graphics.TransferQueueIndex, 0, &Graphics.TransferQueue);
+	Graphics.CmdDrawIndexedIndirectCount = NULL;
+	if (Graphics.DrawIndirectCountSupported)
+	{
+		Graphics.CmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(Graphics.Device, "vkCmdDrawIndexedIndirectCountKHR");
+		Graphics.DrawIndirectCountSupported = Graphics.CmdDrawIndexedIndirectCount != NULL;
+	}
+}
+
+static void CheckTimestampSupport(bool requested)
+{
+	Graphics.TimingsEnabled = false;
+	if (!requested) { return; }
+	
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(Graphics.PhysicalDevice, &deviceProperties);
+	unsigned int queueFamilyCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(Graphics.PhysicalDevice, &queueFamilyCount, NULL);
+	VkQueueFamilyProperties * queueFamilies = malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+	vkGetPhysicalDeviceQueueFamilyProperties(Graphics.PhysicalDevice, &queueFamilyCount, queueFamilies);
+	unsigned int graphicsBits = queueFamilies[Graphics.GraphicsQueueIndex].timestampValidBits;
+	unsigned int computeBits = queueFamilies[Graphics.ComputeQueueIndex].timestampValidBits;
+	free(queueFamilies);
+	
+	if (graphicsBits == 0 || computeBits == 0)
+	{
+		log_warn("Gpu timings were requested, but timestamps are not supported by the graphics device.\n");
+		return;
+	}
+	Graphics.TimingsEnabled = true;
+	Graphics.TimestampPeriod = deviceProperties.limits.timestampPeriod;
+	Graphics.TimestampMask = graphicsBits >= 64 ? UINT64_MAX : (1ull << graphicsBits) - 1;
+	Graphics.ComputeTimestampMask = computeBits >= 64 ? UINT64_MAX : (1ull << computeBits) - 1;
+}
+
+static void PipelineCachePath(char * path, size_t size)
+{
+	// The driver rejects data from other devices and drivers, keying the file by them keeps one cache per device instead of overwriting each other
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(Graphics.PhysicalDevice, &deviceProperties);
+	int length = snprintf(path, size, "%s/pipelines-%x-%x-%x-", Graphics.CacheDirectory, deviceProperties.vendorID, deviceProperties.deviceID, deviceProperties.driverVersion);
+	for (int i = 0; i < VK_UUID_SIZE && length + 2 < size; i++, length += 2) { snprintf(path + length, size - length, "%02x", deviceProperties.pipelineCacheUUID[i]); }
+	snprintf(path + length, size - length, ".cache");
+}
+
+static bool ValidatePipelineCacheData(const unsigned char * data, unsigned long size)
+{
+	if (size < 16 + VK_UUID_SIZE) { return false; }
+	uint32_t header[4];
+	memcpy(header, data, sizeof(header));
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(Graphics.PhysicalDevice, &deviceProperties);
+	return header[0] >= 16 + VK_UUID_SIZE && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header[2] == deviceProperties.vendorID && header[3] == deviceProperties.deviceID &&
+		memcmp(data + 16, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static void CreatePipelineCache()
+{
+	unsigned long size = 0;
+	void * data = NULL;
+	if (Graphics.CacheDirectory != NULL)
+	{
+		char path[1024];
+		PipelineCachePath(path, sizeof(path));
+		if (FileExists(path))
+		{
+			File file = FileOpen(path, FileModeReadBinary);
+			size = FileGetSize(file);
+			data = malloc(size);
+			FileRead(file, 0, size, data);
+			FileClose(file);
+			if (!ValidatePipelineCacheData(data, size))
+			{
+				log_warn("Pipeline cache %s doesn't match the device, starting with an empty cache.\n", path);
+				size = 0;
+			}
+			else { log_info("Loaded %lu bytes of cached pipelines from %s.\n", size, path); }
+		}
+	}
+	
+	VkPipelineCacheCreateInfo createInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = size,
+		.pInitialData = size == 0 ? NULL : data,
+	};
+	VkResult result = vkCreatePipelineCache(Graphics.Device, &createInfo, NULL, &Graphics.PipelineCache);
+	if (result != VK_SUCCESS && size > 0)
+	{
+		// Data that passes the header check can still be rejected by the driver
+		log_warn("Failed to create the pipeline cache from its data: %i\n", result);
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = NULL;
+		result = vkCreatePipelineCache(Graphics.Device, &createInfo, NULL, &Graphics.PipelineCache);
+	}
+	free(data);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Failed to create the pipeline cache: %i\n", result);
+		exit(1);
+	}
 }
 
-static void CreateSwapchain(int width, int height)
+static void SavePipelineCache()
+{
+	if (Graphics.CacheDirectory == NULL) { return; }
+	size_t size = 0;
+	vkGetPipelineCacheData(Graphics.Device, Graphics.PipelineCache, &size, NULL);
+	void * data = malloc(size);
+	VkResult result = vkGetPipelineCacheData(Graphics.Device, Graphics.PipelineCache, &size, data);
+	if (result != VK_SUCCESS || !ValidatePipelineCacheData(data, size))
+	{
+		log_warn("Failed to get the pipeline cache data: %i\n", result);
+		free(data);
+		return;
+	}
+	
+	// It's written next to the cache and renamed over it, so a launch that's stopped while writing doesn't leave a partial cache
+	char path[1024];
+	char temporaryPath[1040];
+	PipelineCachePath(path, sizeof(path));
+	snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+	// Saving is best effort, a missing or read only cache directory shouldn't stop the application from closing
+	FILE * file = fopen(temporaryPath, "wb");
+	if (file == NULL)
+	{
+		log_warn("Failed to open %s to save the pipeline cache.\n", temporaryPath);
+		free(data);
+		return;
+	}
+	bool written = fwrite(data, 1, size, file) == size;
+	written &= fclose(file) == 0;
+	free(data);
+	if (!written)
+	{
+		log_warn("Failed to write the pipeline cache to %s.\n", temporaryPath);
+		remove(temporaryPath);
+		return;
+	}
+#ifdef _WIN32
+	// Renaming doesn't replace an existing file on Windows
+	remove(path);
+#endif
+	if (rename(temporaryPath, path) != 0)
+	{
+		log_warn("Failed to save the pipeline cache to %s.\n", path);
+		return;
+	}
+	log_info("Saved %lu bytes of cached pipelines to %s.\n", (unsigned long)size, path);
+}
+
+static void CreateSwapchain(int width, int height, VkSwapchainKHR oldSwapchain)
 {
 	VkSurfaceCapabilitiesKHR availableCapabilities;
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(Graphics.PhysicalDevice, Graphics.Surface, &availableCapabilities);
@@ -297,12 +524,18 @@ static void CreateSwapchain(int width, int height)
 	VkSurfaceFormatKHR * availableFormats = (VkSurfaceFormatKHR * )malloc(availableFormatCount * sizeof(VkSurfaceFormatKHR));
 	vkGetPhysicalDeviceSurfaceFormatsKHR(Graphics.PhysicalDevice, Graphics.Surface, &availableFormatCount, availableFormats);
 	VkSurfaceFormatKHR surfaceFormat = availableFormats[0];
-	VkFormat targetFormat = VK_FORMAT_B8G8R8A8_UNORM;
-	for (int i = 0; i < availableFormatCount; i++)
+	// The color texture format is preferred so framebuffers can be copied into the swapchain without conversion
+	VkFormat targetFormats[] = { (VkFormat)TextureFormatColor, VK_FORMAT_B8G8R8A8_UNORM };
+	bool found = false;
+	for (int j = 0; j < sizeof(targetFormats) / sizeof(targetFormats[0]) && !found; j++)
 	{
-		if (availableFormats[i].format == targetFormat)
+		for (int i = 0; i < availableFormatCount; i++)
 		{
-			surfaceFormat = availableFormats[i];
+			if (availableFormats[i].format == targetFormats[j])
+			{
+				surfaceFormat = availableFormats[i];
+				found = true;
+			}
 		}
 	}
 	free(availableFormats);
@@ -337,7 +570,9 @@ static void CreateSwapchain(int width, int height)
 		log_warn("Tried to create swapchain with dimensions (%i, %i) but (%i, %i) was chosen instead.\n", width, height, extent.width, extent.height);
 	}
 	
-	unsigned int imageCount = MAX(availableCapabilities.minImageCount, MIN(3, availableCapabilities.maxImageCount));
+	// A max image count of 0 means there is no limit
+	unsigned int imageCount = MAX(availableCapabilities.minImageCount, Graphics.Swapchain.TargetImageCount);
+	if (availableCapabilities.maxImageCount > 0) { imageCount = MIN(imageCount, availableCapabilities.maxImageCount); }
 	log_info("Initializing swapchain with %i images.\n", imageCount);
 	
 	VkSwapchainCreateInfoKHR createInfo =
@@ -354,7 +589,8 @@ static void CreateSwapchain(int width, int height)
 		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
 		.presentMode = (VkPresentModeKHR)Graphics.Swapchain.PresentMode,
 		.clipped = VK_TRUE,
-		.oldSwapchain = VK_NULL_HANDLE,
+		// Passing the old swapchain lets the images that are still being presented be handed over without waiting
+		.oldSwapchain = oldSwapchain,
 	};
 	
 	const uint32_t queueFamilyIndices[] = { Graphics.GraphicsQueueIndex, Graphics.PresentQueueIndex };
@@ -375,84 +611,61 @@ static void CreateSwapchain(int width, int height)
 		log_fatal("Trying to create swapchain, but failed to create VkSwapchainKHR: %i\n", result);
 		exit(1);
 	}
-
+	
 	Graphics.Swapchain.Extent = extent;
 	Graphics.Swapchain.ColorFormat = surfaceFormat.format;
 	Window.Width = Graphics.Swapchain.Extent.width;
 	Window.Height = Graphics.Swapchain.Extent.height;
 }
 
-static void GetSwapchainImages()
+static void CreateHeadlessSwapchain(int width, int height)
 {
-	vkGetSwapchainImagesKHR(Graphics.Device, Graphics.Swapchain.Instance, &Graphics.Swapchain.ImageCount, NULL);
-	Graphics.Swapchain.Images = malloc(Graphics.Swapchain.ImageCount * sizeof(VkImage));
-	vkGetSwapchainImagesKHR(Graphics.Device, Graphics.Swapchain.Instance, &Graphics.Swapchain.ImageCount, Graphics.Swapchain.Images);
+	Graphics.Swapchain.Instance = VK_NULL_HANDLE;
+	Graphics.Swapchain.PresentMode = Graphics.Swapchain.TargetPresentMode;
+	Graphics.Swapchain.Extent = (VkExtent2D){ .width = width, .height = height };
+	Graphics.Swapchain.ColorFormat = (VkFormat)TextureFormatColor;
+	Graphics.Swapchain.ImageCount = Graphics.FrameResourceCount;
+	Graphics.Swapchain.CurrentImageIndex = 0;
+	log_info("Initializing headless swapchain with %i images.\n", Graphics.Swapchain.ImageCount);
 	
-	VkCommandBuffer commandBuffer;
-	VkCommandBufferAllocateInfo commandAllocateInfo =
+	FrameBufferConfigure config =
 	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandPool = Graphics.CommandPool,
-		.commandBufferCount = 1,
+		.Width = width,
+		.Height = height,
+		.Filter = TextureFilterNearest,
+		.AddressMode = TextureAddressModeClamp,
 	};
-	vkAllocateCommandBuffers(Graphics.Device, &commandAllocateInfo, &commandBuffer);
-	VkCommandBufferBeginInfo beginInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
-	
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	Graphics.Swapchain.FrameBuffers = malloc(Graphics.Swapchain.ImageCount * sizeof(FrameBuffer));
+	Graphics.Swapchain.Images = malloc(Graphics.Swapchain.ImageCount * sizeof(VkImage));
 	for (int i = 0; i < Graphics.Swapchain.ImageCount; i++)
 	{
-		VkImageMemoryBarrier memoryBarrier =
-		{
-			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.image = Graphics.Swapchain.Images[i],
-			.subresourceRange =
-			{
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.baseMipLevel = 0,
-				.levelCount = 1,
-				.baseArrayLayer = 0,
-				.layerCount = 1,
-			},
-			.srcAccessMask = 0,
-			.dstAccessMask = 0,
-		};
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &memoryBarrier);
+		Graphics.Swapchain.FrameBuffers[i] = FrameBufferCreate(config);
+		Graphics.Swapchain.Images[i] = Graphics.Swapchain.FrameBuffers[i]->ColorTexture->Image;
 	}
-	vkEndCommandBuffer(commandBuffer);
-	
-	VkSubmitInfo submitInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &commandBuffer,
-	};
-	vkQueueSubmit(Graphics.GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkDeviceWaitIdle(Graphics.Device);
-	
-	vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, 1, &commandBuffer);
+	Window.Width = width;
+	Window.Height = height;
 }
 
-static void CreateRenderPass()
+static void GetSwapchainImages()
+{
+	vkGetSwapchainImagesKHR(Graphics.Device, Graphics.Swapchain.Instance, &Graphics.Swapchain.ImageCount, NULL);
+	Graphics.Swapchain.Images = malloc(Graphics.Swapchain.ImageCount * sizeof(VkImage));
+	vkGetSwapchainImagesKHR(Graphics.Device, Graphics.Swapchain.Instance, &Graphics.Swapchain.ImageCount, Graphics.Swapchain.Images);
+}
+
+static VkRenderPass CreateRenderPass(struct GraphicsRenderPassKey key)
 {
 	VkAttachmentDescription colorAttachment =
 	{
-		.format = (VkFormat)TextureFormatColor,
+		.format = key.ColorFormat,
 		.samples = VK_SAMPLE_COUNT_1_BIT,
-		.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
-		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
-		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE,
-		.initialLayout = VK_IMAGE_LAYOUT_GENERAL,
-		.finalLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.loadOp = key.ColorLoad,
+		.storeOp = key.ColorStore,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		// Contents that aren't loaded don't need to be preserved through the transition
+		.initialLayout = key.ColorLoad == VK_ATTACHMENT_LOAD_OP_LOAD ? key.ColorLayout : VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = key.ColorLayout,
 	};
 	VkAttachmentReference colorAttachmentReference =
 	{
@@ -462,14 +675,14 @@ static void CreateRenderPass()
 	
 	VkAttachmentDescription depthAttachment =
 	{
-		.format = (VkFormat)TextureFormatDepthStencil,
+		.format = key.DepthFormat,
 		.samples = VK_SAMPLE_COUNT_1_BIT,
-		.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
-		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
-		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE,
-		.initialLayout = VK_IMAGE_LAYOUT_GENERAL,
-		.finalLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.loadOp = key.DepthLoad,
+		.storeOp = key.DepthStore,
+		.stencilLoadOp = key.StencilLoad,
+		.stencilStoreOp = key.StencilStore,
+		.initialLayout = key.DepthLoad == VK_ATTACHMENT_LOAD_OP_LOAD || key.StencilLoad == VK_ATTACHMENT_LOAD_OP_LOAD ? TextureShaderLayout(TextureFormatDepthStencil) : VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = TextureShaderLayout(TextureFormatDepthStencil),
 	};
 	VkAttachmentReference depthAttachmentReference =
 	{
@@ -485,6 +698,30 @@ static void CreateRenderPass()
 		.pDepthStencilAttachment = &depthAttachmentReference,
 	};
 	
+	// Attachments rest in their shader layouts between render passes, so the transitions wait on earlier sampling and copies,
+	// and the writes are made visible to whatever samples or copies them afterwards
+	VkSubpassDependency dependencies[] =
+	{
+		{
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = TextureShaderStages,
+			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			.dependencyFlags = 0,
+		},
+		{
+			.srcSubpass = 0,
+			.dstSubpass = VK_SUBPASS_EXTERNAL,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.dstStageMask = TextureShaderStages,
+			.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+			.dependencyFlags = 0,
+		},
+	};
+	
 	VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment };
 	VkRenderPassCreateInfo renderPassInfo =
 	{
@@ -493,15 +730,48 @@ static void CreateRenderPass()
 		.pAttachments = attachments,
 		.subpassCount = 1,
 		.pSubpasses = &subpass,
-		.dependencyCount = 0,
-		.pDependencies = NULL,
+		.dependencyCount = 2,
+		.pDependencies = dependencies,
 	};
-	VkResult result = vkCreateRenderPass(Graphics.Device, &renderPassInfo, NULL, &Graphics.RenderPass);
+	VkRenderPass renderPass;
+	VkResult result = vkCreateRenderPass(Graphics.Device, &renderPassInfo, NULL, &renderPass);
 	if (result != VK_SUCCESS)
 	{
-		log_fatal("Trying to initialize Graphics, but failed to create VkRenderPass: %i\n", result);
+		log_fatal("Trying to create a render pass, but failed to create VkRenderPass: %i\n", result);
 		exit(1);
 	}
+	return renderPass;
+}
+
+static VkRenderPass GetRenderPass(struct GraphicsRenderPassKey key)
+{
+	for (int i = 0; i < Graphics.RenderPassCount; i++)
+	{
+		if (memcmp(&Graphics.RenderPasses[i].Key, &key, sizeof(key)) == 0) { return Graphics.RenderPasses[i].Instance; }
+	}
+	Graphics.RenderPasses = realloc(Graphics.RenderPasses, (Graphics.RenderPassCount + 1) * sizeof(struct GraphicsRenderPass));
+	Graphics.RenderPasses[Graphics.RenderPassCount] = (struct GraphicsRenderPass){ .Key = key, .Instance = CreateRenderPass(key) };
+	return Graphics.RenderPasses[Graphics.RenderPassCount++].Instance;
+}
+
+static void CreateRenderPasses()
+{
+	Graphics.RenderPassCount = 0;
+	Graphics.RenderPasses = NULL;
+	struct GraphicsRenderPassKey key =
+	{
+		.ColorFormat = (VkFormat)TextureFormatColor,
+		.DepthFormat = (VkFormat)TextureFormatDepthStencil,
+		.ColorLayout = TextureShaderLayout(TextureFormatColor),
+		.ColorLoad = VK_ATTACHMENT_LOAD_OP_LOAD,
+		.DepthLoad = VK_ATTACHMENT_LOAD_OP_LOAD,
+		.StencilLoad = VK_ATTACHMENT_LOAD_OP_LOAD,
+		.ColorStore = VK_ATTACHMENT_STORE_OP_STORE,
+		.DepthStore = VK_ATTACHMENT_STORE_OP_STORE,
+		.StencilStore = VK_ATTACHMENT_STORE_OP_STORE,
+	};
+	Graphics.RenderPass = GetRenderPass(key);
+	Graphics.SwapchainRenderPass = Graphics.RenderPass;
 }
 
 static void CreateCommandPool()
@@ -519,6 +789,14 @@ static void CreateCommandPool()
 		log_fatal("Trying to initialize Graphics, but failed to create VkCommandPool: %i\n", result);
 		exit(1);
 	}
+	
+	createInfo.queueFamilyIndex = Graphics.ComputeQueueIndex;
+	result = vkCreateCommandPool(Graphics.Device, &createInfo, NULL, &Graphics.ComputeCommandPool);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to initialize Graphics, but failed to create compute VkCommandPool: %i\n", result);
+		exit(1);
+	}
 }
 
 static void CreateAllocator()
@@ -556,6 +834,7 @@ static void CreateFrameResources()
 			.commandBufferCount = 1,
 		};
 		vkAllocateCommandBuffers(Graphics.Device, &allocateInfo, &Graphics.FrameResources[i].CommandBuffer);
+		allocateInfo.commandPool = Graphics.ComputeCommandPool;
 		vkAllocateCommandBuffers(Graphics.Device, &allocateInfo, &Graphics.FrameResources[i].ComputeCommandBuffer);
 		
 		VkSemaphoreCreateInfo semaphoreInfo =
@@ -565,22 +844,51 @@ static void CreateFrameResources()
 		vkCreateSemaphore(Graphics.Device, &semaphoreInfo, NULL, &Graphics.FrameResources[i].ImageAvailable);
 		vkCreateSemaphore(Graphics.Device, &semaphoreInfo, NULL, &Graphics.FrameResources[i].RenderFinished);
 		vkCreateSemaphore(Graphics.Device, &semaphoreInfo, NULL, &Graphics.FrameResources[i].ComputeFinished);
+		Graphics.FrameResources[i].FrameValue = 0;
+		Graphics.FrameResources[i].InputTime = 0;
+		Graphics.FrameResources[i].ComputeValue = 0;
 		
-		VkFenceCreateInfo fenceInfo =
+		Graphics.FrameResources[i].TimestampCount = 0;
+		Graphics.FrameResources[i].ComputeTimestampCount = 0;
+		Graphics.FrameResources[i].TimingScopeCount = 0;
+		if (Graphics.TimingsEnabled)
 		{
-			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
-		};
-		vkCreateFence(Graphics.Device, &fenceInfo, NULL, &Graphics.FrameResources[i].FrameReady);
-		vkCreateFence(Graphics.Device, &fenceInfo, NULL, &Graphics.FrameResources[i].ComputeFence);
-		
-		for (int j = 0; j < GraphicsQueueCount; j++)
-		{
-			Graphics.FrameResources[i].Queues[j] = ListCreate();
+			VkQueryPoolCreateInfo queryPoolInfo =
+			{
+				.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				.queryType = VK_QUERY_TYPE_TIMESTAMP,
+				.queryCount = 2 * GraphicsTimingScopeMax,
+			};
+			vkCreateQueryPool(Graphics.Device, &queryPoolInfo, NULL, &Graphics.FrameResources[i].TimestampPool);
+			vkCreateQueryPool(Graphics.Device, &queryPoolInfo, NULL, &Graphics.FrameResources[i].ComputeTimestampPool);
 		}
+		Graphics.FrameResources[i].DescriptorWriteCount = 0;
+		Graphics.FrameResources[i].DescriptorWriteCapacity = 0;
+		Graphics.FrameResources[i].DescriptorWrites = NULL;
+		Graphics.FrameResources[i].DescriptorInfos = NULL;
+		Graphics.FrameResources[i].Arena = (struct GraphicsFrameArena)
+		{
+			.Data = malloc(GraphicsFrameArenaSize),
+			.Capacity = GraphicsFrameArenaSize,
+			.Used = 0,
+			.OverflowSize = 0,
+			.OverflowBlocks = ListCreate(),
+		};
 	}
 	Graphics.FrameIndex = 0;
-	Graphics.PreRenderSemaphores = ListCreate();
+	Graphics.PreRenderSemaphoreCount = 0;
+	
+	Graphics.CommandRecorders = ListCreate();
+	Graphics.Recorder = malloc(sizeof(struct CommandRecorder));
+	*Graphics.Recorder = (struct CommandRecorder)
+	{
+		.Primary = true,
+		.Recording = false,
+		.CommandBuffer = VK_NULL_HANDLE,
+		.BoundPipeline = NULL,
+		.PipelinePending = false,
+	};
+	Graphics.ParallelRendering = false;
 }
 
 static bool Initialized = false;
@@ -603,28 +911,117 @@ void GraphicsInitialize(GraphicsConfigure config)
 	}
 	Initialized = true;
 	log_info("Initializing the graphics backend...\n");
+	Graphics.Headless = config.Headless;
 	Graphics.FrameResourceCount = config.FrameResourceCount;
+	Graphics.CacheDirectory = config.CacheDirectory;
 	Graphics.Swapchain.TargetPresentMode = config.TargetPresentMode;
-	CheckExtensionSupport();
+	Graphics.Swapchain.TargetImageCount = config.SwapchainImageCount == 0 ? 3 : config.SwapchainImageCount;
+	GraphicsSetFrameLatency(config.LatencyMode, config.MaxFramesAhead);
+	if (!Graphics.Headless) { CheckExtensionSupport(); }
 	CreateInstance(config.VulkanValidation);
-	CreateSurface();
+	if (!Graphics.Headless) { CreateSurface(); }
 	ChoosePhysicalDevice(config.TargetIntegratedDevice);
 	CreateLogicalDevice();
-	CreateRenderPass();
+	CheckTimestampSupport(config.GpuTimings);
+	CreatePipelineCache();
+	CreateRenderPasses();
 	CreateCommandPool();
 	CreateAllocator();
 	CreateCompiler();
+	WorkerInitialize();
+	TimelineInitialize();
 	CreateFrameResources();
+	UploadInitialize();
 	GraphicsCreateSwapchain(Window.Width, Window.Height);
 	log_info("Successfully initialized the graphics backend.\n");
 }
 
+static void CreateSwapchainFrameBuffers()
+{
+	struct GraphicsRenderPassKey key =
+	{
+		.ColorFormat = Graphics.Swapchain.ColorFormat,
+		.DepthFormat = (VkFormat)TextureFormatDepthStencil,
+		.ColorLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		.ColorLoad = VK_ATTACHMENT_LOAD_OP_LOAD,
+		.DepthLoad = VK_ATTACHMENT_LOAD_OP_LOAD,
+		.StencilLoad = VK_ATTACHMENT_LOAD_OP_LOAD,
+		.ColorStore = VK_ATTACHMENT_STORE_OP_STORE,
+		.DepthStore = VK_ATTACHMENT_STORE_OP_STORE,
+		.StencilStore = VK_ATTACHMENT_STORE_OP_STORE,
+	};
+	Graphics.SwapchainRenderPass = GetRenderPass(key);
+	
+	// Swapchain images rest in the present layout, the render pass leaves them there so they can be presented right after rendering
+	Graphics.Swapchain.FrameBuffers = malloc(Graphics.Swapchain.ImageCount * sizeof(FrameBuffer));
+	for (int i = 0; i < Graphics.Swapchain.ImageCount; i++)
+	{
+		VkExtent2D extent = Graphics.Swapchain.Extent;
+		Graphics.Swapchain.FrameBuffers[i] = FrameBufferCreateFromImage(Graphics.Swapchain.Images[i], Graphics.Swapchain.ColorFormat, extent.width, extent.height, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		// New images are undefined until they're first used, they're transitioned in the frame that first uses them instead of with a separate submit
+		Graphics.Swapchain.FrameBuffers[i]->ColorTexture->Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+}
+
+struct RetiredSwapchain
+{
+	VkSwapchainKHR Instance;
+	unsigned int ImageCount;
+	VkImage * Images;
+	FrameBuffer * FrameBuffers;
+};
+
+static void DestroyRetiredSwapchain(struct RetiredSwapchain * swapchain)
+{
+	for (int i = 0; i < swapchain->ImageCount; i++) { FrameBufferDestroy(swapchain->FrameBuffers[i]); }
+	free(swapchain->FrameBuffers);
+	free(swapchain->Images);
+	if (swapchain->Instance != VK_NULL_HANDLE) { vkDestroySwapchainKHR(Graphics.Device, swapchain->Instance, NULL); }
+	free(swapchain);
+}
+
+static void RecreateSwapchain()
+{
+	log_info("Recreating the swapchain...\n");
+	struct RetiredSwapchain * retired = malloc(sizeof(struct RetiredSwapchain));
+	*retired = (struct RetiredSwapchain)
+	{
+		.Instance = Graphics.Swapchain.Instance,
+		.ImageCount = Graphics.Swapchain.ImageCount,
+		.Images = Graphics.Swapchain.Images,
+		.FrameBuffers = Graphics.Swapchain.FrameBuffers,
+	};
+	VkExtent2D extent = Graphics.Swapchain.TargetExtent;
+	if (Graphics.Headless)
+	{
+		CreateHeadlessSwapchain(extent.width, extent.height);
+	}
+	else
+	{
+		CreateSwapchain(extent.width, extent.height, retired->Instance);
+		GetSwapchainImages();
+		CreateSwapchainFrameBuffers();
+	}
+	// Frames in flight may still use the old images, so they're destroyed once the gpu is done with them instead of waiting for the device to idle
+	TimelineRetire(retired, (TimelineDestroyFunction)DestroyRetiredSwapchain);
+	Graphics.Swapchain.Outdated = false;
+}
+
 void GraphicsCreateSwapchain(int width, int height)
 {
 	log_info("Creating the swapchain...\n");
 	Graphics.Swapchain.TargetExtent = (VkExtent2D) { .width = width, .height = height };
-	CreateSwapchain(width, height);
-	GetSwapchainImages();
+	Graphics.Swapchain.Outdated = false;
+	if (Graphics.Headless)
+	{
+		CreateHeadlessSwapchain(width, height);
+	}
+	else
+	{
+		CreateSwapchain(width, height, VK_NULL_HANDLE);
+		GetSwapchainImages();
+		CreateSwapchainFrameBuffers();
+	}
 	log_info("Successfully created the swapchain.\n");
 }
 
@@ -643,12 +1040,87 @@ void GraphicsSetPresentMode(PresentMode presentMode)
 		exit(1);
 	}
 	Graphics.Swapchain.TargetPresentMode = presentMode;
-	GraphicsDestroySwapchain();
-	GraphicsCreateSwapchain(Graphics.Swapchain.TargetExtent.width, Graphics.Swapchain.Extent.height);
+	Graphics.Swapchain.Outdated = true;
+}
+
+void GraphicsSetFrameLatency(LatencyMode mode, int maxFramesAhead)
+{
+	ValidateInitialized();
+	if (mode < 0 || mode >= LatencyModeCount)
+	{
+		log_fatal("Trying to set the latency mode to %i, but it isn't a valid LatencyMode.\n", mode);
+		exit(1);
+	}
+	// 0 is the default for a zero initialized GraphicsConfigure, so it's allowed and means the frame resource count
+	if (maxFramesAhead < 0 || maxFramesAhead > Graphics.FrameResourceCount)
+	{
+		log_fatal("Trying to let the cpu record %i frames ahead of the gpu, but it must be 0 for the default or between 1 and the frame resource count %i.\n", maxFramesAhead, Graphics.FrameResourceCount);
+		exit(1);
+	}
+	Graphics.LatencyMode = mode;
+	Graphics.MaxFramesAhead = maxFramesAhead == 0 ? Graphics.FrameResourceCount : maxFramesAhead;
+}
+
+FrameLatency GraphicsFrameLatency()
+{
+	ValidateInitialized();
+	return Graphics.Latency;
+}
+
+void GraphicsResizeSwapchain(int width, int height)
+{
+	ValidateInitialized();
+	Graphics.Swapchain.TargetExtent = (VkExtent2D){ .width = width, .height = height };
+	Graphics.Swapchain.Outdated = true;
+	Window.Width = width;
+	Window.Height = height;
 }
 
 static bool Updated = false;
 static bool ComputeRecorded;
+static double MillisecondsSince(uint64_t time)
+{
+	return (double)(SDL_GetPerformanceCounter() - time) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static void WaitFramesAhead(unsigned int next)
+{
+	// The frame resource that's used next was last used FrameResourceCount frames ago, the frame MaxFramesAhead ago is the one to wait on
+	unsigned int limit = (next + Graphics.FrameResourceCount - Graphics.MaxFramesAhead) % Graphics.FrameResourceCount;
+	uint64_t value = Graphics.FrameResources[limit].FrameValue;
+	if (value <= TimelineCompletedValue()) { return; }
+	uint64_t start = SDL_GetPerformanceCounter();
+	TimelineWait(value);
+	Graphics.LatencyWaitMilliseconds += MillisecondsSince(start);
+}
+
+static void MeasureFinishedFrame()
+{
+	// The newest finished frame that hasn't been measured yet, older ones are skipped since only the latest is reported
+	uint64_t completed = TimelineCompletedValue();
+	struct GraphicsFrameResource * newest = NULL;
+	for (int j = 0; j < Graphics.FrameResourceCount; j++)
+	{
+		struct GraphicsFrameResource * frame = Graphics.FrameResources + j;
+		if (frame->InputTime == 0 || frame->FrameValue == 0 || frame->FrameValue > completed) { continue; }
+		if (newest == NULL || frame->FrameValue > newest->FrameValue) { newest = frame; }
+	}
+	if (newest == NULL) { return; }
+	Graphics.Latency.InputToFinishMilliseconds = MillisecondsSince(newest->InputTime);
+	for (int j = 0; j < Graphics.FrameResourceCount; j++)
+	{
+		if (Graphics.FrameResources[j].FrameValue <= completed) { Graphics.FrameResources[j].InputTime = 0; }
+	}
+}
+
+void GraphicsSampleInput()
+{
+	// Events are also polled while waiting for a swapchain image, that input belongs to the frame already being recorded
+	if (!Initialized || Updated) { return; }
+	if (Graphics.LatencyMode == LatencyModeLow) { WaitFramesAhead((Graphics.FrameIndex + 1) % Graphics.FrameResourceCount); }
+	Graphics.InputTime = SDL_GetPerformanceCounter();
+}
+
 static void ValidateUpdated()
 {
 	if (!Updated)
@@ -658,67 +1130,237 @@ static void ValidateUpdated()
 	}
 }
 
-void GraphicsUpdate()
+static bool RecordingCompute = false;
+static bool RecordingGraphics = false;
+/// Set when no swapchain image could be aquired for the frame, its commands are recorded but never submitted
+static bool SkippingFrame = false;
+
+static void ReadTimings(unsigned int i)
 {
-	ValidateInitialized();
-	if (Updated)
+	struct GraphicsFrameResource * frame = Graphics.FrameResources + i;
+	if (!Graphics.TimingsEnabled || frame->TimingScopeCount == 0) { return; }
+	
+	uint64_t timestamps[2 * GraphicsTimingScopeMax];
+	uint64_t computeTimestamps[2 * GraphicsTimingScopeMax];
+	// The frame has already finished on the timeline, so the results are read without waiting on the gpu
+	if (frame->TimestampCount > 0)
 	{
-		log_fatal("Trying to update graphics, but it already has been updated and GraphicsPresent has not been called since then.\n");
-		exit(1);
+		VkResult result = vkGetQueryPoolResults(Graphics.Device, frame->TimestampPool, 0, frame->TimestampCount, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) { return; }
+	}
+	if (frame->ComputeTimestampCount > 0)
+	{
+		VkResult result = vkGetQueryPoolResults(Graphics.Device, frame->ComputeTimestampPool, 0, frame->ComputeTimestampCount, sizeof(computeTimestamps), computeTimestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) { return; }
 	}
-	Updated = true;
-	ComputeRecorded = false;
 	
-	Graphics.FrameIndex = (Graphics.FrameIndex + 1) % Graphics.FrameResourceCount;
-	unsigned int i = Graphics.FrameIndex;
-	vkWaitForFences(Graphics.Device, 1, &Graphics.FrameResources[i].FrameReady, VK_TRUE, UINT64_MAX);
-	vkResetFences(Graphics.Device, 1, &Graphics.FrameResources[i].FrameReady);
+	Graphics.Timings.ScopeCount = 0;
+	for (int j = 0; j < frame->TimingScopeCount; j++)
+	{
+		struct GraphicsTimingScope scope = frame->TimingScopes[j];
+		if (scope.End < 0) { continue; }
+		uint64_t * values = scope.Compute ? computeTimestamps : timestamps;
+		uint64_t mask = scope.Compute ? Graphics.ComputeTimestampMask : Graphics.TimestampMask;
+		uint64_t ticks = (values[scope.End] - values[scope.Begin]) & mask;
+		Graphics.Timings.Scopes[Graphics.Timings.ScopeCount++] = (TimingScope)
+		{
+			.Name = scope.Name,
+			.Compute = scope.Compute,
+			.Milliseconds = (double)ticks * Graphics.TimestampPeriod / 1000000.0,
+		};
+	}
+}
+
+static int BeginTimingScope(const char * name)
+{
+	struct GraphicsFrameResource * frame = Graphics.FrameResources + Graphics.FrameIndex;
+	if (!Graphics.TimingsEnabled || frame->TimingScopeCount == GraphicsTimingScopeMax) { return -1; }
+	if (!RecordingCompute && !RecordingGraphics) { return -1; }
+	// The primary command buffer can only execute secondary command buffers within a parallel render pass
+	if (Graphics.ParallelRendering) { return -1; }
 	
-	for (int j = 0; j < Graphics.FrameResources[i].Queues[0]->Count; j++)
+	int scope = frame->TimingScopeCount++;
+	frame->TimingScopes[scope] = (struct GraphicsTimingScope)
+	{
+		.Name = name,
+		.Compute = RecordingCompute,
+		.End = -1,
+	};
+	if (RecordingCompute)
 	{
-		VertexBuffer vertexBuffer = ListIndex(Graphics.FrameResources[i].Queues[0], j);
-		VertexBufferDestroy(vertexBuffer);
+		frame->TimingScopes[scope].Begin = frame->ComputeTimestampCount++;
+		vkCmdWriteTimestamp(frame->ComputeCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame->ComputeTimestampPool, frame->TimingScopes[scope].Begin);
 	}
-	for (int j = 0; j < Graphics.FrameResources[i].Queues[1]->Count; j++)
+	else
 	{
-		UniformBuffer uniformBuffer = ListIndex(Graphics.FrameResources[i].Queues[1], j);
-		UniformBufferDestroy(uniformBuffer);
+		frame->TimingScopes[scope].Begin = frame->TimestampCount++;
+		vkCmdWriteTimestamp(frame->CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame->TimestampPool, frame->TimingScopes[scope].Begin);
 	}
-	for (int j = 0; j < Graphics.FrameResources[i].Queues[2]->Count; j++)
+	return scope;
+}
+
+static void EndTimingScope(int scope)
+{
+	if (scope < 0 || Graphics.ParallelRendering) { return; }
+	struct GraphicsFrameResource * frame = Graphics.FrameResources + Graphics.FrameIndex;
+	if (frame->TimingScopes[scope].Compute)
 	{
-		FrameBuffer frameBuffer = ListIndex(Graphics.FrameResources[i].Queues[2], j);
-		FrameBufferDestroy(frameBuffer);
+		frame->TimingScopes[scope].End = frame->ComputeTimestampCount++;
+		vkCmdWriteTimestamp(frame->ComputeCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame->ComputeTimestampPool, frame->TimingScopes[scope].End);
 	}
-	for (int j = 0; j < Graphics.FrameResources[i].Queues[3]->Count; j++)
+	else
 	{
-		StorageBuffer storageBuffer = ListIndex(Graphics.FrameResources[i].Queues[3], j);
-		StorageBufferDestroy(storageBuffer);
+		frame->TimingScopes[scope].End = frame->TimestampCount++;
+		vkCmdWriteTimestamp(frame->CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame->TimestampPool, frame->TimingScopes[scope].End);
 	}
-	for (int j = 0; j < Graphics.FrameResources[i].Queues[4]->Count; j++)
+}
+
+void GraphicsBeginTiming(const char * name)
+{
+	ValidateInitialized();
+	if (Graphics.TimingStackCount == GraphicsTimingScopeMax)
 	{
-		Pipeline pipeline = ListIndex(Graphics.FrameResources[i].Queues[4], j);
-		PipelineDestroy(pipeline);
+		log_fatal("Trying to begin a timing scope, but there are already %i nested scopes.\n", GraphicsTimingScopeMax);
+		exit(1);
 	}
-	for (int j = 0; j < Graphics.FrameResources[i].Queues[5]->Count; j++)
+	Graphics.TimingStack[Graphics.TimingStackCount++] = BeginTimingScope(name);
+}
+
+void GraphicsEndTiming()
+{
+	ValidateInitialized();
+	if (Graphics.TimingStackCount == 0)
 	{
-		Texture texture = ListIndex(Graphics.FrameResources[i].Queues[5], j);
-		TextureDestroy(texture);
+		log_fatal("Trying to end a timing scope, but GraphicsBeginTiming was never called.\n");
+		exit(1);
 	}
-	for (int j = 0; j < Graphics.FrameResources[i].Queues[6]->Count; j++)
+	EndTimingScope(Graphics.TimingStack[--Graphics.TimingStackCount]);
+}
+
+FrameTimings GraphicsFrameTimings()
+{
+	ValidateInitialized();
+	return Graphics.Timings;
+}
+
+CommandRecorderStatistics GraphicsRecordingStatistics()
+{
+	ValidateInitialized();
+	CommandRecorderStatistics statistics = Graphics.Recorder->Statistics;
+	for (int i = 0; i < Graphics.CommandRecorders->Count; i++)
 	{
-		VkWriteDescriptorSet * writeInfo = ListIndex(Graphics.FrameResources[i].Queues[6], j);
-		vkUpdateDescriptorSets(Graphics.Device, 1, writeInfo, 0, NULL);
-		free((void *)writeInfo->pBufferInfo);
-		free(writeInfo);
+		CommandRecorder recorder = ListIndex(Graphics.CommandRecorders, i);
+		statistics.Recorded += recorder->Statistics.Recorded;
+		statistics.Elided += recorder->Statistics.Elided;
 	}
-	for (int j = 0; j < GraphicsQueueCount; j++)
+	return statistics;
+}
+
+static void ResetFrameArena(unsigned int i)
+{
+	struct GraphicsFrameArena * arena = &Graphics.FrameResources[i].Arena;
+	for (int j = 0; j < arena->OverflowBlocks->Count; j++) { free(ListIndex(arena->OverflowBlocks, j)); }
+	ListClear(arena->OverflowBlocks);
+	if (arena->OverflowSize > 0)
+	{
+		// The arena grows to fit the whole frame, so the next frames don't fall back to the heap
+		free(arena->Data);
+		arena->Capacity += arena->OverflowSize;
+		arena->Data = malloc(arena->Capacity);
+	}
+	arena->Used = 0;
+	arena->OverflowSize = 0;
+}
+
+void * GraphicsFrameAlloc(size_t size)
+{
+	ValidateInitialized();
+	struct GraphicsFrameArena * arena = &Graphics.FrameResources[Graphics.FrameIndex].Arena;
+	size = (size + GraphicsFrameArenaAlignment - 1) / GraphicsFrameArenaAlignment * GraphicsFrameArenaAlignment;
+	if (arena->Used + size <= arena->Capacity)
+	{
+		void * memory = arena->Data + arena->Used;
+		arena->Used += size;
+		return memory;
+	}
+	void * memory = malloc(size);
+	ListPush(arena->OverflowBlocks, memory);
+	arena->OverflowSize += size;
+	return memory;
+}
+
+static void FlushDescriptorWrites(unsigned int i)
+{
+	struct GraphicsFrameResource * frame = Graphics.FrameResources + i;
+	if (frame->DescriptorWriteCount == 0) { return; }
+	for (int j = 0; j < frame->DescriptorWriteCount; j++)
 	{
-		ListClear(Graphics.FrameResources[i].Queues[j]);
+		bool image = frame->DescriptorWrites[j].descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		frame->DescriptorWrites[j].pImageInfo = image ? &frame->DescriptorInfos[j].Image : NULL;
+		frame->DescriptorWrites[j].pBufferInfo = image ? NULL : &frame->DescriptorInfos[j].Buffer;
 	}
+	vkUpdateDescriptorSets(Graphics.Device, frame->DescriptorWriteCount, frame->DescriptorWrites, 0, NULL);
+	frame->DescriptorWriteCount = 0;
 }
 
-static bool RecordingCompute = false;
-static bool RecordingGraphics = false;
+void GraphicsUpdate()
+{
+	ValidateInitialized();
+	if (Updated)
+	{
+		log_fatal("Trying to update graphics, but it already has been updated and GraphicsPresent has not been called since then.\n");
+		exit(1);
+	}
+	Updated = true;
+	ComputeRecorded = false;
+	Graphics.FrameCount++;
+	
+	Graphics.FrameIndex = (Graphics.FrameIndex + 1) % Graphics.FrameResourceCount;
+	unsigned int i = Graphics.FrameIndex;
+	WaitFramesAhead(i);
+	// The resource itself was used by an older frame than the one waited on, so this only waits if MaxFramesAhead changed
+	TimelineWait(Graphics.FrameResources[i].FrameValue);
+	MeasureFinishedFrame();
+	Graphics.Latency.Mode = Graphics.LatencyMode;
+	Graphics.Latency.MaxFramesAhead = Graphics.MaxFramesAhead;
+	Graphics.Latency.WaitMilliseconds = Graphics.LatencyWaitMilliseconds;
+	Graphics.LatencyWaitMilliseconds = 0.0;
+	Graphics.FrameResources[i].InputTime = Graphics.InputTime;
+	Graphics.InputTime = 0;
+	ResetFrameArena(i);
+	ReadTimings(i);
+	Graphics.FrameResources[i].TimestampCount = 0;
+	Graphics.FrameResources[i].ComputeTimestampCount = 0;
+	Graphics.FrameResources[i].TimingScopeCount = 0;
+	for (int j = 0; j < Graphics.CommandRecorders->Count; j++)
+	{
+		CommandRecorder recorder = ListIndex(Graphics.CommandRecorders, j);
+		vkResetCommandPool(Graphics.Device, recorder->CommandPools[i], 0);
+		recorder->UsedCount[i] = 0;
+		recorder->ExecutedCount[i] = 0;
+		recorder->Statistics = (CommandRecorderStatistics){ 0 };
+	}
+	Graphics.Recorder->Statistics = (CommandRecorderStatistics){ 0 };
+	
+	
+	TimelineCollect();
+	FlushDescriptorWrites(i);
+}
+
+static int ComputeTimingScope = -1;
+static int RenderTimingScope = -1;
+
+static void WaitBeforeRender(VkSemaphore semaphore, VkPipelineStageFlags stages)
+{
+	if (Graphics.PreRenderSemaphoreCount == GraphicsPreRenderSemaphoreMax)
+	{
+		log_fatal("Trying to wait on a semaphore before rendering, but there are already %i semaphores waiting.\n", GraphicsPreRenderSemaphoreMax);
+		exit(1);
+	}
+	Graphics.PreRenderSemaphores[Graphics.PreRenderSemaphoreCount] = semaphore;
+	Graphics.PreRenderStages[Graphics.PreRenderSemaphoreCount] = stages;
+	Graphics.PreRenderSemaphoreCount++;
+}
 
 void GraphicsStartCompute()
 {
@@ -741,8 +1383,7 @@ void GraphicsStartCompute()
 	}
 	RecordingCompute = true;
 	
-	vkWaitForFences(Graphics.Device, 1, &Graphics.FrameResources[Graphics.FrameIndex].ComputeFence, VK_TRUE, UINT64_MAX);
-	vkResetFences(Graphics.Device, 1, &Graphics.FrameResources[Graphics.FrameIndex].ComputeFence);
+	TimelineWait(Graphics.FrameResources[Graphics.FrameIndex].ComputeValue);
 	vkResetCommandBuffer(Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer, 0);
 	VkCommandBufferBeginInfo beginInfo =
 	{
@@ -750,17 +1391,15 @@ void GraphicsStartCompute()
 		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 	};
 	vkBeginCommandBuffer(Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer, &beginInfo);
+	if (Graphics.TimingsEnabled)
+	{
+		vkCmdResetQueryPool(Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer, Graphics.FrameResources[Graphics.FrameIndex].ComputeTimestampPool, 0, 2 * GraphicsTimingScopeMax);
+	}
+	ComputeTimingScope = BeginTimingScope("Compute");
 }
 
-void GraphicsDispatch(ComputePipeline pipeline, int xGroups, int yGroups, int zGroups)
+static void RecordDispatch(VkCommandBuffer commandBuffer, ComputePipeline pipeline, int xGroups, int yGroups, int zGroups)
 {
-	ValidateInitialized();
-	ValidateUpdated();
-	if (!RecordingCompute)
-	{
-		log_fatal("Trying to call a compute command, but compute recording was never started with GraphicsStartCompute.\n");
-		exit(1);
-	}
 	if (pipeline == NULL)
 	{
 		log_fatal("Trying to dispatch an uninitialized pipeline.\n");
@@ -777,16 +1416,28 @@ void GraphicsDispatch(ComputePipeline pipeline, int xGroups, int yGroups, int zG
 		exit(1);
 	}
 	
-	vkCmdBindPipeline(Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->Instance);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->Instance);
 	if (pipeline->UsesPushConstant)
 	{
-		vkCmdPushConstants(Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer, pipeline->Layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pipeline->PushConstantSize, pipeline->PushConstantData);
+		vkCmdPushConstants(commandBuffer, pipeline->Layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pipeline->PushConstantSize, pipeline->PushConstantData);
 	}
 	if (pipeline->UsesDescriptors)
 	{
-		vkCmdBindDescriptorSets(Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->Layout, 0, 1, &pipeline->DescriptorSet[Graphics.FrameIndex], 0, NULL);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->Layout, 0, 1, &pipeline->DescriptorSet[Graphics.FrameIndex], 0, NULL);
 	}
-	vkCmdDispatch(Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer, xGroups, yGroups, zGroups);
+	vkCmdDispatch(commandBuffer, xGroups, yGroups, zGroups);
+}
+
+void GraphicsDispatch(ComputePipeline pipeline, int xGroups, int yGroups, int zGroups)
+{
+	ValidateInitialized();
+	ValidateUpdated();
+	if (!RecordingCompute)
+	{
+		log_fatal("Trying to call a compute command, but compute recording was never started with GraphicsStartCompute.\n");
+		exit(1);
+	}
+	RecordDispatch(Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer, pipeline, xGroups, yGroups, zGroups);
 }
 
 void GraphicsEndCompute()
@@ -798,6 +1449,7 @@ void GraphicsEndCompute()
 		log_fatal("Trying to end compute recording, but compute recording was never started with GraphicsStartCompute.\n");
 		exit(1);
 	}
+	EndTimingScope(ComputeTimingScope);
 	RecordingCompute = false;
 	ComputeRecorded = true;
 	
@@ -808,25 +1460,40 @@ void GraphicsEndCompute()
 		exit(1);
 	}
 	
+	VkSemaphore uploadFinished = UploadFlush(true);
+	VkPipelineStageFlags uploadStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 	VkSubmitInfo submitInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount = 0,
-		.pWaitSemaphores = NULL,
-		.pWaitDstStageMask = NULL,
+		.waitSemaphoreCount = uploadFinished == VK_NULL_HANDLE ? 0 : 1,
+		.pWaitSemaphores = &uploadFinished,
+		.pWaitDstStageMask = &uploadStage,
 		.commandBufferCount = 1,
 		.pCommandBuffers = &Graphics.FrameResources[Graphics.FrameIndex].ComputeCommandBuffer,
 		.signalSemaphoreCount = 1,
 		.pSignalSemaphores = &Graphics.FrameResources[Graphics.FrameIndex].ComputeFinished,
 	};
-	result = vkQueueSubmit(Graphics.GraphicsQueue, 1, &submitInfo, Graphics.FrameResources[Graphics.FrameIndex].ComputeFence);
-	if (result != VK_SUCCESS)
+	Graphics.FrameResources[Graphics.FrameIndex].ComputeValue = TimelineSubmit(Graphics.ComputeQueue, &submitInfo, false);
+	
+	// Compute results are consumed as indirect arguments, vertex data or shader storage, everything before that can overlap the compute work
+	VkPipelineStageFlags consumerStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	WaitBeforeRender(Graphics.FrameResources[Graphics.FrameIndex].ComputeFinished, consumerStages);
+}
+
+/// Waits while the window is minimized, a swapchain can't be created or aquired from while the surface has a zero extent
+/// \return Whether the surface can be rendered to, false if the window was closed while waiting
+static bool WaitWhileMinimized()
+{
+	VkSurfaceCapabilitiesKHR capabilities;
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(Graphics.PhysicalDevice, Graphics.Surface, &capabilities);
+	while (capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0)
 	{
-		log_fatal("Trying to send compute operations, but failed to submit queue: %i\n", result);
-		exit(1);
+		if (!WindowRunning()) { return false; }
+		EventHandlerPoll();
+		SDL_Delay(10);
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(Graphics.PhysicalDevice, Graphics.Surface, &capabilities);
 	}
-	
-	ListPush(Graphics.PreRenderSemaphores, &Graphics.FrameResources[Graphics.FrameIndex].ComputeFinished);
+	return true;
 }
 
 void GraphicsAquireNextImage()
@@ -847,12 +1514,40 @@ void GraphicsAquireNextImage()
 	
 	unsigned int i = Graphics.FrameIndex;
 	
-	VkResult result = vkAcquireNextImageKHR(Graphics.Device, Graphics.Swapchain.Instance, UINT64_MAX, Graphics.FrameResources[i].ImageAvailable, VK_NULL_HANDLE, &Graphics.Swapchain.CurrentImageIndex);
-	if (result != VK_SUCCESS) { log_info("Unsuccessful aquire image: %i\n", result); }
-	while (result != VK_SUCCESS)
+	VkResult result = VK_SUCCESS;
+	// The window can only be closed while it's minimized, then there is nothing to present the frame to
+	SkippingFrame = !Graphics.Headless && !WaitWhileMinimized();
+	// Every resize and present mode change since the last frame is applied with one recreation
+	if (Graphics.Swapchain.Outdated && !SkippingFrame) { RecreateSwapchain(); }
+	if (Graphics.Headless)
+	{
+		// Frames are already paced by the timeline in GraphicsUpdate, so there is nothing to wait on
+		Graphics.Swapchain.CurrentImageIndex = (Graphics.Swapchain.CurrentImageIndex + 1) % Graphics.Swapchain.ImageCount;
+	}
+	else if (!SkippingFrame)
 	{
-		EventHandlerPoll();
 		result = vkAcquireNextImageKHR(Graphics.Device, Graphics.Swapchain.Instance, UINT64_MAX, Graphics.FrameResources[i].ImageAvailable, VK_NULL_HANDLE, &Graphics.Swapchain.CurrentImageIndex);
+		while (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			if (result == VK_ERROR_OUT_OF_DATE_KHR)
+			{
+				// Minimizing the window makes the swapchain out of date, it's only recreated once the surface has a size again
+				if (!WaitWhileMinimized())
+				{
+					SkippingFrame = true;
+					break;
+				}
+				RecreateSwapchain();
+			}
+			else
+			{
+				log_info("Unsuccessful aquire image: %i\n", result);
+				EventHandlerPoll();
+			}
+			result = vkAcquireNextImageKHR(Graphics.Device, Graphics.Swapchain.Instance, UINT64_MAX, Graphics.FrameResources[i].ImageAvailable, VK_NULL_HANDLE, &Graphics.Swapchain.CurrentImageIndex);
+		}
+		// A suboptimal image can still be presented, the swapchain is recreated for the next frame
+		if (result == VK_SUBOPTIMAL_KHR) { Graphics.Swapchain.Outdated = true; }
 	}
 	
 	vkResetCommandBuffer(Graphics.FrameResources[i].CommandBuffer, 0);
@@ -862,6 +1557,14 @@ void GraphicsAquireNextImage()
 		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 	};
 	result = vkBeginCommandBuffer(Graphics.FrameResources[i].CommandBuffer, &beginInfo);
+	if (Graphics.TimingsEnabled)
+	{
+		vkCmdResetQueryPool(Graphics.FrameResources[i].CommandBuffer, Graphics.FrameResources[i].TimestampPool, 0, 2 * GraphicsTimingScopeMax);
+	}
+	Graphics.Recorder->CommandBuffer = Graphics.FrameResources[i].CommandBuffer;
+	Graphics.Recorder->BoundPipeline = NULL;
+	Graphics.Recorder->PipelinePending = false;
+	CommandRecorderResetState(Graphics.Recorder);
 }
 
 static void ValidateRecordingGraphics()
@@ -872,6 +1575,35 @@ static void ValidateRecordingGraphics()
 	}
 }
 
+VkCommandBuffer GraphicsCommandBuffer()
+{
+	ValidateInitialized();
+	ValidateUpdated();
+	ValidateRecordingGraphics();
+	if (Graphics.BoundFrameBuffer != NULL)
+	{
+		log_fatal("Trying to record commands outside of rendering, but GraphicsEnd was never called after the last GraphicsBegin.\n");
+		exit(1);
+	}
+	return Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer;
+}
+
+void GraphicsDispatchInline(ComputePipeline pipeline, int xGroups, int yGroups, int zGroups)
+{
+	VkCommandBuffer commandBuffer = GraphicsCommandBuffer();
+	RecordDispatch(commandBuffer, pipeline, xGroups, yGroups, zGroups);
+	
+	// Everything in the graphics queue that can read the results waits on the dispatch
+	VkMemoryBarrier barrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+	};
+	VkPipelineStageFlags consumerStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, consumerStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
 void GraphicsPresent()
 {
 	ValidateInitialized();
@@ -882,43 +1614,63 @@ void GraphicsPresent()
 	
 	unsigned int i = Graphics.FrameIndex;
 	
+	// The image has to be presentable even if nothing was rendered or copied into it this frame
+	if (!Graphics.Headless && !SkippingFrame)
+	{
+		Texture image = Graphics.Swapchain.FrameBuffers[Graphics.Swapchain.CurrentImageIndex]->ColorTexture;
+		TextureTransition(image, Graphics.FrameResources[i].CommandBuffer, image->IdleLayout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+	}
 	VkResult result = vkEndCommandBuffer(Graphics.FrameResources[i].CommandBuffer);
 	if (result != VK_SUCCESS)
 	{
 		log_fatal("Trying to end graphics recording, but failed to record command buffer: %i\n", result);
 		exit(1);
 	}
-
-	VkSemaphore * waitSemaphores = malloc((1 + Graphics.PreRenderSemaphores->Count) * sizeof(VkSemaphore));
-	VkPipelineStageFlags * waitStages = malloc((1 + Graphics.PreRenderSemaphores->Count) * sizeof(VkPipelineStageFlags));
-	waitSemaphores[0] = Graphics.FrameResources[i].ImageAvailable;
-	waitStages[0] = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-	for (int i = 0; i < Graphics.PreRenderSemaphores->Count; i++)
+	if (SkippingFrame)
+	{
+		// No image was aquired, so the commands that render into it are dropped
+		Graphics.PreRenderSemaphoreCount = 0;
+		return;
+	}
+	
+	VkSemaphore uploadFinished = UploadFlush(true);
+	if (uploadFinished != VK_NULL_HANDLE) { WaitBeforeRender(uploadFinished, UploadConsumerStages); }
+	int commandBufferCount = 0;
+	VkCommandBuffer commandBuffers[2];
+	VkCommandBuffer acquireCommandBuffer = UploadRecordAcquire();
+	if (acquireCommandBuffer != VK_NULL_HANDLE) { commandBuffers[commandBufferCount++] = acquireCommandBuffer; }
+	commandBuffers[commandBufferCount++] = Graphics.FrameResources[i].CommandBuffer;
+	
+	int waitCount = 0;
+	VkSemaphore waitSemaphores[1 + GraphicsPreRenderSemaphoreMax];
+	VkPipelineStageFlags waitStages[1 + GraphicsPreRenderSemaphoreMax];
+	if (!Graphics.Headless)
+	{
+		waitSemaphores[waitCount] = Graphics.FrameResources[i].ImageAvailable;
+		waitStages[waitCount] = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		waitCount++;
+	}
+	for (int j = 0; j < Graphics.PreRenderSemaphoreCount; j++, waitCount++)
 	{
-		waitSemaphores[i + 1] = *(VkSemaphore *)ListIndex(Graphics.PreRenderSemaphores, i);
-		waitStages[i + 1] = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		waitSemaphores[waitCount] = Graphics.PreRenderSemaphores[j];
+		waitStages[waitCount] = Graphics.PreRenderStages[j];
 	}
 	
 	VkSubmitInfo submitInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount = 1 + Graphics.PreRenderSemaphores->Count,
+		.waitSemaphoreCount = waitCount,
 		.pWaitSemaphores = waitSemaphores,
 		.pWaitDstStageMask = waitStages,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &Graphics.FrameResources[i].CommandBuffer,
-		.signalSemaphoreCount = 1,
+		.commandBufferCount = commandBufferCount,
+		.pCommandBuffers = commandBuffers,
+		.signalSemaphoreCount = Graphics.Headless ? 0 : 1,
 		.pSignalSemaphores = &Graphics.FrameResources[i].RenderFinished,
 	};
-	result = vkQueueSubmit(Graphics.GraphicsQueue, 1, &submitInfo, Graphics.FrameResources[i].FrameReady);
-	if (result != VK_SUCCESS)
-	{
-		log_fatal("Trying to send graphics commands, but failed to submit queue: %i\n", result);
-		exit(1);
-	}
-	free(waitSemaphores);
-	free(waitStages);
-	ListClear(Graphics.PreRenderSemaphores);
+	Graphics.FrameResources[i].FrameValue = TimelineSubmit(Graphics.GraphicsQueue, &submitInfo, true);
+	Graphics.PreRenderSemaphoreCount = 0;
+	Graphics.Latency.InputToSubmitMilliseconds = Graphics.FrameResources[i].InputTime == 0 ? 0.0 : MillisecondsSince(Graphics.FrameResources[i].InputTime);
+	if (Graphics.Headless) { return; }
 	
 	VkPresentInfoKHR presentInfo =
 	{
@@ -929,16 +1681,26 @@ void GraphicsPresent()
 		.pSwapchains = &Graphics.Swapchain.Instance,
 		.pImageIndices = &Graphics.Swapchain.CurrentImageIndex,
 	};
-	vkQueuePresentKHR(Graphics.PresentQueue, &presentInfo);
+	result = vkQueuePresentKHR(Graphics.PresentQueue, &presentInfo);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) { Graphics.Swapchain.Outdated = true; }
 }
 
 void GraphicsDestroySwapchain()
 {
 	vkDeviceWaitIdle(Graphics.Device);
 	free(Graphics.Swapchain.Images);
+	for (int i = 0; i < Graphics.Swapchain.ImageCount; i++) { FrameBufferDestroy(Graphics.Swapchain.FrameBuffers[i]); }
+	free(Graphics.Swapchain.FrameBuffers);
+	if (Graphics.Headless) { return; }
 	vkDestroySwapchainKHR(Graphics.Device, Graphics.Swapchain.Instance, NULL);
 }
 
+FrameBuffer GraphicsSwapchainFrameBuffer()
+{
+	ValidateInitialized();
+	return Graphics.Swapchain.FrameBuffers[Graphics.Swapchain.CurrentImageIndex];
+}
+
 static void ValidateRenderingBegan()
 {
 	if (Graphics.BoundFrameBuffer == NULL)
@@ -948,7 +1710,28 @@ static void ValidateRenderingBegan()
 	}
 }
 
-void GraphicsBegin(FrameBuffer frameBuffer)
+static void ValidateInlineRendering()
+{
+	ValidateRenderingBegan();
+	if (Graphics.ParallelRendering)
+	{
+		log_fatal("Trying to perform rendering operations on the main thread, but rendering began with GraphicsBeginParallel, use a CommandRecorder instead.\n");
+		exit(1);
+	}
+}
+
+static VkAttachmentLoadOp LoadOp(RenderPassLoad load)
+{
+	if (load < 0 || load >= RenderPassLoadCount)
+	{
+		log_fatal("Trying to begin rendering with an invalid RenderPassLoad: %i\n", load);
+		exit(1);
+	}
+	if (load == RenderPassLoadClear) { return VK_ATTACHMENT_LOAD_OP_CLEAR; }
+	return load == RenderPassLoadDontCare ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD;
+}
+
+static void BeginRendering(FrameBuffer frameBuffer, bool parallel, RenderPassConfigure config)
 {
 	ValidateInitialized();
 	ValidateUpdated();
@@ -963,153 +1746,171 @@ void GraphicsBegin(FrameBuffer frameBuffer)
 		log_fatal("Trying to begin rendering on an uninitialized FrameBuffer.\n");
 		exit(1);
 	}
+	// The render pass moves the attachments from their shader layouts and back, so textures that were transitioned elsewhere are moved back first
+	VkCommandBuffer commandBuffer = Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer;
+	TextureTransition(frameBuffer->ColorTexture, commandBuffer, frameBuffer->ColorTexture->IdleLayout, TextureShaderStages, VK_ACCESS_SHADER_READ_BIT);
+	TextureTransition(frameBuffer->DepthTexture, commandBuffer, frameBuffer->DepthTexture->IdleLayout, TextureShaderStages, VK_ACCESS_SHADER_READ_BIT);
 	Graphics.BoundFrameBuffer = frameBuffer;
+	RenderTimingScope = BeginTimingScope("Render");
 	
+	struct GraphicsRenderPassKey key =
+	{
+		.ColorFormat = (VkFormat)frameBuffer->ColorTexture->Format,
+		.DepthFormat = (VkFormat)frameBuffer->DepthTexture->Format,
+		.ColorLayout = frameBuffer->ColorTexture->IdleLayout,
+		.ColorLoad = LoadOp(config.ColorLoad),
+		.DepthLoad = LoadOp(config.DepthLoad),
+		.StencilLoad = LoadOp(config.StencilLoad),
+		.ColorStore = config.DiscardColor ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+		.DepthStore = config.DiscardDepthStencil ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+		.StencilStore = config.DiscardDepthStencil ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+	};
+	Vector4 clearColor = ColorToVector4(config.ClearColor);
+	VkClearValue clearValues[] =
+	{
+		{ .color = { .float32 = { clearColor.X, clearColor.Y, clearColor.Z, clearColor.W } } },
+		{ .depthStencil = { .depth = config.ClearDepth, .stencil = config.ClearStencil } },
+	};
+	Graphics.BoundRenderPass = GetRenderPass(key);
 	VkRenderPassBeginInfo renderPassBegin =
 	{
 		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-		.renderPass = Graphics.RenderPass,
+		.renderPass = Graphics.BoundRenderPass,
 		.framebuffer = Graphics.BoundFrameBuffer->Instance,
 		.renderArea = (VkRect2D)
 		{
 			.offset = { 0, 0 },
 			.extent = { frameBuffer->Width, frameBuffer->Height },
 		},
-		.clearValueCount = 0,
-		.pClearValues = NULL,
+		.clearValueCount = 2,
+		.pClearValues = clearValues,
 	};
-	vkCmdBeginRenderPass(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+	VkSubpassContents contents = parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBegin, contents);
+	Graphics.ParallelRendering = parallel;
+	Graphics.Recorder->Recording = !parallel;
 }
 
-static void Clear(Color clearColor, float depth, int stencil, VkImageAspectFlagBits aspect)
+void GraphicsBegin(FrameBuffer frameBuffer)
 {
-	Vector4 color = ColorToVector4(clearColor);
-	VkClearRect rect =
-	{
-		.baseArrayLayer = 0,
-		.layerCount = 1,
-		.rect =
-		{
-			.offset = { 0, 0 },
-			.extent = { Graphics.BoundFrameBuffer->Width, Graphics.BoundFrameBuffer->Height },
-		},
-	};
-	
-	VkClearAttachment clear = aspect == VK_IMAGE_ASPECT_COLOR_BIT ? (VkClearAttachment)
-	{
-		.aspectMask = aspect,
-		.clearValue = { .color = { color.X, color.Y, color.Z, color.W } },
-	} : (VkClearAttachment)
-	{
-		.aspectMask = aspect,
-		.clearValue = { .depthStencil = { .depth = depth, .stencil = stencil }, }
-	};
-	vkCmdClearAttachments(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, 1, &clear, 1, &rect);
+	BeginRendering(frameBuffer, false, (RenderPassConfigure){ 0 });
+}
+
+void GraphicsBeginParallel(FrameBuffer frameBuffer)
+{
+	BeginRendering(frameBuffer, true, (RenderPassConfigure){ 0 });
+}
+
+void GraphicsBeginPass(FrameBuffer frameBuffer, RenderPassConfigure config)
+{
+	BeginRendering(frameBuffer, false, config);
+}
+
+void GraphicsBeginParallelPass(FrameBuffer frameBuffer, RenderPassConfigure config)
+{
+	BeginRendering(frameBuffer, true, config);
 }
 
 void GraphicsClearColor(Color clearColor)
 {
-	ValidateRenderingBegan();
-	Clear(clearColor, 0.0, 0, VK_IMAGE_ASPECT_COLOR_BIT);
+	ValidateInlineRendering();
+	CommandRecorderClearColor(Graphics.Recorder, clearColor);
 }
 
 void GraphicsClearDepth(Scalar depth)
 {
-	ValidateRenderingBegan();
-	Clear(ColorBlack, depth, 0, VK_IMAGE_ASPECT_DEPTH_BIT);
+	ValidateInlineRendering();
+	CommandRecorderClearDepth(Graphics.Recorder, depth);
 }
 
 void GraphicsClearStencil(unsigned int stencil)
 {
-	ValidateRenderingBegan();
-	Clear(ColorBlack, 0.0, stencil, VK_IMAGE_ASPECT_STENCIL_BIT);
+	ValidateInlineRendering();
+	CommandRecorderClearStencil(Graphics.Recorder, stencil);
 }
 
 void GraphicsClear(Color clearColor, Scalar depth, int stencil)
 {
-	ValidateRenderingBegan();
-	GraphicsClearColor(clearColor);
-	Clear(clearColor, depth, stencil, VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+	ValidateInlineRendering();
+	CommandRecorderClear(Graphics.Recorder, clearColor, depth, stencil);
 }
 
 void GraphicsBindPipeline(Pipeline pipeline)
 {
-	ValidateRenderingBegan();
-	if (pipeline == NULL)
-	{
-		log_fatal("Trying to bind an uninitialized pipeline.\n");
-		exit(1);
-	}
-	if (pipeline->IsCompute)
-	{
-		log_fatal("Trying to bind a compute shader pipeline for rendering operations.\n");
-		exit(1);
-	}
-	
-	Graphics.BoundPipeline = pipeline;
-	vkCmdBindPipeline(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->Instance);
-	VkViewport viewport =
-	{
-		.x = 0.0f,
-		.y = 0.0f,
-		.width = Graphics.Swapchain.Extent.width,
-		.height = Graphics.Swapchain.Extent.height,
-		.minDepth = 0.0f,
-		.maxDepth = 1.0f,
-	};
-	VkRect2D scissor =
-	{
-		.offset = { 0, 0 },
-		.extent = Graphics.Swapchain.Extent,
-	};
-	vkCmdSetViewport(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, 0, 1, &viewport);
-	vkCmdSetScissor(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, 0, 1, &scissor);
+	ValidateInlineRendering();
+	CommandRecorderBindPipeline(Graphics.Recorder, pipeline);
 }
 
 void GraphicsRenderVertexBuffer(VertexBuffer vertexBuffer)
 {
-	ValidateRenderingBegan();
-	if (vertexBuffer == NULL)
-	{
-		log_fatal("Trying to render an uninitialized VertexBuffer.\n");
-		exit(1);
-	}
-	if (Graphics.BoundPipeline == NULL)
-	{
-		log_fatal("Trying to render a VertexBuffer, but no Pipeline object has been bound yet.\n");
-		exit(1);
-	}
-	
-	vkCmdSetStencilReference(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, VK_STENCIL_FACE_FRONT_BIT, Graphics.BoundPipeline->FrontStencilReference);
-	vkCmdSetStencilReference(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, VK_STENCIL_FACE_BACK_BIT, Graphics.BoundPipeline->BackStencilReference);
-	
-	if (Graphics.BoundPipeline->UsesPushConstant)
-	{
-		vkCmdPushConstants(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, Graphics.BoundPipeline->Layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, Graphics.BoundPipeline->PushConstantSize, Graphics.BoundPipeline->PushConstantData);
-	}
-	if (Graphics.BoundPipeline->UsesDescriptors)
+	ValidateInlineRendering();
+	CommandRecorderRenderVertexBuffer(Graphics.Recorder, vertexBuffer);
+}
+
+void GraphicsRenderVertexBufferInstanced(VertexBuffer vertexBuffer, VertexBuffer instanceBuffer, int instanceCount, int firstInstance)
+{
+	ValidateInlineRendering();
+	CommandRecorderRenderVertexBufferInstanced(Graphics.Recorder, vertexBuffer, instanceBuffer, instanceCount, firstInstance);
+}
+
+void GraphicsRenderIndirect(VertexBuffer vertexBuffer, StorageBuffer arguments, unsigned long offset, int drawCount)
+{
+	ValidateInlineRendering();
+	CommandRecorderRenderIndirect(Graphics.Recorder, vertexBuffer, arguments, offset, drawCount);
+}
+
+void GraphicsRenderIndexedIndirectCount(VertexBuffer vertexBuffer, StorageBuffer arguments, unsigned long offset, StorageBuffer count, unsigned long countOffset, int maxDrawCount)
+{
+	ValidateInlineRendering();
+	CommandRecorderRenderIndexedIndirectCount(Graphics.Recorder, vertexBuffer, arguments, offset, count, countOffset, maxDrawCount);
+}
+
+void GraphicsQueueDraw(Pipeline pipeline, VertexBuffer vertexBuffer, Scalar depth, bool transparent)
+{
+	ValidateInlineRendering();
+	CommandRecorderQueueDraw(Graphics.Recorder, pipeline, vertexBuffer, depth, transparent);
+}
+
+static void ExecuteRecorders()
+{
+	unsigned int i = Graphics.FrameIndex;
+	int commandBufferCount = 0;
+	for (int j = 0; j < Graphics.CommandRecorders->Count; j++)
 	{
-		vkCmdBindDescriptorSets(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Graphics.BoundPipeline->Layout, 0, 1, &Graphics.BoundPipeline->DescriptorSet[Graphics.FrameIndex], 0, NULL);
+		CommandRecorder recorder = ListIndex(Graphics.CommandRecorders, j);
+		if (recorder->Recording)
+		{
+			log_fatal("Trying to end rendering, but CommandRecorderEnd was never called on CommandRecorder %p.\n", recorder);
+			exit(1);
+		}
+		commandBufferCount += recorder->UsedCount[i] - recorder->ExecutedCount[i];
 	}
+	if (commandBufferCount == 0) { return; }
 	
-	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, 0, 1, &vertexBuffer->VertexBuffer, &offset);
-	if (vertexBuffer->IndexCount > 0)
+	VkCommandBuffer * commandBuffers = GraphicsFrameAlloc(commandBufferCount * sizeof(VkCommandBuffer));
+	int k = 0;
+	for (int j = 0; j < Graphics.CommandRecorders->Count; j++)
 	{
-		VkDeviceSize offset = vertexBuffer->VertexCount * vertexBuffer->VertexSize;
-		vkCmdBindIndexBuffer(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, vertexBuffer->VertexBuffer, offset, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, vertexBuffer->IndexCount, 1, 0, 0, 0);
-	}
-	else
-	{
-		vkCmdDraw(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer, vertexBuffer->VertexCount, 1, 0, 0);
+		CommandRecorder recorder = ListIndex(Graphics.CommandRecorders, j);
+		for (; recorder->ExecutedCount[i] < recorder->UsedCount[i]; recorder->ExecutedCount[i]++, k++)
+		{
+			commandBuffers[k] = ListIndex(recorder->CommandBuffers[i], recorder->ExecutedCount[i]);
+		}
 	}
+	vkCmdExecuteCommands(Graphics.FrameResources[i].CommandBuffer, commandBufferCount, commandBuffers);
+	// The state bound in the primary command buffer is undefined after executing secondary command buffers
+	CommandRecorderResetState(Graphics.Recorder);
 }
 
 void GraphicsEnd()
 {
 	ValidateRenderingBegan();
+	if (Graphics.ParallelRendering) { ExecuteRecorders(); }
+	else { CommandRecorderFlushDraws(Graphics.Recorder); }
 	vkCmdEndRenderPass(Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer);
+	Graphics.ParallelRendering = false;
+	Graphics.Recorder->Recording = false;
+	EndTimingScope(RenderTimingScope);
 	Graphics.BoundFrameBuffer = NULL;
 }
 
@@ -1125,52 +1926,59 @@ void GraphicsCopyToSwapchain(FrameBuffer frameBuffer)
 	{
 		log_fatal("Trying to copy an uninitialized FrameBuffer to the swapchain.\n");
 	}
+	if (frameBuffer == Graphics.Swapchain.FrameBuffers[Graphics.Swapchain.CurrentImageIndex])
+	{
+		log_fatal("Trying to copy the swapchain FrameBuffer to the swapchain, it was already rendered to directly.\n");
+		exit(1);
+	}
 	
-	unsigned int i = Graphics.FrameIndex;
+	VkCommandBuffer commandBuffer = Graphics.FrameResources[Graphics.FrameIndex].CommandBuffer;
+	int timingScope = BeginTimingScope("CopyToSwapchain");
 	
-	VkImageMemoryBarrier memoryBarrier =
+	Texture source = frameBuffer->ColorTexture;
+	Texture destination = Graphics.Swapchain.FrameBuffers[Graphics.Swapchain.CurrentImageIndex]->ColorTexture;
+	// The whole swapchain image is overwritten, so its previous contents don't need to be kept
+	destination->Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	TextureTransition(destination, commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	TextureTransition(source, commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	
+	VkImageSubresourceLayers subresource =
 	{
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image = Graphics.Swapchain.Images[Graphics.Swapchain.CurrentImageIndex],
-		.subresourceRange =
-		{
-			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-		},
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.mipLevel = 0,
+		.baseArrayLayer = 0,
+		.layerCount = 1,
 	};
-	vkCmdPipelineBarrier(Graphics.FrameResources[i].CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &memoryBarrier);
-	
-	VkImageBlit blitInfo =
+	// A copy is a plain memory copy, it only needs a blit to scale or convert the format
+	if (source->Width == destination->Width && source->Height == destination->Height && source->Format == destination->Format)
 	{
-		.srcOffsets = { { .x = 0, .y = 0, .z = 0}, { .x = frameBuffer->Width, .y = frameBuffer->Height, 1 } },
-		.srcSubresource =
+		VkImageCopy copyInfo =
 		{
-			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.mipLevel = 0,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-		},
-		.dstOffsets = { { .x = 0, .y = 0, .z = 0}, { .x = Window.Width - 1, .y = Window.Height, 1 } },
-		.dstSubresource =
+			.srcSubresource = subresource,
+			.srcOffset = { 0, 0, 0 },
+			.dstSubresource = subresource,
+			.dstOffset = { 0, 0, 0 },
+			.extent = { source->Width, source->Height, 1 },
+		};
+		vkCmdCopyImage(commandBuffer, source->Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination->Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyInfo);
+	}
+	else
+	{
+		VkImageBlit blitInfo =
 		{
-			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.mipLevel = 0,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-		},
-	};
-	vkCmdBlitImage(Graphics.FrameResources[i].CommandBuffer, frameBuffer->ColorTexture->Image, VK_IMAGE_LAYOUT_GENERAL, Graphics.Swapchain.Images[Graphics.Swapchain.CurrentImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitInfo, (VkFilter)frameBuffer->Filter);
+			.srcOffsets = { { .x = 0, .y = 0, .z = 0 }, { .x = source->Width, .y = source->Height, .z = 1 } },
+			.srcSubresource = subresource,
+			.dstOffsets = { { .x = 0, .y = 0, .z = 0 }, { .x = destination->Width, .y = destination->Height, .z = 1 } },
+			.dstSubresource = subresource,
+		};
+		vkCmdBlitImage(commandBuffer, source->Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination->Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitInfo, (VkFilter)frameBuffer->Filter);
+	}
 	
-	memoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	memoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	vkCmdPipelineBarrier(Graphics.FrameResources[i].CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &memoryBarrier);
+	TextureTransition(source, commandBuffer, source->IdleLayout, TextureShaderStages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+	// Swapchain images are presented, headless swapchain images are ordinary framebuffers
+	if (destination->External) { TextureTransition(destination, commandBuffer, destination->IdleLayout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0); }
+	else { TextureTransition(destination, commandBuffer, destination->IdleLayout, TextureShaderStages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT); }
+	EndTimingScope(timingScope);
 }
 
 void GraphicsStopOperations()
@@ -1181,60 +1989,45 @@ void GraphicsStopOperations()
 void GraphicsDeinitialize()
 {
 	ValidateInitialized();
+	WorkerDeinitialize();
 	vkDeviceWaitIdle(Graphics.Device);
 	GraphicsDestroySwapchain();
-	ListDestroy(Graphics.PreRenderSemaphores);
+	UploadDeinitialize();
+	TimelineDeinitialize();
+	while (Graphics.CommandRecorders->Count > 0) { CommandRecorderDestroy(ListIndex(Graphics.CommandRecorders, 0)); }
+	ListDestroy(Graphics.CommandRecorders);
+	free(Graphics.Recorder->Packets);
+	free(Graphics.Recorder->SortedPackets);
+	free(Graphics.Recorder->PacketData);
+	free(Graphics.Recorder);
 	for (int i = 0; i < Graphics.FrameResourceCount; i++)
 	{
-		for (int j = 0; j < Graphics.FrameResources[i].Queues[0]->Count; j++)
-		{
-			VertexBuffer vertexBuffer = ListIndex(Graphics.FrameResources[i].Queues[0], j);
-			VertexBufferDestroy(vertexBuffer);
-		}
-		for (int j = 0; j < Graphics.FrameResources[i].Queues[1]->Count; j++)
-		{
-			UniformBuffer uniformBuffer = ListIndex(Graphics.FrameResources[i].Queues[1], j);
-			UniformBufferDestroy(uniformBuffer);
-		}
-		for (int j = 0; j < Graphics.FrameResources[i].Queues[2]->Count; j++)
-		{
-			FrameBuffer frameBuffer = ListIndex(Graphics.FrameResources[i].Queues[2], j);
-			FrameBufferDestroy(frameBuffer);
-		}
-		for (int j = 0; j < Graphics.FrameResources[i].Queues[3]->Count; j++)
+		free(Graphics.FrameResources[i].DescriptorWrites);
+		free(Graphics.FrameResources[i].DescriptorInfos);
+		for (int j = 0; j < Graphics.FrameResources[i].Arena.OverflowBlocks->Count; j++) { free(ListIndex(Graphics.FrameResources[i].Arena.OverflowBlocks, j)); }
+		free(Graphics.FrameResources[i].Arena.Data);
+		ListDestroy(Graphics.FrameResources[i].Arena.OverflowBlocks);
+		if (Graphics.TimingsEnabled)
 		{
-			StorageBuffer storageBuffer = ListIndex(Graphics.FrameResources[i].Queues[3], j);
-			StorageBufferDestroy(storageBuffer);
+			vkDestroyQueryPool(Graphics.Device, Graphics.FrameResources[i].TimestampPool, NULL);
+			vkDestroyQueryPool(Graphics.Device, Graphics.FrameResources[i].ComputeTimestampPool, NULL);
 		}
-		for (int j = 0; j < Graphics.FrameResources[i].Queues[4]->Count; j++)
-		{
-			Pipeline pipeline = ListIndex(Graphics.FrameResources[i].Queues[4], j);
-			PipelineDestroy(pipeline);
-		}
-		for (int j = 0; j < Graphics.FrameResources[i].Queues[5]->Count; j++)
-		{
-			Texture texture = ListIndex(Graphics.FrameResources[i].Queues[5], j);
-			TextureDestroy(texture);
-		}
-		for (int j = 0; j < GraphicsQueueCount; j++)
-		{
-			ListDestroy(Graphics.FrameResources[i].Queues[j]);
-		}
-		
-		vkDestroyFence(Graphics.Device, Graphics.FrameResources[i].FrameReady, NULL);
-		vkDestroyFence(Graphics.Device, Graphics.FrameResources[i].ComputeFence, NULL);
 		vkDestroySemaphore(Graphics.Device, Graphics.FrameResources[i].RenderFinished, NULL);
 		vkDestroySemaphore(Graphics.Device, Graphics.FrameResources[i].ImageAvailable, NULL);
 		vkDestroySemaphore(Graphics.Device, Graphics.FrameResources[i].ComputeFinished, NULL);
 		vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, 1, &Graphics.FrameResources[i].CommandBuffer);
-		vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, 1, &Graphics.FrameResources[i].ComputeCommandBuffer);
+		vkFreeCommandBuffers(Graphics.Device, Graphics.ComputeCommandPool, 1, &Graphics.FrameResources[i].ComputeCommandBuffer);
 	}
 	free(Graphics.FrameResources);
 	shaderc_compiler_release(Graphics.ShaderCompiler);
 	vmaDestroyAllocator(Graphics.Allocator);
 	vkDestroyCommandPool(Graphics.Device, Graphics.CommandPool, NULL);
-	vkDestroyRenderPass(Graphics.Device, Graphics.RenderPass, NULL);
+	vkDestroyCommandPool(Graphics.Device, Graphics.ComputeCommandPool, NULL);
+	for (int i = 0; i < Graphics.RenderPassCount; i++) { vkDestroyRenderPass(Graphics.Device, Graphics.RenderPasses[i].Instance, NULL); }
+	free(Graphics.RenderPasses);
+	SavePipelineCache();
+	vkDestroyPipelineCache(Graphics.Device, Graphics.PipelineCache, NULL);
 	vkDestroyDevice(Graphics.Device, NULL);
-	vkDestroySurfaceKHR(Graphics.Instance, Graphics.Surface, NULL);
+	if (!Graphics.Headless) { vkDestroySurfaceKHR(Graphics.Instance, Graphics.Surface, NULL); }
 	vkDestroyInstance(Graphics.Instance, NULL);
 }
@@ -10,6 +10,7 @@
 #include "UniformBuffer.h"
 #include "FrameBuffer.h"
 #include "EventHandler.h"
+#include "CommandRecorder.h"
 
 typedef enum PresentMode
 {
@@ -24,6 +25,85 @@ typedef enum PresentMode
 	PresentModeCount,
 } PresentMode;
 
+typedef enum LatencyMode
+{
+	/// The cpu waits in GraphicsUpdate when it's MaxFramesAhead frames ahead of the gpu, after the input was sampled
+	LatencyModeThroughput,
+	/// The cpu waits in EventHandlerPoll before the input is sampled, so the frame is recorded with the most recent input
+	LatencyModeLow,
+	LatencyModeCount,
+} LatencyMode;
+
+typedef enum RenderPassLoad
+{
+	/// The contents from before the pass are kept
+	RenderPassLoadKeep,
+	/// The contents are cleared to the clear value at the start of the pass
+	RenderPassLoadClear,
+	/// The contents from before the pass aren't needed, they're undefined at the start of the pass
+	RenderPassLoadDontCare,
+	RenderPassLoadCount,
+} RenderPassLoad;
+
+typedef struct RenderPassConfigure
+{
+	/// What the color starts as
+	RenderPassLoad ColorLoad;
+	/// The color to clear to if ColorLoad is RenderPassLoadClear
+	Color ClearColor;
+	/// What the depth starts as
+	RenderPassLoad DepthLoad;
+	/// The depth to clear to if DepthLoad is RenderPassLoadClear
+	Scalar ClearDepth;
+	/// What the stencil starts as
+	RenderPassLoad StencilLoad;
+	/// The stencil to clear to if StencilLoad is RenderPassLoadClear
+	unsigned int ClearStencil;
+	/// Whether or not the color is discarded at the end of the pass instead of stored
+	bool DiscardColor;
+	/// Whether or not the depth and stencil are discarded at the end of the pass instead of stored.
+	/// Recommended true when depth is only used for testing within the pass
+	bool DiscardDepthStencil;
+} RenderPassConfigure;
+
+#define GraphicsTimingScopeMax 32
+#define GraphicsPreRenderSemaphoreMax 8
+#define GraphicsFrameArenaSize (64 * 1024)
+#define GraphicsFrameArenaAlignment 16
+
+typedef struct TimingScope
+{
+	/// The name the scope was started with
+	const char * Name;
+	/// Whether or not the scope was recorded on the compute commands
+	bool Compute;
+	/// The gpu time elapsed between the start and the end of the scope
+	double Milliseconds;
+} TimingScope;
+
+typedef struct FrameTimings
+{
+	/// The number of scopes that were timed
+	int ScopeCount;
+	/// The timed scopes in the order that they were started
+	TimingScope Scopes[GraphicsTimingScopeMax];
+} FrameTimings;
+
+typedef struct FrameLatency
+{
+	/// The latency mode in use
+	LatencyMode Mode;
+	/// The number of frames the cpu may record ahead of the gpu
+	int MaxFramesAhead;
+	/// The time the cpu waited on the gpu before recording the frame
+	double WaitMilliseconds;
+	/// The time between sampling the input in EventHandlerPoll and submitting the frame in GraphicsPresent
+	double InputToSubmitMilliseconds;
+	/// The time between sampling the input and the frame being seen finished on the gpu, for the most recent finished frame.
+	/// It's an upper bound since frames are only checked for at GraphicsUpdate
+	double InputToFinishMilliseconds;
+} FrameLatency;
+
 typedef struct GraphicsConfigure
 {
 	/// Whether or not vulkan validation layers should be enabled.
@@ -36,13 +116,31 @@ typedef struct GraphicsConfigure
 	/// Recommended 3 for maximum cpu and gpu balance
 	/// Anything higher than 1 won't make much of a difference if the present mode is VSync or RelaxedVsync
 	int FrameResourceCount;
+	/// Where the cpu waits when it's too far ahead of the gpu
+	LatencyMode LatencyMode;
+	/// The number of frames the cpu may record ahead of the gpu, from 1 to FrameResourceCount.
+	/// 0 uses FrameResourceCount, lower values trade throughput for latency
+	int MaxFramesAhead;
+	/// The number of swapchain images to request, it's clamped to what the surface supports.
+	/// 0 uses 3
+	int SwapchainImageCount;
 	/// The present mode to use, if  possible.
 	/// The only one guarenteed to be available is PresentModeVSync
 	PresentMode TargetPresentMode;
+	/// Whether or not to run without a surface and swapchain (for machines without a display).
+	/// Images are rendered into internally owned framebuffers and presenting only paces the frames.
+	bool Headless;
+	/// Whether or not gpu timestamps are recorded around passes for GraphicsFrameTimings.
+	/// Recommended false for release
+	bool GpuTimings;
+	/// The directory that compiled pipelines are cached in between launches, it must already exist.
+	/// NULL keeps the cache in memory only
+	const char * CacheDirectory;
 } GraphicsConfigure;
 
 struct Graphics
 {
+	bool Headless;
 	VkInstance Instance;
 	VkSurfaceKHR Surface;
 	VkPhysicalDevice PhysicalDevice;
@@ -54,6 +152,17 @@ struct Graphics
 	bool ComputeQueueSupported;
 	VkQueue ComputeQueue;
 	unsigned int ComputeQueueIndex;
+	bool TransferQueueSupported;
+	VkQueue TransferQueue;
+	unsigned int TransferQueueIndex;
+	int SharedQueueCount;
+	unsigned int SharedQueueIndices[3];
+	bool MultiDrawIndirectSupported;
+	unsigned int MaxDrawIndirectCount;
+	bool DrawIndirectCountSupported;
+	PFN_vkCmdDrawIndexedIndirectCountKHR CmdDrawIndexedIndirectCount;
+	const char * CacheDirectory;
+	VkPipelineCache PipelineCache;
 	
 	struct GraphicsSwapchain
 	{
@@ -62,17 +171,44 @@ struct Graphics
 		PresentMode PresentMode;
 		VkExtent2D TargetExtent;
 		VkExtent2D Extent;
+		unsigned int TargetImageCount;
 		VkFormat ColorFormat;
 		unsigned int ImageCount;
 		VkImage * Images;
+		FrameBuffer * FrameBuffers;
 		unsigned int CurrentImageIndex;
+		/// Whether or not the swapchain is recreated at the next GraphicsAquireNextImage
+		bool Outdated;
 	} Swapchain;
 	
+	/// The render pass that loads and stores everything, pipelines and framebuffers are created with it since every variant is compatible with it
 	VkRenderPass RenderPass;
+	/// The render pass that swapchain framebuffers and pipelines created with SwapchainTarget are compatible with
+	VkRenderPass SwapchainRenderPass;
+	int RenderPassCount;
+	struct GraphicsRenderPass
+	{
+		struct GraphicsRenderPassKey
+		{
+			VkFormat ColorFormat;
+			VkFormat DepthFormat;
+			VkImageLayout ColorLayout;
+			VkAttachmentLoadOp ColorLoad;
+			VkAttachmentLoadOp DepthLoad;
+			VkAttachmentLoadOp StencilLoad;
+			VkAttachmentStoreOp ColorStore;
+			VkAttachmentStoreOp DepthStore;
+			VkAttachmentStoreOp StencilStore;
+		} Key;
+		VkRenderPass Instance;
+	} * RenderPasses;
 	VkCommandPool CommandPool;
+	VkCommandPool ComputeCommandPool;
 	VmaAllocator Allocator;
 	shaderc_compiler_t ShaderCompiler;
-	List PreRenderSemaphores;
+	int PreRenderSemaphoreCount;
+	VkSemaphore PreRenderSemaphores[GraphicsPreRenderSemaphoreMax];
+	VkPipelineStageFlags PreRenderStages[GraphicsPreRenderSemaphoreMax];
 	
 	int FrameResourceCount;
 	struct GraphicsFrameResource
@@ -80,32 +216,77 @@ struct Graphics
 		VkCommandBuffer CommandBuffer;
 		VkSemaphore ImageAvailable;
 		VkSemaphore RenderFinished;
-		VkFence FrameReady;
+		uint64_t FrameValue;
+		uint64_t InputTime;
 		VkCommandBuffer ComputeCommandBuffer;
 		VkSemaphore ComputeFinished;
-		VkFence ComputeFence;
-		List Queues[7];
-		#define GraphicsQueueDestroyVertexBuffer 0
-		#define GraphicsQueueDestroyUniformBuffer 1
-		#define GraphicsQueueDestroyFrameBuffer 2
-		#define GraphicsQueueDestroyStorageBuffer 3
-		#define GraphicsQueueDestroyPipeline 4
-		#define GraphicsQueueDestroyTexture 5
-		#define GraphicsQueueUploadDescriptor 6
-		#define GraphicsQueueCount 7
+		uint64_t ComputeValue;
+		VkQueryPool TimestampPool;
+		VkQueryPool ComputeTimestampPool;
+		int TimestampCount;
+		int ComputeTimestampCount;
+		int TimingScopeCount;
+		struct GraphicsTimingScope
+		{
+			const char * Name;
+			bool Compute;
+			int Begin;
+			int End;
+		} TimingScopes[GraphicsTimingScopeMax];
+		int DescriptorWriteCount;
+		int DescriptorWriteCapacity;
+		VkWriteDescriptorSet * DescriptorWrites;
+		union GraphicsDescriptorInfo
+		{
+			VkDescriptorBufferInfo Buffer;
+			VkDescriptorImageInfo Image;
+		} * DescriptorInfos;
+		struct GraphicsFrameArena
+		{
+			unsigned char * Data;
+			size_t Capacity;
+			size_t Used;
+			size_t OverflowSize;
+			List OverflowBlocks;
+		} Arena;
 	} * FrameResources;
 	int FrameIndex;
+	unsigned long FrameCount;
+	
+	LatencyMode LatencyMode;
+	int MaxFramesAhead;
+	uint64_t InputTime;
+	double LatencyWaitMilliseconds;
+	FrameLatency Latency;
+	
+	bool TimingsEnabled;
+	float TimestampPeriod;
+	uint64_t TimestampMask;
+	uint64_t ComputeTimestampMask;
+	int TimingStack[GraphicsTimingScopeMax];
+	int TimingStackCount;
+	FrameTimings Timings;
 	
 	FrameBuffer BoundFrameBuffer;
-	Pipeline BoundPipeline;
+	VkRenderPass BoundRenderPass;
+	bool ParallelRendering;
+	CommandRecorder Recorder;
+	List CommandRecorders;
 } extern Graphics;
 
 /// This should not be called by the user, it is called in the XGIInitialize function
 void GraphicsInitialize(GraphicsConfigure config);
 
-/// This should not be called, it is automatically called at initialization, and when the window is resized.
+/// This should not be called, it is automatically called at initialization.
 void GraphicsCreateSwapchain(int width, int height);
 
+/// Requests the swapchain to be recreated with a new size, it's called automatically when the window is resized.
+/// The swapchain is recreated at the next GraphicsAquireNextImage without waiting for the gpu, the old images are destroyed once the frames using them finish.
+/// Any number of requests before then are applied with one recreation.
+/// \param width The new width of the swapchain
+/// \param height The new height of the swapchain
+void GraphicsResizeSwapchain(int width, int height);
+
 /// Gets the present mode that is currently in use
 /// \return The present mode that was chosen
 PresentMode GraphicsPresentMode(void);
@@ -114,6 +295,20 @@ PresentMode GraphicsPresentMode(void);
 /// \param presentMode The desired present mode to set
 void GraphicsSetPresentMode(PresentMode presentMode);
 
+/// Sets how far the cpu may record ahead of the gpu, and where it waits when it's too far ahead.
+/// The change applies from the next frame.
+/// \param mode The latency mode to use, it must be below LatencyModeCount
+/// \param maxFramesAhead The number of frames the cpu may record ahead of the gpu, from 1 to FrameResourceCount. 0 is the default and uses FrameResourceCount
+void GraphicsSetFrameLatency(LatencyMode mode, int maxFramesAhead);
+
+/// Gets the latencies of the most recently presented frame.
+/// \return The frame latency
+FrameLatency GraphicsFrameLatency(void);
+
+/// This should not be called by the user, it is called in EventHandlerPoll before the events are read.
+/// Records when the input of the next frame is sampled, and waits on the gpu first if the latency mode is LatencyModeLow.
+void GraphicsSampleInput(void);
+
 /// Begins recording commands for use on a compute pipeline.
 /// This should be called once a frame and all compute pipeline dispatches should be called after this.
 void GraphicsStartCompute(void);
@@ -126,24 +321,54 @@ void GraphicsStartCompute(void);
 /// \param zGroups The number of work groups in the z direction
 void GraphicsDispatch(ComputePipeline pipeline, int xGroups, int yGroups, int zGroups);
 
+/// Dispatches a compute pipeline in the graphics commands, so rendering later in the frame can use its results without waiting on the compute queue.
+/// The writes of the dispatch are made visible to later dispatches, indirect draws and vertex and fragment shaders.
+/// This should only be called after GraphicsAquireNextImage and outside of GraphicsBegin and GraphicsEnd.
+/// \param pipeline The compute pipeline to dispatch
+/// \param xGroups The number of work groups in the x direction
+/// \param yGroups The number of work groups in the y direction
+/// \param zGroups The number of work groups in the z direction
+void GraphicsDispatchInline(ComputePipeline pipeline, int xGroups, int yGroups, int zGroups);
+
+/// Gets the graphics command buffer of the frame, so commands like barriers and buffer updates can be recorded between rendering.
+/// This should only be called after GraphicsAquireNextImage and outside of GraphicsBegin and GraphicsEnd.
+/// \return The command buffer of the frame
+VkCommandBuffer GraphicsCommandBuffer(void);
+
 /// Ends recording of compute pipeline dispatches.
 /// This should be called once a frame and should only be called after GraphicsStartCompute.
 void GraphicsEndCompute(void);
 
 /// Advances the engine to the next frame resource.
-/// Also processes anything in queues at this point (like VertexBufferQueueDestroy).
+/// Also destroys anything queued for destruction that the gpu has finished with (like VertexBufferQueueDestroy).
 /// This should be called once per a frame, before any graphics or compute operations are done.
 void GraphicsUpdate(void);
 
+/// Allocates transient memory from the current frame resource's arena.
+/// The memory is freed automatically once the frame resource is reused, FrameResourceCount updates later, so it must not be freed by the user.
+/// If the arena runs out, the allocation falls back to the heap and the arena grows at its next reset.
+/// This should only be called from the main thread.
+/// \param size The number of bytes to allocate
+/// \return The allocated memory, aligned to GraphicsFrameArenaAlignment
+void * GraphicsFrameAlloc(size_t size);
+
+/// Gets the framebuffer of the current swapchain image, so the frame can be rendered directly into it instead of being copied with GraphicsCopyToSwapchain.
+/// The framebuffer changes every frame and is only valid after GraphicsAquireNextImage until GraphicsPresent.
+/// Pipelines used with it must be created with SwapchainTarget, unless the swapchain format is the color texture format.
+/// \return The framebuffer of the current image
+FrameBuffer GraphicsSwapchainFrameBuffer(void);
+
 /// Acquires the next swapchain image for rendering.
 /// This should be called once per a frame, specifically before any rendering operations are called
+/// In headless mode this only advances to the next internally owned image.
 void GraphicsAquireNextImage(void);
 
 /// Presents the acquired image to the screen
 /// This should be called once per a frame, after all render calls have been finished
+/// In headless mode the commands are submitted but nothing is presented.
 void GraphicsPresent(void);
 
-/// This should not be called, it is automatically called at deinitialization, and when the window is resized.
+/// This should not be called, it is automatically called at deinitialization.
 void GraphicsDestroySwapchain(void);
 
 /// Begins rendering on a given framebuffer.
@@ -151,6 +376,25 @@ void GraphicsDestroySwapchain(void);
 /// \param frameBuffer the framebuffer to start rendering on
 void GraphicsBegin(FrameBuffer frameBuffer);
 
+/// Begins rendering on a given framebuffer where the commands are recorded by CommandRecorders on other threads.
+/// The Graphics render functions can't be used until GraphicsEnd, the recorders commands are executed at GraphicsEnd in the order the recorders were created.
+/// This should only be called after SwapchainAquireNextImage and before SwapchainPresent
+/// \param frameBuffer the framebuffer to start rendering on
+void GraphicsBeginParallel(FrameBuffer frameBuffer);
+
+/// Begins rendering on a given framebuffer, with what the attachments start as and whether they're stored at the end.
+/// Clearing or not caring at the start and discarding at the end avoids loading and storing the whole framebuffer, which is expensive on tile-based and bandwidth-limited gpus.
+/// This should only be called after SwapchainAquireNextImage and before SwapchainPresent
+/// \param frameBuffer the framebuffer to start rendering on
+/// \param config What the attachments start as and whether they're stored
+void GraphicsBeginPass(FrameBuffer frameBuffer, RenderPassConfigure config);
+
+/// Begins rendering on a given framebuffer where the commands are recorded by CommandRecorders on other threads, see GraphicsBeginParallel and GraphicsBeginPass.
+/// This should only be called after SwapchainAquireNextImage and before SwapchainPresent
+/// \param frameBuffer the framebuffer to start rendering on
+/// \param config What the attachments start as and whether they're stored
+void GraphicsBeginParallelPass(FrameBuffer frameBuffer, RenderPassConfigure config);
+
 /// Clears the color of the currently bound framebuffer.
 /// This shoud only be called after GraphicsBegin and before GraphicsEnd
 /// \param clearColor Color to clear to
@@ -184,14 +428,77 @@ void GraphicsBindPipeline(Pipeline pipeline);
 /// A pipeline must be bound before calling this
 void GraphicsRenderVertexBuffer(VertexBuffer vertexBuffer);
 
+/// Renders several instances of a vertexbuffer in one draw to the currently bound framebuffer using the currently bound pipeline.
+/// This shoud only be called after GraphicsBegin and before GraphicsEnd.
+/// A pipeline must be bound before calling this
+/// \param vertexBuffer The vertex buffer to render
+/// \param instanceBuffer The per-instance attributes, it's required if the pipeline's vertex layout was created with instance attributes, otherwise it's ignored
+/// \param instanceCount The number of instances to render
+/// \param firstInstance The first instance to render, instance attributes are read starting at this instance
+void GraphicsRenderVertexBufferInstanced(VertexBuffer vertexBuffer, VertexBuffer instanceBuffer, int instanceCount, int firstInstance);
+
+/// Renders a vertexbuffer with draw parameters read by the gpu from a storage buffer, which can be written by a compute pipeline.
+/// The storage buffer holds drawCount tightly packed VkDrawIndexedIndirectCommand records, or VkDrawIndirectCommand records if the vertex buffer has no index buffer.
+/// This shoud only be called after GraphicsBegin and before GraphicsEnd.
+/// A pipeline must be bound before calling this
+/// \param vertexBuffer The vertex buffer to render
+/// \param arguments The storage buffer that holds the draw commands
+/// \param offset The byte offset of the first draw command, it must be a multiple of 4
+/// \param drawCount The number of draw commands to read, the commands must fit in the storage buffer
+void GraphicsRenderIndirect(VertexBuffer vertexBuffer, struct StorageBuffer * arguments, unsigned long offset, int drawCount);
+
+/// Renders a vertexbuffer with indexed draw parameters and the number of draws read by the gpu from storage buffers.
+/// The number of draws is a uint32 that's clamped to maxDrawCount.
+/// If VK_KHR_draw_indirect_count isn't supported, maxDrawCount draws are always recorded, so unused draws should have an instance count of 0.
+/// This shoud only be called after GraphicsBegin and before GraphicsEnd.
+/// A pipeline must be bound before calling this
+/// \param vertexBuffer The vertex buffer to render, it must have an index buffer
+/// \param arguments The storage buffer that holds the VkDrawIndexedIndirectCommand records
+/// \param offset The byte offset of the first draw command, it must be a multiple of 4
+/// \param count The storage buffer that holds the number of draws
+/// \param countOffset The byte offset of the number of draws, it must be a multiple of 4
+/// \param maxDrawCount The maximum number of draws to read, that many commands must fit in the storage buffer
+void GraphicsRenderIndexedIndirectCount(VertexBuffer vertexBuffer, struct StorageBuffer * arguments, unsigned long offset, struct StorageBuffer * count, unsigned long countOffset, int maxDrawCount);
+
+/// Queues a vertex buffer to be rendered with a pipeline, the queued draws are sorted to minimize state changes and recorded at GraphicsEnd.
+/// The pipeline's current push constants are captured, so the pipeline can be changed for the next draw.
+/// Opaque draws are recorded first grouped by pipeline and front to back, then transparent draws back to front.
+/// This shoud only be called after GraphicsBegin and before GraphicsEnd.
+/// \param pipeline The pipeline to render with
+/// \param vertexBuffer The vertex buffer to render
+/// \param depth The distance from the camera, it must not be negative
+/// \param transparent Whether or not the draw is blended with what's behind it
+void GraphicsQueueDraw(Pipeline pipeline, VertexBuffer vertexBuffer, Scalar depth, bool transparent);
+
 /// Ends rendering to a framebuffer.
+/// Draws queued with GraphicsQueueDraw are recorded before the rendering ends.
 /// This should be called after GraphicsBegin and before SwapchainPresent
+/// If rendering began with GraphicsBeginParallel, every CommandRecorder must have ended recording before this is called.
 void GraphicsEnd(void);
 
 /// Copies a framebuffer to the swapchain for rendering,
 /// This should only be called after GraphicsEnd and before SwapchainPresent
 void GraphicsCopyToSwapchain(FrameBuffer frameBuffer);
 
+/// Starts a named gpu timing scope, the scope is recorded in the compute commands if they are being recorded.
+/// Scopes can be nested and must be ended with GraphicsEndTiming in the same frame.
+/// This does nothing unless GraphicsConfigure.GpuTimings is enabled and supported.
+/// \param name The name of the scope, it must stay valid until the timings are read
+void GraphicsBeginTiming(const char * name);
+
+/// Ends the most recently started gpu timing scope.
+void GraphicsEndTiming(void);
+
+/// Gets the gpu timings of the most recent frame that has finished on the gpu.
+/// The passes between GraphicsBegin/GraphicsEnd, GraphicsStartCompute/GraphicsEndCompute and GraphicsCopyToSwapchain are timed automatically.
+/// \return The timings of every scope in the frame
+FrameTimings GraphicsFrameTimings(void);
+
+/// Gets the number of state commands recorded and skipped as redundant since the last GraphicsUpdate, summed over every CommandRecorder.
+/// This should be read after GraphicsEnd, while no CommandRecorder is recording.
+/// \return The recording statistics of the frame
+CommandRecorderStatistics GraphicsRecordingStatistics(void);
+
 /// Syncs all graphics operations with the cpu.
 /// This should be called right before deinitializing the application
 void GraphicsStopOperations(void);
@@ -59,12 +59,8 @@ void ListRemove(List list, int index)
 	}
 	
 	for (int j = index + 1; j < list->Count; j++) { list->Data[j - 1] = list->Data[j]; }
+	// The capacity is kept so lists that are refilled every frame don't reallocate
 	list->Count--;
-	if (list->Count == list->Capacity / 2 - 1)
-	{
-		list->Capacity /= 2;
-		list->Data = realloc(list->Data, list->Capacity * sizeof(void *));
-	}
 }
 
 void ListPush(List list, void * value)
@@ -134,10 +130,7 @@ bool ListContains(List list, void * value)
 void ListClear(List list)
 {
 	ValidateListObject(list);
-	for (int i = list->Count - 1; i >= 0; i--)
-	{
-		ListRemove(list, i);
-	}
+	list->Count = 0;
 }
 
 void ListDestroy(List list)
@@ -8,28 +8,67 @@
 #include "UniformBuffer.h"
 #include "StorageBuffer.h"
 #include "File.h"
+#include "ShaderCache.h"
+#include "Worker.h"
+#include "Timeline.h"
 #include "log.h"
 
-ShaderData ShaderDataFromMemory(ShaderType type, unsigned long dataSize, void * data, bool precompiled)
+// Identical pipelines, programs and layouts are shared, they're looked up by the hash of what they're created from
+static struct PipelineRegistry
 {
-	if (!precompiled)
+	/// Only held while the arrays and reference counts are touched, objects are created and destroyed outside of it
+	SDL_SpinLock Lock;
+	int SharedCount;
+	SharedPipeline * Shared;
+	int ProgramCount;
+	PipelineProgram * Programs;
+	int DescriptorLayoutCount;
+	struct RegisteredDescriptorLayout
 	{
-		shaderc_shader_kind shaderType;
-		switch (type)
-		{
-			case ShaderTypeVertex: shaderType = shaderc_vertex_shader; break;
-			case ShaderTypeFragment: shaderType = shaderc_fragment_shader; break;
-			case ShaderTypeCompute: shaderType = shaderc_compute_shader; break;
-		}
-		shaderc_compilation_result_t result = shaderc_compile_into_spv(Graphics.ShaderCompiler, data, dataSize, shaderType, "shader", "main", 0);
-		if (shaderc_result_get_num_errors(result) > 0)
-		{
-			log_fatal("Error while compiling shader:\n%s\n", shaderc_result_get_error_message(result));
-			exit(1);
-		}
-		data = (void *)shaderc_result_get_bytes(result);
-		dataSize = shaderc_result_get_length(result);
+		PipelineKey Key;
+		int ReferenceCount;
+		VkDescriptorSetLayout Instance;
+	} * DescriptorLayouts;
+	int LayoutCount;
+	struct RegisteredLayout
+	{
+		PipelineKey Key;
+		int ReferenceCount;
+		VkPipelineLayout Instance;
+	} * Layouts;
+} Registry = { 0 };
+
+static void KeyAppend(PipelineKey * key, const void * data, unsigned long size)
+{
+	key->Data = realloc(key->Data, key->Size + size);
+	memcpy(key->Data + key->Size, data, size);
+	key->Size += size;
+}
+
+static void KeyFinish(PipelineKey * key)
+{
+	key->Hash = ShaderCacheHash(ShaderCacheHashSeed, key->Data, key->Size);
+}
+
+static bool KeyEqual(PipelineKey a, PipelineKey b)
+{
+	return a.Hash == b.Hash && a.Size == b.Size && memcmp(a.Data, b.Data, a.Size) == 0;
+}
+
+static shaderc_shader_kind ShaderKind(ShaderType type)
+{
+	switch (type)
+	{
+		case ShaderTypeVertex: return shaderc_vertex_shader;
+		case ShaderTypeFragment: return shaderc_fragment_shader;
+		case ShaderTypeCompute: return shaderc_compute_shader;
+		default: log_fatal("Trying to compile a shader with an unknown ShaderType %i.\n", type); exit(1);
 	}
+}
+
+ShaderData ShaderDataFromMemory(ShaderType type, unsigned long dataSize, void * data, bool precompiled)
+{
+	if (!precompiled) { data = ShaderCacheCompile(ShaderKind(type), data, dataSize, "shader", &dataSize); }
 	return (ShaderData)
 	{
 		.Type = type,
@@ -40,95 +79,150 @@ ShaderData ShaderDataFromMemory(ShaderType type, unsigned long dataSize, void *
 
 ShaderData ShaderDataFromFile(ShaderType type, const char * file, bool precompiled)
 {
+	File shader = FileOpen(file, precompiled ? FileModeReadBinary : FileModeRead);
+	unsigned long size = FileGetSize(shader);
+	void * data = malloc(size);
+	FileRead(shader, 0, size, data);
+	FileClose(shader);
 	if (!precompiled)
 	{
-		File shader = FileOpen(file, FileModeRead);
-		unsigned long size = FileGetSize(shader);
-		char * text = malloc(size);
-		FileRead(shader, 0, size, text);
-		FileClose(shader);
-		shaderc_shader_kind shaderType;
-		switch (type)
-		{
-			case ShaderTypeVertex: shaderType = shaderc_vertex_shader; break;
-			case ShaderTypeFragment: shaderType = shaderc_fragment_shader; break;
-			case ShaderTypeCompute: shaderType = shaderc_compute_shader; break;
-		}
-		shaderc_compilation_result_t result = shaderc_compile_into_spv(Graphics.ShaderCompiler, text, size, shaderType, file, "main", 0);
-		if (shaderc_result_get_num_errors(result) > 0)
-		{
-			log_fatal("Error while compiling shader:\n%s\n", shaderc_result_get_error_message(result));
-			exit(1);
-		}
-		void * data = (void *)shaderc_result_get_bytes(result);
-		unsigned long dataSize = shaderc_result_get_length(result);
-		return (ShaderData)
-		{
-			.Type = type,
-			.DataSize = dataSize,
-			.Data = data,
-		};
+		void * text = data;
+		data = ShaderCacheCompile(ShaderKind(type), text, size, file, &size);
+		free(text);
 	}
-	File spv = FileOpen(file, FileModeReadBinary);
-	unsigned long size = FileGetSize(spv);
+	return (ShaderData)
+	{
+		.Type = type,
+		.DataSize = size,
+		.Data = data,
+	};
+}
+
+ShaderData ShaderDataSourceFromMemory(ShaderType type, unsigned long dataSize, const char * data)
+{
+	return (ShaderData)
+	{
+		.Type = type,
+		.DataSize = dataSize,
+		.Data = (void *)data,
+		.Source = true,
+		.Name = "shader",
+	};
+}
+
+ShaderData ShaderDataSourceFromFile(ShaderType type, const char * file)
+{
+	File shader = FileOpen(file, FileModeRead);
+	unsigned long size = FileGetSize(shader);
 	void * data = malloc(size);
-	FileRead(spv, 0, size, data);
-	FileClose(spv);
+	FileRead(shader, 0, size, data);
+	FileClose(shader);
 	return (ShaderData)
 	{
 		.Type = type,
 		.DataSize = size,
 		.Data = data,
+		.Source = true,
+		.Name = file,
 	};
 }
 
-static void CreateReflectModules(Pipeline pipeline, PipelineConfigure config)
+static void CompileSources(PipelineConfigure * config)
+{
+	for (int i = 0; i < config->ShaderCount; i++)
+	{
+		ShaderData * shader = config->Shaders + i;
+		if (!shader->Source) { continue; }
+		shader->Data = ShaderCacheCompile(ShaderKind(shader->Type), shader->Data, shader->DataSize, shader->Name, &shader->DataSize);
+	}
+}
+
+static void FreeCompiledSources(PipelineConfigure original, PipelineConfigure compiled)
+{
+	for (int i = 0; i < original.ShaderCount; i++)
+	{
+		if (original.Shaders[i].Source) { free(compiled.Shaders[i].Data); }
+	}
+}
+
+static void CreateReflectModules(PipelineProgram program, PipelineConfigure config)
 {
-	pipeline->StageCount = config.ShaderCount;
-	pipeline->Stages = malloc(pipeline->StageCount * sizeof(struct PipelineStage));
+	program->StageCount = config.ShaderCount;
+	program->Stages = malloc(program->StageCount * sizeof(struct PipelineStage));
 	
-	for (int i = 0; i < pipeline->StageCount; i++)
+	for (int i = 0; i < program->StageCount; i++)
 	{
-		pipeline->Stages[i].ShaderType = config.Shaders[i].Type;
-		spvReflectCreateShaderModule(config.Shaders[i].DataSize, config.Shaders[i].Data, &pipeline->Stages[i].Module);
+		program->Stages[i].ShaderType = config.Shaders[i].Type;
+		spvReflectCreateShaderModule(config.Shaders[i].DataSize, config.Shaders[i].Data, &program->Stages[i].Module);
 	}
 }
 
-static VkPushConstantRange GetPushConstantRange(Pipeline pipeline)
+static void CreateShaderModules(PipelineProgram program, PipelineConfigure config)
 {
-	VkPushConstantRange pushConstantRange = { 0 };
-	for (int i = 0; i < pipeline->StageCount; i++)
+	for (int i = 0; i < config.ShaderCount; i++)
+	{
+		VkShaderModuleCreateInfo moduleInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = config.Shaders[i].DataSize,
+			.pCode = config.Shaders[i].Data,
+		};
+		VkResult result = vkCreateShaderModule(Graphics.Device, &moduleInfo, NULL, program->Modules + i);
+		if (result != VK_SUCCESS)
+		{
+			log_fatal("Unable to create shader module: %i\n", result);
+			exit(1);
+		}
+	}
+}
+
+static void GetPushConstantRange(PipelineProgram program)
+{
+	program->PushConstantRange = (VkPushConstantRange){ 0 };
+	for (int i = 0; i < program->StageCount; i++)
 	{
 		unsigned int pushConstantCount;
-		spvReflectEnumeratePushConstantBlocks(&pipeline->Stages[i].Module, &pushConstantCount, NULL);
+		spvReflectEnumeratePushConstantBlocks(&program->Stages[i].Module, &pushConstantCount, NULL);
 		SpvReflectBlockVariable * pushConstants = malloc(pushConstantCount * sizeof(SpvReflectBlockVariable));
-		spvReflectEnumeratePushConstantBlocks(&pipeline->Stages[i].Module, &pushConstantCount, &pushConstants);
+		spvReflectEnumeratePushConstantBlocks(&program->Stages[i].Module, &pushConstantCount, &pushConstants);
 		if (pushConstantCount > 0)
 		{
-			pipeline->UsesPushConstant = true;
-			pipeline->PushConstantInfo = pushConstants[0];
-			pipeline->PushConstantData = malloc(pushConstants[0].size);
-			pipeline->PushConstantSize = pushConstants[0].size;
+			program->UsesPushConstant = true;
+			program->PushConstantInfo = pushConstants[0];
 			VkShaderStageFlags stages = 0;
-			for (int j = 0; j < pipeline->StageCount; j++) { stages |= pipeline->Stages[j].ShaderType; }
-			return (VkPushConstantRange)
+			for (int j = 0; j < program->StageCount; j++) { stages |= program->Stages[j].ShaderType; }
+			program->PushConstantRange = (VkPushConstantRange)
 			{
 				.stageFlags = stages,
 				.offset = pushConstants[0].offset,
 				.size = pushConstants[0].size,
 			};
+			return;
 		}
 	}
-	return pushConstantRange;
 }
 
-static void CreateDescriptorLayout(Pipeline pipeline, int * uboCount, int * samplerCount, int * storageCount)
+/// Looks up a registered descriptor set layout and takes a reference to it, the registry has to be locked
+/// \return Whether or not a layout with the key was registered
+static bool FindDescriptorLayout(PipelineKey key, VkDescriptorSetLayout * layout)
+{
+	for (int i = 0; i < Registry.DescriptorLayoutCount; i++)
+	{
+		if (!KeyEqual(Registry.DescriptorLayouts[i].Key, key)) { continue; }
+		Registry.DescriptorLayouts[i].ReferenceCount++;
+		*layout = Registry.DescriptorLayouts[i].Instance;
+		return true;
+	}
+	return false;
+}
+
+static void CreateDescriptorLayout(PipelineProgram program)
 {
 	unsigned int bindingCount = 0;
-	pipeline->UsesDescriptors = false;
-	for (int i = 0; i < pipeline->StageCount; i++)
+	program->UsesDescriptors = false;
+	for (int i = 0; i < program->StageCount; i++)
 	{
-		struct PipelineStage * stage = pipeline->Stages + i;
+		struct PipelineStage * stage = program->Stages + i;
 		unsigned int setCount;
 		spvReflectEnumerateDescriptorSets(&stage->Module, &setCount, NULL);
 		SpvReflectDescriptorSet * sets = malloc(setCount * sizeof(SpvReflectDescriptorSet));
@@ -137,23 +231,24 @@ static void CreateDescriptorLayout(Pipeline pipeline, int * uboCount, int * samp
 		stage->BindingCount = 0;
 		if (setCount > 0)
 		{
-			pipeline->UsesDescriptors = true;
+			program->UsesDescriptors = true;
 			stage->DescriptorInfo = sets[0];
 			stage->BindingCount = stage->DescriptorInfo.binding_count;
 			bindingCount += stage->DescriptorInfo.binding_count;
 		}
 	}
-	if (pipeline->UsesDescriptors)
+	if (program->UsesDescriptors)
 	{
 		VkDescriptorSetLayoutBinding * layoutBindings = malloc(bindingCount * sizeof(VkDescriptorSetLayoutBinding));
-		for (int i = 0, c = 0; i < pipeline->StageCount; i++)
+		PipelineKey key = { 0 };
+		for (int i = 0, c = 0; i < program->StageCount; i++)
 		{
-			struct PipelineStage * stage = pipeline->Stages + i;
+			struct PipelineStage * stage = program->Stages + i;
 			unsigned int setCount;
 			spvReflectEnumerateDescriptorSets(&stage->Module, &setCount, NULL);
 			SpvReflectDescriptorSet * sets = malloc(setCount * sizeof(SpvReflectDescriptorSet));
 			spvReflectEnumerateDescriptorSets(&stage->Module, &setCount, &sets);
-
+	
 			if (setCount > 0)
 			{
 				for (int j = 0; j < stage->DescriptorInfo.binding_count; j++, c++)
@@ -166,26 +261,93 @@ static void CreateDescriptorLayout(Pipeline pipeline, int * uboCount, int * samp
 						.descriptorType = (VkDescriptorType)binding->descriptor_type,
 						.stageFlags = stage->ShaderType,
 					};
-					if (binding->descriptor_type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) { (*samplerCount) += binding->count; }
-					if (binding->descriptor_type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) { (*uboCount) += binding->count; }
-					if (binding->descriptor_type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) { (*storageCount) += binding->count; }
+					uint32_t bindingInfo[] = { layoutBindings[c].binding, layoutBindings[c].descriptorType, layoutBindings[c].descriptorCount, layoutBindings[c].stageFlags };
+					KeyAppend(&key, bindingInfo, sizeof(bindingInfo));
+					if (binding->descriptor_type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) { program->SamplerCount += binding->count; }
+					if (binding->descriptor_type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) { program->UniformCount += binding->count; }
+					if (binding->descriptor_type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) { program->StorageCount += binding->count; }
 				}
 			}
 		}
-
+		
+		// Each descriptor gets its own slot, so a pending write to it is found without searching the frame's writes
+		unsigned int maxBinding = 0;
+		for (int i = 0; i < bindingCount; i++) { maxBinding = layoutBindings[i].binding > maxBinding ? layoutBindings[i].binding : maxBinding; }
+		program->DescriptorBindingCount = maxBinding + 1;
+		program->DescriptorSlotOffsets = malloc(program->DescriptorBindingCount * sizeof(int));
+		for (int i = 0; i < program->DescriptorBindingCount; i++) { program->DescriptorSlotOffsets[i] = -1; }
+		program->DescriptorSlotCount = 0;
+		for (int i = 0; i < bindingCount; i++)
+		{
+			if (program->DescriptorSlotOffsets[layoutBindings[i].binding] != -1) { continue; }
+			program->DescriptorSlotOffsets[layoutBindings[i].binding] = program->DescriptorSlotCount;
+			program->DescriptorSlotCount += layoutBindings[i].descriptorCount;
+		}
+	
+		KeyFinish(&key);
+		SDL_AtomicLock(&Registry.Lock);
+		bool found = FindDescriptorLayout(key, &program->DescriptorLayout);
+		SDL_AtomicUnlock(&Registry.Lock);
+		if (found)
+		{
+			free(key.Data);
+			free(layoutBindings);
+			return;
+		}
+		
+		// It's created outside of the lock like programs are, if another thread registered the same layout first this one is thrown away
 		VkDescriptorSetLayoutCreateInfo layoutInfo =
 		{
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 			.bindingCount = bindingCount,
 			.pBindings = layoutBindings,
 		};
-		vkCreateDescriptorSetLayout(Graphics.Device, &layoutInfo, NULL, &pipeline->DescriptorLayout);
+		VkDescriptorSetLayout layout;
+		vkCreateDescriptorSetLayout(Graphics.Device, &layoutInfo, NULL, &layout);
 		free(layoutBindings);
+		SDL_AtomicLock(&Registry.Lock);
+		found = FindDescriptorLayout(key, &program->DescriptorLayout);
+		if (!found)
+		{
+			program->DescriptorLayout = layout;
+			Registry.DescriptorLayouts = realloc(Registry.DescriptorLayouts, (Registry.DescriptorLayoutCount + 1) * sizeof(struct RegisteredDescriptorLayout));
+			Registry.DescriptorLayouts[Registry.DescriptorLayoutCount++] = (struct RegisteredDescriptorLayout)
+			{
+				.Key = key,
+				.ReferenceCount = 1,
+				.Instance = layout,
+			};
+		}
+		SDL_AtomicUnlock(&Registry.Lock);
+		if (found)
+		{
+			vkDestroyDescriptorSetLayout(Graphics.Device, layout, NULL);
+			free(key.Data);
+		}
 	}
 }
 
-static void CreateDescriptorPool(Pipeline pipeline, int uboCount, int samplerCount, int storageCount)
+static void ReleaseDescriptorLayout(VkDescriptorSetLayout layout)
 {
+	SDL_AtomicLock(&Registry.Lock);
+	bool destroy = false;
+	for (int i = 0; i < Registry.DescriptorLayoutCount; i++)
+	{
+		if (Registry.DescriptorLayouts[i].Instance != layout || --Registry.DescriptorLayouts[i].ReferenceCount > 0) { continue; }
+		destroy = true;
+		free(Registry.DescriptorLayouts[i].Key.Data);
+		Registry.DescriptorLayouts[i] = Registry.DescriptorLayouts[--Registry.DescriptorLayoutCount];
+		break;
+	}
+	SDL_AtomicUnlock(&Registry.Lock);
+	if (destroy) { vkDestroyDescriptorSetLayout(Graphics.Device, layout, NULL); }
+}
+
+static void CreateDescriptorPool(Pipeline pipeline)
+{
+	int uboCount = pipeline->Program->UniformCount;
+	int samplerCount = pipeline->Program->SamplerCount;
+	int storageCount = pipeline->Program->StorageCount;
 	if (pipeline->UsesDescriptors)
 	{
 		VkDescriptorPoolSize poolSizes[2];
@@ -240,65 +402,386 @@ static void CreateDescriptorSets(Pipeline pipeline)
 				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 				.descriptorPool = pipeline->DescriptorPool,
 				.descriptorSetCount = 1,
-				.pSetLayouts = &pipeline->DescriptorLayout,
+				.pSetLayouts = &pipeline->Program->DescriptorLayout,
 			};
 			vkAllocateDescriptorSets(Graphics.Device, &allocateInfo, pipeline->DescriptorSet + i);
 		}
+		pipeline->PendingWrites = malloc(Graphics.FrameResourceCount * pipeline->Program->DescriptorSlotCount * sizeof(int));
+		for (int i = 0; i < Graphics.FrameResourceCount * pipeline->Program->DescriptorSlotCount; i++) { pipeline->PendingWrites[i] = -1; }
+	}
+}
+
+/// Looks up a registered pipeline layout and takes a reference to it, the registry has to be locked
+/// \return Whether or not a layout with the key was registered
+static bool FindPipelineLayout(PipelineKey key, VkPipelineLayout * layout)
+{
+	for (int i = 0; i < Registry.LayoutCount; i++)
+	{
+		if (!KeyEqual(Registry.Layouts[i].Key, key)) { continue; }
+		Registry.Layouts[i].ReferenceCount++;
+		*layout = Registry.Layouts[i].Instance;
+		return true;
 	}
+	return false;
 }
 
-static void CreatePipelineLayout(Pipeline pipeline, VkPushConstantRange pushConstantRange)
+static void CreatePipelineLayout(PipelineProgram program)
 {
+	uint32_t layoutInfo[] =
+	{
+		program->UsesDescriptors,
+		program->UsesPushConstant,
+		program->PushConstantRange.stageFlags,
+		program->PushConstantRange.offset,
+		program->PushConstantRange.size,
+	};
+	PipelineKey key = { 0 };
+	KeyAppend(&key, layoutInfo, sizeof(layoutInfo));
+	// Descriptor set layouts are shared, so the handle identifies the bindings while a layout made with it is alive
+	if (program->UsesDescriptors) { KeyAppend(&key, &program->DescriptorLayout, sizeof(VkDescriptorSetLayout)); }
+	KeyFinish(&key);
+	
+	SDL_AtomicLock(&Registry.Lock);
+	bool found = FindPipelineLayout(key, &program->Layout);
+	SDL_AtomicUnlock(&Registry.Lock);
+	if (found)
+	{
+		free(key.Data);
+		return;
+	}
+	
+	// It's created outside of the lock like the descriptor set layout is
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-		.setLayoutCount = pipeline->UsesDescriptors ? 1 : 0,
-		.pSetLayouts = &pipeline->DescriptorLayout,
-		.pushConstantRangeCount = pipeline->UsesPushConstant ? 1 : 0,
-		.pPushConstantRanges = &pushConstantRange,
+		.setLayoutCount = program->UsesDescriptors ? 1 : 0,
+		.pSetLayouts = &program->DescriptorLayout,
+		.pushConstantRangeCount = program->UsesPushConstant ? 1 : 0,
+		.pPushConstantRanges = &program->PushConstantRange,
 	};
-	vkCreatePipelineLayout(Graphics.Device, &pipelineLayoutCreateInfo, NULL, &pipeline->Layout);
+	VkPipelineLayout layout;
+	vkCreatePipelineLayout(Graphics.Device, &pipelineLayoutCreateInfo, NULL, &layout);
+	SDL_AtomicLock(&Registry.Lock);
+	found = FindPipelineLayout(key, &program->Layout);
+	if (!found)
+	{
+		program->Layout = layout;
+		Registry.Layouts = realloc(Registry.Layouts, (Registry.LayoutCount + 1) * sizeof(struct RegisteredLayout));
+		Registry.Layouts[Registry.LayoutCount++] = (struct RegisteredLayout)
+		{
+			.Key = key,
+			.ReferenceCount = 1,
+			.Instance = layout,
+		};
+	}
+	SDL_AtomicUnlock(&Registry.Lock);
+	if (found)
+	{
+		vkDestroyPipelineLayout(Graphics.Device, layout, NULL);
+		free(key.Data);
+	}
+}
+
+static void ReleasePipelineLayout(VkPipelineLayout layout)
+{
+	SDL_AtomicLock(&Registry.Lock);
+	bool destroy = false;
+	for (int i = 0; i < Registry.LayoutCount; i++)
+	{
+		if (Registry.Layouts[i].Instance != layout || --Registry.Layouts[i].ReferenceCount > 0) { continue; }
+		destroy = true;
+		free(Registry.Layouts[i].Key.Data);
+		Registry.Layouts[i] = Registry.Layouts[--Registry.LayoutCount];
+		break;
+	}
+	SDL_AtomicUnlock(&Registry.Lock);
+	if (destroy) { vkDestroyPipelineLayout(Graphics.Device, layout, NULL); }
+}
+
+static PipelineProgram FindProgram(PipelineKey key)
+{
+	for (int i = 0; i < Registry.ProgramCount; i++)
+	{
+		if (KeyEqual(Registry.Programs[i]->Key, key)) { return Registry.Programs[i]; }
+	}
+	return NULL;
+}
+
+static void DestroyProgram(PipelineProgram program)
+{
+	for (int i = 0; i < program->StageCount; i++)
+	{
+		vkDestroyShaderModule(Graphics.Device, program->Modules[i], NULL);
+		spvReflectDestroyShaderModule(&program->Stages[i].Module);
+	}
+	free(program->Stages);
+	if (program->Base != VK_NULL_HANDLE) { vkDestroyPipeline(Graphics.Device, program->Base, NULL); }
+	ReleasePipelineLayout(program->Layout);
+	if (program->UsesDescriptors)
+	{
+		ReleaseDescriptorLayout(program->DescriptorLayout);
+		free(program->DescriptorSlotOffsets);
+	}
+	free(program->Key.Data);
+	free(program);
 }
 
-static void CreateLayout(Pipeline pipeline, PipelineConfigure config)
+static PipelineProgram CreateProgram(PipelineConfigure config)
 {
-	CreateReflectModules(pipeline, config);
-	VkPushConstantRange pushConstantRange = GetPushConstantRange(pipeline);
-	int samplerCount = 0, uboCount = 0, storageCount = 0;
-	CreateDescriptorLayout(pipeline, &uboCount, &samplerCount, &storageCount);
-	CreateDescriptorPool(pipeline, uboCount, samplerCount, storageCount);
-	CreatePipelineLayout(pipeline, pushConstantRange);
+	PipelineKey key = { 0 };
+	for (int i = 0; i < config.ShaderCount; i++)
+	{
+		KeyAppend(&key, &config.Shaders[i].Type, sizeof(ShaderType));
+		KeyAppend(&key, &config.Shaders[i].DataSize, sizeof(unsigned long));
+		KeyAppend(&key, config.Shaders[i].Data, config.Shaders[i].DataSize);
+	}
+	KeyFinish(&key);
+	SDL_AtomicLock(&Registry.Lock);
+	PipelineProgram program = FindProgram(key);
+	if (program != NULL) { program->ReferenceCount++; }
+	SDL_AtomicUnlock(&Registry.Lock);
+	if (program != NULL)
+	{
+		free(key.Data);
+		return program;
+	}
+	
+	// It's created outside of the lock since pipelines are created on several threads, if another thread registered the same program first this one is thrown away
+	program = malloc(sizeof(struct PipelineProgram));
+	*program = (struct PipelineProgram)
+	{
+		.ReferenceCount = 1,
+		.Key = key,
+		.Base = VK_NULL_HANDLE,
+	};
+	CreateReflectModules(program, config);
+	CreateShaderModules(program, config);
+	GetPushConstantRange(program);
+	CreateDescriptorLayout(program);
+	CreatePipelineLayout(program);
+	
+	SDL_AtomicLock(&Registry.Lock);
+	PipelineProgram registered = FindProgram(key);
+	if (registered != NULL) { registered->ReferenceCount++; }
+	else
+	{
+		Registry.Programs = realloc(Registry.Programs, (Registry.ProgramCount + 1) * sizeof(PipelineProgram));
+		Registry.Programs[Registry.ProgramCount++] = program;
+	}
+	SDL_AtomicUnlock(&Registry.Lock);
+	if (registered == NULL) { return program; }
+	DestroyProgram(program);
+	return registered;
+}
+
+static void RetainProgram(PipelineProgram program)
+{
+	SDL_AtomicLock(&Registry.Lock);
+	program->ReferenceCount++;
+	SDL_AtomicUnlock(&Registry.Lock);
+}
+
+static void UseProgram(Pipeline pipeline, PipelineProgram program)
+{
+	pipeline->Program = program;
+	pipeline->Layout = program->Layout;
+	pipeline->StageCount = program->StageCount;
+	pipeline->Stages = program->Stages;
+	pipeline->UsesDescriptors = program->UsesDescriptors;
+	pipeline->UsesPushConstant = program->UsesPushConstant;
+	pipeline->PushConstantSize = program->PushConstantRange.size;
+	// Every pipeline object has its own descriptors and push constants, so pipelines that share a compiled pipeline can be given different resources
+	if (pipeline->UsesPushConstant) { pipeline->PushConstantData = calloc(1, pipeline->PushConstantSize); }
+	CreateDescriptorPool(pipeline);
 	CreateDescriptorSets(pipeline);
 }
 
-Pipeline PipelineCreate(PipelineConfigure config)
+static void ReleaseProgram(PipelineProgram program)
+{
+	SDL_AtomicLock(&Registry.Lock);
+	bool destroy = --program->ReferenceCount == 0;
+	for (int i = 0; destroy && i < Registry.ProgramCount; i++)
+	{
+		if (Registry.Programs[i] == program) { Registry.Programs[i] = Registry.Programs[--Registry.ProgramCount]; }
+	}
+	SDL_AtomicUnlock(&Registry.Lock);
+	if (destroy) { DestroyProgram(program); }
+}
+
+static SDL_atomic_t NextPipelineId = { 0 };
+
+static void AppendState(PipelineKey * key, PipelineConfigure config)
+{
+	uint32_t state[] =
+	{
+		config.Primitive,
+		config.PolygonMode,
+		config.CullMode,
+		config.CullClockwise,
+		config.AlphaBlend,
+		config.DepthTest,
+		config.DepthWrite,
+		config.DepthCompare,
+		config.StencilTest,
+		config.FrontStencil.Compare,
+		config.FrontStencil.Pass,
+		config.FrontStencil.Fail,
+		config.FrontStencil.DepthFail,
+		config.BackStencil.Compare,
+		config.BackStencil.Pass,
+		config.BackStencil.Fail,
+		config.BackStencil.DepthFail,
+		config.SwapchainTarget,
+	};
+	KeyAppend(key, state, sizeof(state));
+	if (config.VertexLayout == NULL) { return; }
+	
+	// The layout is compared by its contents since separately created layouts can describe the same vertices
+	VertexLayout layout = config.VertexLayout;
+	KeyAppend(key, &layout->BindingCount, sizeof(unsigned int));
+	for (int i = 0; i < layout->BindingCount; i++)
+	{
+		uint32_t binding[] = { layout->Bindings[i].binding, layout->Bindings[i].stride, layout->Bindings[i].inputRate };
+		KeyAppend(key, binding, sizeof(binding));
+	}
+	KeyAppend(key, &layout->AttributeCount, sizeof(unsigned int));
+	for (int i = 0; i < layout->AttributeCount; i++)
+	{
+		uint32_t attribute[] = { layout->Attributes[i].location, layout->Attributes[i].binding, layout->Attributes[i].format, layout->Attributes[i].offset };
+		KeyAppend(key, attribute, sizeof(attribute));
+	}
+}
+
+static PipelineKey CreateKey(bool compute, PipelineConfigure config)
+{
+	// Sources are keyed before they're compiled so an identical pipeline can be found without compiling them
+	PipelineKey key = { 0 };
+	KeyAppend(&key, &compute, sizeof(bool));
+	for (int i = 0; i < config.ShaderCount; i++)
+	{
+		ShaderData shader = config.Shaders[i];
+		uint32_t info[] = { shader.Type, shader.Source };
+		KeyAppend(&key, info, sizeof(info));
+		KeyAppend(&key, &shader.DataSize, sizeof(unsigned long));
+		KeyAppend(&key, shader.Data, shader.DataSize);
+		if (shader.Source) { KeyAppend(&key, shader.Name, strlen(shader.Name) + 1); }
+	}
+	AppendState(&key, config);
+	KeyFinish(&key);
+	return key;
+}
+
+static Pipeline AllocatePipeline(bool compute, PipelineConfigure config, Pipeline fallback)
 {
 	Pipeline pipeline = malloc(sizeof(struct Pipeline));
 	*pipeline = (struct Pipeline)
 	{
-		.IsCompute = false,
+		.IsCompute = compute,
+		.Id = (unsigned int)SDL_AtomicAdd(&NextPipelineId, 1),
+		.Fallback = fallback,
 		.VertexLayout = config.VertexLayout,
 		.FrontStencilReference = config.FrontStencil.Reference,
 		.BackStencilReference = config.BackStencil.Reference,
 	};
-	
-	VkPipelineShaderStageCreateInfo shaderInfos[5];
-	VkShaderModule modules[5];
-	for (int i = 0; i < config.ShaderCount; i++)
+	SDL_AtomicSet(&pipeline->Ready, 0);
+	return pipeline;
+}
+
+static void MarkReady(Pipeline pipeline)
+{
+	// Everything written while creating the pipeline has to be visible to the thread that sees it ready
+	SDL_MemoryBarrierRelease();
+	// Pipelines created on the calling thread can be waited on too, so the waiters are woken here instead of by a finished job
+	WorkerSignal(&pipeline->Ready);
+}
+
+static void FinishPipeline(Pipeline pipeline)
+{
+	UseProgram(pipeline, pipeline->Shared->Program);
+	pipeline->Instance = pipeline->Shared->Instance;
+	MarkReady(pipeline);
+}
+
+static bool SharePipeline(Pipeline pipeline, PipelineKey key)
+{
+	// Pipeline objects that share a compiled pipeline before it's created are finished by the thread that creates it
+	SDL_AtomicLock(&Registry.Lock);
+	for (int i = 0; i < Registry.SharedCount; i++)
 	{
-		VkShaderModuleCreateInfo moduleInfo =
+		SharedPipeline shared = Registry.Shared[i];
+		if (!KeyEqual(shared->Key, key)) { continue; }
+		shared->ReferenceCount++;
+		pipeline->Shared = shared;
+		bool ready = shared->Ready;
+		if (!ready)
 		{
-			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-			.codeSize = config.Shaders[i].DataSize,
-			.pCode = config.Shaders[i].Data,
-		};
-		vkCreateShaderModule(Graphics.Device, &moduleInfo, NULL, modules + i);
-		
+			shared->Pending = realloc(shared->Pending, (shared->PendingCount + 1) * sizeof(Pipeline));
+			shared->Pending[shared->PendingCount++] = pipeline;
+		}
+		SDL_AtomicUnlock(&Registry.Lock);
+		free(key.Data);
+		if (ready) { FinishPipeline(pipeline); }
+		return false;
+	}
+	SharedPipeline shared = malloc(sizeof(struct SharedPipeline));
+	*shared = (struct SharedPipeline)
+	{
+		.ReferenceCount = 1,
+		.Key = key,
+		.Ready = false,
+		.PendingCount = 1,
+		.Pending = malloc(sizeof(Pipeline)),
+	};
+	shared->Pending[0] = pipeline;
+	pipeline->Shared = shared;
+	Registry.Shared = realloc(Registry.Shared, (Registry.SharedCount + 1) * sizeof(SharedPipeline));
+	Registry.Shared[Registry.SharedCount++] = shared;
+	SDL_AtomicUnlock(&Registry.Lock);
+	return true;
+}
+
+static void PublishShared(SharedPipeline shared)
+{
+	SDL_AtomicLock(&Registry.Lock);
+	shared->Ready = true;
+	int pendingCount = shared->PendingCount;
+	Pipeline * pending = shared->Pending;
+	shared->PendingCount = 0;
+	shared->Pending = NULL;
+	SDL_AtomicUnlock(&Registry.Lock);
+	for (int i = 0; i < pendingCount; i++) { FinishPipeline(pending[i]); }
+	free(pending);
+}
+
+static void ReleaseShared(SharedPipeline shared)
+{
+	SDL_AtomicLock(&Registry.Lock);
+	bool destroy = --shared->ReferenceCount == 0;
+	for (int i = 0; destroy && i < Registry.SharedCount; i++)
+	{
+		if (Registry.Shared[i] == shared) { Registry.Shared[i] = Registry.Shared[--Registry.SharedCount]; }
+	}
+	// The base pipeline can be in use by a variant being created on another thread, so it's destroyed with the program instead
+	bool base = shared->Program->Base == shared->Instance;
+	SDL_AtomicUnlock(&Registry.Lock);
+	if (!destroy) { return; }
+	if (!base) { vkDestroyPipeline(Graphics.Device, shared->Instance, NULL); }
+	ReleaseProgram(shared->Program);
+	free(shared->Key.Data);
+	free(shared);
+}
+
+static void CreateGraphicsInstance(SharedPipeline shared, PipelineConfigure config)
+{
+	PipelineProgram program = shared->Program;
+	VkPipelineShaderStageCreateInfo shaderInfos[5];
+	for (int i = 0; i < program->StageCount; i++)
+	{
 		shaderInfos[i] = (VkPipelineShaderStageCreateInfo)
 		{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage = (VkShaderStageFlagBits)config.Shaders[i].Type,
-			.module = modules[i],
+			.stage = (VkShaderStageFlagBits)program->Stages[i].ShaderType,
+			.module = program->Modules[i],
 			.pName = "main",
 		};
 	}
@@ -306,8 +789,8 @@ Pipeline PipelineCreate(PipelineConfigure config)
 	VkPipelineVertexInputStateCreateInfo vertexInput =
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-		.vertexBindingDescriptionCount = 1,
-		.pVertexBindingDescriptions = &config.VertexLayout->Binding,
+		.vertexBindingDescriptionCount = config.VertexLayout->BindingCount,
+		.pVertexBindingDescriptions = config.VertexLayout->Bindings,
 		.vertexAttributeDescriptionCount = config.VertexLayout->AttributeCount,
 		.pVertexAttributeDescriptions = config.VertexLayout->Attributes,
 	};
@@ -334,7 +817,7 @@ Pipeline PipelineCreate(PipelineConfigure config)
 		.offset = { 0, 0 },
 		.extent = Graphics.Swapchain.Extent,
 	};
-
+	
 	VkPipelineViewportStateCreateInfo viewportState =
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
@@ -426,11 +909,15 @@ Pipeline PipelineCreate(PipelineConfigure config)
 		.pDynamicStates = dynamicStates,
 	};
 	
-	CreateLayout(pipeline, config);
+	// Only the program's first pipeline allows derivatives, the flag can make drivers compile less optimized code so later pipelines don't set it
+	SDL_AtomicLock(&Registry.Lock);
+	VkPipeline base = program->Base;
+	SDL_AtomicUnlock(&Registry.Lock);
 	VkGraphicsPipelineCreateInfo pipelineCreateInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-		.stageCount = config.ShaderCount,
+		.flags = base == VK_NULL_HANDLE ? VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT : VK_PIPELINE_CREATE_DERIVATIVE_BIT,
+		.stageCount = program->StageCount,
 		.pStages = shaderInfos,
 		.pVertexInputState = &vertexInput,
 		.pInputAssemblyState = &inputAssembly,
@@ -440,33 +927,138 @@ Pipeline PipelineCreate(PipelineConfigure config)
 		.pDepthStencilState = &depthStencilState,
 		.pColorBlendState = &colorBlendState,
 		.pDynamicState = &dynamicState,
-		.layout = pipeline->Layout,
-		.renderPass = Graphics.RenderPass,
+		.layout = program->Layout,
+		.renderPass = config.SwapchainTarget ? Graphics.SwapchainRenderPass : Graphics.RenderPass,
 		.subpass = 0,
-		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineHandle = base,
 		.basePipelineIndex = -1,
 	};
-	VkResult result = vkCreateGraphicsPipelines(Graphics.Device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL, &pipeline->Instance);
+	VkResult result = vkCreateGraphicsPipelines(Graphics.Device, Graphics.PipelineCache, 1, &pipelineCreateInfo, NULL, &shared->Instance);
 	if (result != VK_SUCCESS)
 	{
 		log_fatal("Unable to create graphics pipeline: %i\n", result);
 		exit(1);
 	}
-	
-	for (int i = 0; i < config.ShaderCount; i++)
+	SDL_AtomicLock(&Registry.Lock);
+	if (program->Base == VK_NULL_HANDLE) { program->Base = shared->Instance; }
+	SDL_AtomicUnlock(&Registry.Lock);
+}
+
+static void BuildShared(SharedPipeline shared, PipelineConfigure original)
+{
+	PipelineConfigure config = original;
+	CompileSources(&config);
+	shared->Program = CreateProgram(config);
+	FreeCompiledSources(original, config);
+	CreateGraphicsInstance(shared, config);
+	PublishShared(shared);
+}
+
+Pipeline PipelineCreate(PipelineConfigure config)
+{
+	Pipeline pipeline = AllocatePipeline(false, config, NULL);
+	if (SharePipeline(pipeline, CreateKey(false, config))) { BuildShared(pipeline->Shared, config); }
+	PipelineWait(pipeline);
+	return pipeline;
+}
+
+Pipeline PipelineCreateVariant(Pipeline pipeline, PipelineConfigure config)
+{
+	if (pipeline == NULL || pipeline->IsCompute)
+	{
+		log_fatal("Trying to create a variant of an uninitialized or compute Pipeline object.\n");
+		exit(1);
+	}
+	PipelineWait(pipeline);
+	if (config.VertexLayout == NULL) { config.VertexLayout = pipeline->VertexLayout; }
+	// The shared pipeline keeps the program alive, so the program identifies its shaders while the key is registered
+	PipelineKey key = { 0 };
+	KeyAppend(&key, "Variant", strlen("Variant"));
+	KeyAppend(&key, &pipeline->Program, sizeof(PipelineProgram));
+	AppendState(&key, config);
+	KeyFinish(&key);
+	Pipeline variant = AllocatePipeline(false, config, NULL);
+	if (SharePipeline(variant, key))
+	{
+		RetainProgram(pipeline->Program);
+		variant->Shared->Program = pipeline->Program;
+		CreateGraphicsInstance(variant->Shared, config);
+		PublishShared(variant->Shared);
+	}
+	PipelineWait(variant);
+	return variant;
+}
+
+struct PipelineJob
+{
+	SharedPipeline Shared;
+	PipelineConfigure Config;
+};
+
+static void RunPipelineJob(struct PipelineJob * job)
+{
+	BuildShared(job->Shared, job->Config);
+	free(job);
+}
+
+Pipeline PipelineCreateAsync(PipelineConfigure config, Pipeline fallback)
+{
+	if (fallback != NULL && fallback->IsCompute)
 	{
-		vkDestroyShaderModule(Graphics.Device, modules[i], NULL);
+		log_fatal("Trying to create a pipeline with a compute pipeline as its fallback.\n");
+		exit(1);
 	}
+	Pipeline pipeline = AllocatePipeline(false, config, fallback);
+	if (!SharePipeline(pipeline, CreateKey(false, config))) { return pipeline; }
+	struct PipelineJob * job = malloc(sizeof(struct PipelineJob));
+	*job = (struct PipelineJob){ .Shared = pipeline->Shared, .Config = config };
+	WorkerSubmit((WorkerFunction)RunPipelineJob, job);
 	return pipeline;
 }
 
+void PipelineCreateBatch(int count, PipelineConfigure * configs, Pipeline * pipelines)
+{
+	for (int i = 0; i < count; i++) { pipelines[i] = PipelineCreateAsync(configs[i], NULL); }
+	for (int i = 0; i < count; i++) { PipelineWait(pipelines[i]); }
+}
+
+bool PipelineReady(Pipeline pipeline)
+{
+	if (SDL_AtomicGet(&pipeline->Ready) == 0) { return false; }
+	SDL_MemoryBarrierAcquire();
+	return true;
+}
+
+void PipelineWait(Pipeline pipeline)
+{
+	if (PipelineReady(pipeline)) { return; }
+	WorkerWait(&pipeline->Ready);
+	SDL_MemoryBarrierAcquire();
+}
+
+Pipeline PipelineResolve(Pipeline pipeline)
+{
+	while (pipeline != NULL && !PipelineReady(pipeline)) { pipeline = pipeline->Fallback; }
+	return pipeline;
+}
+
+static void ValidateReady(Pipeline pipeline)
+{
+	if (!PipelineReady(pipeline))
+	{
+		log_fatal("Trying to modify a Pipeline object that isn't ready yet, check PipelineReady or call PipelineWait first.\n");
+		exit(1);
+	}
+}
+
 void PipelineSetPushConstant(Pipeline pipeline, const char * variable, void * value)
 {
+	ValidateReady(pipeline);
 	if (pipeline->UsesPushConstant)
 	{
-		for (int i = 0; i < pipeline->PushConstantInfo.member_count; i++)
+		for (int i = 0; i < pipeline->Program->PushConstantInfo.member_count; i++)
 		{
-			SpvReflectBlockVariable member = pipeline->PushConstantInfo.members[i];
+			SpvReflectBlockVariable member = pipeline->Program->PushConstantInfo.members[i];
 			if (strcmp(member.name, variable) == 0)
 			{
 				memcpy((unsigned char *)pipeline->PushConstantData + member.offset, value, member.size);
@@ -475,93 +1067,95 @@ void PipelineSetPushConstant(Pipeline pipeline, const char * variable, void * va
 	}
 }
 
-void PipelineSetUniform(Pipeline pipeline, int binding, int arrayIndex, struct UniformBuffer * uniform)
+static void QueueDescriptorWrite(Pipeline pipeline, int binding, int arrayIndex, VkDescriptorType type, union GraphicsDescriptorInfo info)
 {
-	if (pipeline->UsesDescriptors)
+	PipelineProgram program = pipeline->Program;
+	int slot = -1;
+	if (binding >= 0 && arrayIndex >= 0 && binding < program->DescriptorBindingCount && program->DescriptorSlotOffsets[binding] != -1) { slot = program->DescriptorSlotOffsets[binding] + arrayIndex; }
+	if (slot >= program->DescriptorSlotCount) { slot = -1; }
+	for (int i = 0; i < Graphics.FrameResourceCount; i++)
 	{
-		for (int i = 0; i < Graphics.FrameResourceCount; i++)
+		struct GraphicsFrameResource * frame = Graphics.FrameResources + i;
+		// A newer write to the same descriptor replaces the pending one, so each descriptor is written at most once per frame.
+		// The slot's index is only trusted if it still refers to this descriptor, since flushing or destroying a pipeline moves the writes
+		int * pending = slot == -1 ? NULL : pipeline->PendingWrites + i * program->DescriptorSlotCount + slot;
+		int index = frame->DescriptorWriteCount;
+		if (pending != NULL && *pending != -1 && *pending < frame->DescriptorWriteCount)
 		{
-			VkDescriptorBufferInfo * bufferInfo = malloc(sizeof(VkDescriptorBufferInfo));
-			*bufferInfo = (VkDescriptorBufferInfo)
-			{
-				.buffer = uniform->Buffer,
-				.offset = 0,
-				.range = uniform->Size,
-			};
-			
-			VkWriteDescriptorSet * writeInfo = malloc(sizeof(VkWriteDescriptorSet));
-			*writeInfo = (VkWriteDescriptorSet)
+			VkWriteDescriptorSet write = frame->DescriptorWrites[*pending];
+			if (write.dstSet == pipeline->DescriptorSet[i] && write.dstBinding == binding && write.dstArrayElement == arrayIndex) { index = *pending; }
+		}
+		if (index == frame->DescriptorWriteCount)
+		{
+			if (frame->DescriptorWriteCount == frame->DescriptorWriteCapacity)
 			{
-				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				.dstArrayElement = arrayIndex,
-				.dstBinding = binding,
-				.dstSet = pipeline->DescriptorSet[i],
-				.pBufferInfo = bufferInfo,
-			};
-			ListPush(Graphics.FrameResources[i].Queues[GraphicsQueueUploadDescriptor], writeInfo);
+				frame->DescriptorWriteCapacity = frame->DescriptorWriteCapacity == 0 ? 64 : 2 * frame->DescriptorWriteCapacity;
+				frame->DescriptorWrites = realloc(frame->DescriptorWrites, frame->DescriptorWriteCapacity * sizeof(VkWriteDescriptorSet));
+				frame->DescriptorInfos = realloc(frame->DescriptorInfos, frame->DescriptorWriteCapacity * sizeof(union GraphicsDescriptorInfo));
+			}
+			frame->DescriptorWriteCount++;
+			if (pending != NULL) { *pending = index; }
 		}
+		// The info pointers are set when the writes are flushed, since the arrays can move when they grow
+		frame->DescriptorWrites[index] = (VkWriteDescriptorSet)
+		{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.descriptorCount = 1,
+			.descriptorType = type,
+			.dstArrayElement = arrayIndex,
+			.dstBinding = binding,
+			.dstSet = pipeline->DescriptorSet[i],
+		};
+		frame->DescriptorInfos[index] = info;
 	}
 }
 
+void PipelineSetUniform(Pipeline pipeline, int binding, int arrayIndex, struct UniformBuffer * uniform)
+{
+	ValidateReady(pipeline);
+	if (!pipeline->UsesDescriptors) { return; }
+	union GraphicsDescriptorInfo info =
+	{
+		.Buffer =
+		{
+			.buffer = uniform->Buffer,
+			.offset = 0,
+			.range = uniform->Size,
+		},
+	};
+	QueueDescriptorWrite(pipeline, binding, arrayIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, info);
+}
+
 void PipelineSetSampler(Pipeline pipeline, int binding, int arrayIndex, Texture texture)
 {
-	if (pipeline->UsesDescriptors)
+	ValidateReady(pipeline);
+	if (!pipeline->UsesDescriptors) { return; }
+	union GraphicsDescriptorInfo info =
 	{
-		for (int i = 0; i < Graphics.FrameResourceCount; i++)
+		.Image =
 		{
-			VkDescriptorImageInfo * imageInfo = malloc(sizeof(VkDescriptorImageInfo));
-			*imageInfo = (VkDescriptorImageInfo)
-			{
-				.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
-				.sampler = texture->Sampler,
-				.imageView = texture->ImageView,
-			};
-			VkWriteDescriptorSet * writeInfo = malloc(sizeof(VkWriteDescriptorSet));
-			*writeInfo = (VkWriteDescriptorSet)
-			{
-				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.dstArrayElement = arrayIndex,
-				.dstBinding = binding,
-				.dstSet = pipeline->DescriptorSet[i],
-				.pImageInfo = imageInfo,
-			};
-			ListPush(Graphics.FrameResources[i].Queues[GraphicsQueueUploadDescriptor], writeInfo);
-		}
-	}
+			.imageLayout = TextureShaderLayout(texture->Format),
+			.sampler = texture->Sampler,
+			.imageView = texture->ImageView,
+		},
+	};
+	QueueDescriptorWrite(pipeline, binding, arrayIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, info);
 }
 
 void PipelineSetStorageBuffer(Pipeline pipeline, int binding, int arrayIndex, StorageBuffer storage)
 {
-	if (pipeline->UsesDescriptors)
+	ValidateReady(pipeline);
+	if (!pipeline->UsesDescriptors) { return; }
+	union GraphicsDescriptorInfo info =
 	{
-		for (int i = 0; i < Graphics.FrameResourceCount; i++)
+		.Buffer =
 		{
-			VkDescriptorBufferInfo * bufferInfo = malloc(sizeof(VkDescriptorBufferInfo));
-			*bufferInfo = (VkDescriptorBufferInfo)
-			{
-				.buffer = storage->Buffer,
-				.offset = 0,
-				.range = storage->Size,
-			};
-			
-			VkWriteDescriptorSet * writeInfo = malloc(sizeof(VkWriteDescriptorSet));
-			*writeInfo = (VkWriteDescriptorSet)
-			{
-				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				.dstArrayElement = arrayIndex,
-				.dstBinding = binding,
-				.dstSet = pipeline->DescriptorSet[i],
-				.pBufferInfo = bufferInfo,
-			};
-			ListPush(Graphics.FrameResources[i].Queues[GraphicsQueueUploadDescriptor], writeInfo);
-		}
-	}
+			.buffer = storage->Buffer,
+			.offset = 0,
+			.range = storage->Size,
+		},
+	};
+	QueueDescriptorWrite(pipeline, binding, arrayIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, info);
 }
 
 void PipelineSetFrontStencilReference(Pipeline pipeline, unsigned int reference)
@@ -575,52 +1169,62 @@ void PipelineSetBackStencilReference(Pipeline pipeline, unsigned int reference)
 
 void PipelineQueueDestroy(Pipeline pipeline)
 {
-	ListPush(Graphics.FrameResources[Graphics.FrameIndex].Queues[GraphicsQueueDestroyPipeline], pipeline);
+	TimelineRetire(pipeline, (TimelineDestroyFunction)PipelineDestroy);
 }
 
 void PipelineDestroy(Pipeline pipeline)
 {
+	PipelineWait(pipeline);
 	vkDeviceWaitIdle(Graphics.Device);
-	vkDestroyPipelineLayout(Graphics.Device, pipeline->Layout, NULL);
 	if (pipeline->UsesDescriptors)
 	{
+		// Writes that haven't been flushed yet would target the freed descriptor sets
+		for (int i = 0; i < Graphics.FrameResourceCount; i++)
+		{
+			struct GraphicsFrameResource * frame = Graphics.FrameResources + i;
+			int count = 0;
+			for (int j = 0; j < frame->DescriptorWriteCount; j++)
+			{
+				if (frame->DescriptorWrites[j].dstSet == pipeline->DescriptorSet[i]) { continue; }
+				frame->DescriptorWrites[count] = frame->DescriptorWrites[j];
+				frame->DescriptorInfos[count] = frame->DescriptorInfos[j];
+				count++;
+			}
+			frame->DescriptorWriteCount = count;
+		}
 		free(pipeline->DescriptorSet);
-		vkDestroyDescriptorSetLayout(Graphics.Device, pipeline->DescriptorLayout, NULL);
+		free(pipeline->PendingWrites);
 		vkDestroyDescriptorPool(Graphics.Device, pipeline->DescriptorPool, NULL);
 	}
 	if (pipeline->UsesPushConstant) { free(pipeline->PushConstantData); }
-	for (int i = 0; i < pipeline->StageCount; i++) { spvReflectDestroyShaderModule(&pipeline->Stages[i].Module); }
-	free(pipeline->Stages);
-	vkDestroyPipeline(Graphics.Device, pipeline->Instance, NULL);
+	ReleaseShared(pipeline->Shared);
 	free(pipeline);
 }
 
 ComputePipeline ComputePipelineCreate(ShaderData shader)
 {
-	ComputePipeline pipeline = malloc(sizeof(struct Pipeline));
-	*pipeline = (struct Pipeline){ .IsCompute = true, };
-	
-	PipelineConfigure config =
+	PipelineConfigure original =
 	{
 		.ShaderCount = 1,
 		.Shaders = { shader },
 	};
-	CreateLayout(pipeline, config);
-	
-	VkShaderModule module;
-	VkShaderModuleCreateInfo moduleInfo =
+	ComputePipeline pipeline = AllocatePipeline(true, original, NULL);
+	if (!SharePipeline(pipeline, CreateKey(true, original)))
 	{
-		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		.codeSize = config.Shaders[0].DataSize,
-		.pCode = config.Shaders[0].Data,
-	};
-	vkCreateShaderModule(Graphics.Device, &moduleInfo, NULL, &module);
+		PipelineWait(pipeline);
+		return pipeline;
+	}
+	SharedPipeline shared = pipeline->Shared;
+	PipelineConfigure config = original;
+	CompileSources(&config);
+	shared->Program = CreateProgram(config);
+	FreeCompiledSources(original, config);
 	
 	VkPipelineShaderStageCreateInfo stageInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
-		.module = module,
+		.module = shared->Program->Modules[0],
 		.pName = "main",
 	};
 	
@@ -630,10 +1234,10 @@ ComputePipeline ComputePipelineCreate(ShaderData shader)
 		.basePipelineHandle = VK_NULL_HANDLE,
 		.basePipelineIndex = 0,
 		.stage = stageInfo,
-		.layout = pipeline->Layout,
+		.layout = shared->Program->Layout,
 	};
-	vkCreateComputePipelines(Graphics.Device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline->Instance);
-	vkDestroyShaderModule(Graphics.Device, module, NULL);
+	vkCreateComputePipelines(Graphics.Device, Graphics.PipelineCache, 1, &pipelineInfo, NULL, &shared->Instance);
+	PublishShared(shared);
 	
 	return pipeline;
 }
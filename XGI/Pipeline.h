@@ -4,6 +4,7 @@
 #include <vulkan/vulkan.h>
 #include <stdbool.h>
 #include <spirv/spirv_reflect.h>
+#include <SDL2/SDL_atomic.h>
 #include "VertexBuffer.h"
 #include "UniformBuffer.h"
 #include "StorageBuffer.h"
@@ -103,10 +104,14 @@ typedef struct ShaderData
 	ShaderType Type;
 	unsigned long DataSize;
 	void * Data;
+	/// Whether or not the data is GLSL that is compiled when the pipeline is created
+	bool Source;
+	/// The name of the source, used to resolve its includes
+	const char * Name;
 } ShaderData;
 
 /// Loads a shader from memory.
-/// GLSL strings are accepted just set precompiled to false
+/// GLSL strings are accepted just set precompiled to false, they're compiled through the shader cache so unchanged shaders aren't recompiled
 /// \param type The type of shader
 /// \param dataSize The size of the data to load
 /// \param data The data to load
@@ -121,6 +126,19 @@ ShaderData ShaderDataFromMemory(ShaderType type, unsigned long dataSize, void *
 /// \return The shader data required for the pipeline configuration
 ShaderData ShaderDataFromFile(ShaderType type, const char * file, bool precompiled);
 
+/// Loads GLSL from memory without compiling it, it's compiled when the pipeline is created so it can be compiled on a worker thread.
+/// \param type The type of shader
+/// \param dataSize The size of the GLSL
+/// \param data The GLSL, it must stay valid until the pipeline is ready
+/// \return The shader data required for the pipeline configuration
+ShaderData ShaderDataSourceFromMemory(ShaderType type, unsigned long dataSize, const char * data);
+
+/// Loads GLSL from a file without compiling it, it's compiled when the pipeline is created so it can be compiled on a worker thread.
+/// \param type The type of shader
+/// \param file The file to load, the path must stay valid until the pipeline is ready
+/// \return The shader data required for the pipeline configuration
+ShaderData ShaderDataSourceFromFile(ShaderType type, const char * file);
+
 typedef struct PipelineConfigure
 {
 	/// The vertex layout that the pipeline uses.
@@ -153,17 +171,25 @@ typedef struct PipelineConfigure
 	StencilConfigure FrontStencil;
 	/// The stencil test for back facing triangles
 	StencilConfigure BackStencil;
+	/// Whether or not the pipeline renders into the swapchain framebuffer from GraphicsSwapchainFrameBuffer instead of framebuffers that were created
+	bool SwapchainTarget;
 } PipelineConfigure;
 
-typedef struct Pipeline
+typedef struct PipelineKey
 {
-	bool IsCompute;
-	VkPipeline Instance;
-	VkPipelineLayout Layout;
-	VertexLayout VertexLayout;
-	unsigned int FrontStencilReference;
-	unsigned int BackStencilReference;
-	
+	/// The hash of the data, it's checked before the data is compared
+	uint64_t Hash;
+	unsigned long Size;
+	/// Everything the shared object is created from, compared in full so a hash collision can't share the wrong object
+	unsigned char * Data;
+} PipelineKey;
+
+typedef struct PipelineProgram
+{
+	/// The number of pipelines that use the program, it's destroyed with the last one
+	int ReferenceCount;
+	/// The shader types and SPIR-V, programs with the same key are shared
+	PipelineKey Key;
 	int StageCount;
 	struct PipelineStage
 	{
@@ -172,21 +198,116 @@ typedef struct Pipeline
 		int BindingCount;
 		SpvReflectDescriptorSet DescriptorInfo;
 	} * Stages;
+	VkShaderModule Modules[5];
 	bool UsesDescriptors;
+	int UniformCount;
+	int SamplerCount;
+	int StorageCount;
+	/// The number of binding numbers up to the highest one that's used
+	int DescriptorBindingCount;
+	/// The first descriptor slot of each binding number, or -1 if it isn't used, every array element of a binding has its own slot
+	int * DescriptorSlotOffsets;
+	int DescriptorSlotCount;
+	/// The descriptor set layout, shared with every program that has the same bindings
 	VkDescriptorSetLayout DescriptorLayout;
+	bool UsesPushConstant;
+	SpvReflectBlockVariable PushConstantInfo;
+	VkPushConstantRange PushConstantRange;
+	/// The pipeline layout, shared with every program that has the same descriptor set layout and push constant range
+	VkPipelineLayout Layout;
+	/// The first pipeline created from the program, it's the only one that allows derivatives and later pipelines are marked as derived from it.
+	/// The program keeps it alive until it's destroyed
+	VkPipeline Base;
+} * PipelineProgram;
+
+typedef struct SharedPipeline
+{
+	/// The number of pipeline objects that use it, it's destroyed with the last one
+	int ReferenceCount;
+	/// The shaders and fixed function state, identical pipeline objects share it
+	PipelineKey Key;
+	/// Whether or not the pipeline has been created, pipeline objects that share it before then wait in Pending
+	bool Ready;
+	int PendingCount;
+	struct Pipeline ** Pending;
+	PipelineProgram Program;
+	VkPipeline Instance;
+} * SharedPipeline;
+
+typedef struct Pipeline
+{
+	bool IsCompute;
+	unsigned int Id;
+	/// The compiled pipeline, shaders and layouts, shared with every identical pipeline object
+	SharedPipeline Shared;
+	/// Whether or not the pipeline has finished being created, it's only written by the thread creating it
+	SDL_atomic_t Ready;
+	/// The pipeline that's drawn with while this one isn't ready, or NULL to skip the draws
+	struct Pipeline * Fallback;
+	VkPipeline Instance;
+	/// The shaders and layouts, shared with every variant of the pipeline
+	PipelineProgram Program;
+	VkPipelineLayout Layout;
+	VertexLayout VertexLayout;
+	unsigned int FrontStencilReference;
+	unsigned int BackStencilReference;
+	
+	int StageCount;
+	struct PipelineStage * Stages;
+	bool UsesDescriptors;
 	VkDescriptorPool DescriptorPool;
 	VkDescriptorSet * DescriptorSet;
+	/// The index of the pending write to each descriptor slot in every frame's descriptor writes, it's stale once the writes are flushed
+	int * PendingWrites;
 	bool UsesPushConstant;
-	SpvReflectBlockVariable PushConstantInfo;
 	void * PushConstantData;
 	unsigned int PushConstantSize;
 } * Pipeline;
 
-/// Creates a pipeline from a pipeline configuration
+/// Creates a pipeline from a pipeline configuration.
+/// If an identical pipeline is alive, with the same shaders and fixed function state, its compiled pipeline, shaders and layouts are shared instead of created again.
+/// Every pipeline object still has its own push constants, uniforms, samplers, storage buffers and stencil references.
 /// \param config The pipeline configuration to use
 /// \return The pipeline object
 Pipeline PipelineCreate(PipelineConfigure config);
 
+/// Creates a pipeline on a worker thread, the shaders, layouts and pipeline are all created off of the calling thread.
+/// Until it's ready, binding it draws with the fallback instead, or skips the draws if there is no fallback.
+/// Its push constants, uniforms, samplers and storage buffers can only be set once it's ready.
+/// \param config The pipeline configuration to use, the shader data and vertex layout must stay valid until the pipeline is ready
+/// \param fallback The pipeline to draw with until this one is ready, it can be NULL
+/// \return The pipeline object, it might not be ready yet
+Pipeline PipelineCreateAsync(PipelineConfigure config, Pipeline fallback);
+
+/// Creates many pipelines at once across every worker thread, and waits for all of them to be ready.
+/// \param count The number of pipelines to create
+/// \param configs The configurations to create from
+/// \param pipelines The array that the created pipelines are written to
+void PipelineCreateBatch(int count, PipelineConfigure * configs, Pipeline * pipelines);
+
+/// Creates a variant of a pipeline that uses the same shaders with different fixed function state.
+/// The variant reuses the pipeline's shader modules, reflection and layouts instead of creating them again.
+/// It's still compiled as a whole pipeline, marked as a derivative of the first pipeline created from the same shaders.
+/// It has its own push constants, uniforms, samplers and storage buffers.
+/// \param pipeline The pipeline to create a variant of, it's waited on if it isn't ready
+/// \param config The pipeline configuration to use, the shaders are ignored and a NULL vertex layout uses the pipeline's
+/// \return The variant pipeline object, it can be destroyed independently of the pipeline
+Pipeline PipelineCreateVariant(Pipeline pipeline, PipelineConfigure config);
+
+/// Checks if a pipeline has finished being created without waiting.
+/// \param pipeline The pipeline to check
+/// \return Whether or not the pipeline is ready
+bool PipelineReady(Pipeline pipeline);
+
+/// Waits until a pipeline has finished being created.
+/// \param pipeline The pipeline to wait on
+void PipelineWait(Pipeline pipeline);
+
+/// Gets the pipeline that's drawn with when a pipeline is bound, the pipeline itself if it's ready otherwise the first ready fallback.
+/// \param pipeline The pipeline that's bound
+/// \return The pipeline to draw with, or NULL if none of them are ready
+Pipeline PipelineResolve(Pipeline pipeline);
+
 /// Sets a push constant value in the pipeline shaders
 /// \param pipeline The pipeline to set push constants
 /// \param variableName The name of the member in the push_constant struct
@@ -234,7 +355,7 @@ void PipelineSetBackStencilReference(Pipeline pipeline, unsigned int reference);
 /// \param pipeline The pipeline to destroy
 void PipelineQueueDestroy(Pipeline pipeline);
 
-/// Destroys a pipeline object.
+/// Destroys a pipeline object, the compiled pipeline it shares is destroyed with the last pipeline object that uses it.
 /// Don't call this unless it's at the initialize or the deinitialize of the application, otherwise use PipelineQueueDestroy
 /// \param pipeline The pipeline to destroy
 void PipelineDestroy(Pipeline pipeline);
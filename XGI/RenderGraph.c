@@ -0,0 +1,471 @@
+#include <stdlib.h>
+#include <string.h>
+#include "RenderGraph.h"
+#include "Graphics.h"
+#include "Timeline.h"
+#include "log.h"
+
+#define RenderGraphWriteAccess (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT)
+
+/// What a render target is accessed with, the render pass loads and stores both attachments
+#define RenderGraphTargetStages (VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT)
+#define RenderGraphTargetAccess (VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+
+/// What outputs are accessed with after the graph, like GraphicsCopyToSwapchain or later rendering
+#define RenderGraphFrameBufferOutputStages (VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+#define RenderGraphFrameBufferOutputAccess (VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT)
+#define RenderGraphStorageBufferOutputStages (VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+#define RenderGraphStorageBufferOutputAccess (VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT)
+
+static void ValidateNotCompiled(RenderGraph graph)
+{
+	if (graph->Compiled)
+	{
+		log_fatal("Trying to modify a RenderGraph, but it has already been compiled.\n");
+		exit(1);
+	}
+}
+
+static int FindResource(RenderGraph graph, RenderGraphResourceType type, void * object)
+{
+	if (object == NULL)
+	{
+		log_fatal("Trying to use an uninitialized resource in a RenderGraph.\n");
+		exit(1);
+	}
+	for (int i = 0; i < graph->ResourceCount; i++)
+	{
+		if (graph->Resources[i].Object == object) { return i; }
+	}
+	if (graph->ResourceCount == graph->ResourceCapacity)
+	{
+		graph->ResourceCapacity = graph->ResourceCapacity == 0 ? 8 : 2 * graph->ResourceCapacity;
+		graph->Resources = realloc(graph->Resources, graph->ResourceCapacity * sizeof(struct RenderGraphResource));
+	}
+	graph->Resources[graph->ResourceCount] = (struct RenderGraphResource){ .Type = type, .Object = object };
+	return graph->ResourceCount++;
+}
+
+static void AddAccess(RenderGraph graph, int pass, int resource, bool write, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	ValidateNotCompiled(graph);
+	if (pass < 0 || pass >= graph->PassCount)
+	{
+		log_fatal("Trying to declare a resource of RenderGraph pass %i, but the graph only has %i passes.\n", pass, graph->PassCount);
+		exit(1);
+	}
+	struct RenderGraphPass * graphPass = graph->Passes + pass;
+	if (graphPass->AccessCount == graphPass->AccessCapacity)
+	{
+		graphPass->AccessCapacity = graphPass->AccessCapacity == 0 ? 4 : 2 * graphPass->AccessCapacity;
+		graphPass->Accesses = realloc(graphPass->Accesses, graphPass->AccessCapacity * sizeof(struct RenderGraphAccess));
+	}
+	graphPass->Accesses[graphPass->AccessCount++] = (struct RenderGraphAccess)
+	{
+		.Resource = resource,
+		.Write = write,
+		.Stages = stages,
+		.Access = access,
+	};
+}
+
+RenderGraph RenderGraphCreate()
+{
+	RenderGraph graph = malloc(sizeof(struct RenderGraph));
+	*graph = (struct RenderGraph){ 0 };
+	return graph;
+}
+
+FrameBuffer RenderGraphCreateTransient(RenderGraph graph, FrameBufferConfigure config)
+{
+	ValidateNotCompiled(graph);
+	config.Unbound = true;
+	FrameBuffer frameBuffer = FrameBufferCreate(config);
+	graph->Resources[FindResource(graph, RenderGraphResourceTypeFrameBuffer, frameBuffer)].Transient = true;
+	return frameBuffer;
+}
+
+int RenderGraphAddPass(RenderGraph graph, const char * name, RenderGraphPassType type, FrameBuffer target, RenderGraphPassFunction execute, void * data)
+{
+	ValidateNotCompiled(graph);
+	if (type == RenderGraphPassTypeRender && target == NULL)
+	{
+		log_fatal("Trying to add the render pass %s to a RenderGraph, but its target FrameBuffer is uninitialized.\n", name);
+		exit(1);
+	}
+	if (graph->PassCount == graph->PassCapacity)
+	{
+		graph->PassCapacity = graph->PassCapacity == 0 ? 8 : 2 * graph->PassCapacity;
+		graph->Passes = realloc(graph->Passes, graph->PassCapacity * sizeof(struct RenderGraphPass));
+	}
+	int pass = graph->PassCount++;
+	graph->Passes[pass] = (struct RenderGraphPass)
+	{
+		.Name = name,
+		.Type = type,
+		.Target = type == RenderGraphPassTypeRender ? target : NULL,
+		.Execute = execute,
+		.Data = data,
+	};
+	if (type == RenderGraphPassTypeRender)
+	{
+		int resource = FindResource(graph, RenderGraphResourceTypeFrameBuffer, target);
+		AddAccess(graph, pass, resource, true, RenderGraphTargetStages, RenderGraphTargetAccess);
+	}
+	return pass;
+}
+
+static VkPipelineStageFlags ShaderStages(RenderGraph graph, int pass)
+{
+	if (pass >= 0 && pass < graph->PassCount && graph->Passes[pass].Type == RenderGraphPassTypeCompute) { return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT; }
+	return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+}
+
+void RenderGraphReadFrameBuffer(RenderGraph graph, int pass, FrameBuffer frameBuffer)
+{
+	int resource = FindResource(graph, RenderGraphResourceTypeFrameBuffer, frameBuffer);
+	AddAccess(graph, pass, resource, false, ShaderStages(graph, pass), VK_ACCESS_SHADER_READ_BIT);
+}
+
+void RenderGraphReadTexture(RenderGraph graph, int pass, Texture texture)
+{
+	int resource = FindResource(graph, RenderGraphResourceTypeTexture, texture);
+	AddAccess(graph, pass, resource, false, ShaderStages(graph, pass), VK_ACCESS_SHADER_READ_BIT);
+}
+
+void RenderGraphReadStorageBuffer(RenderGraph graph, int pass, StorageBuffer storageBuffer)
+{
+	int resource = FindResource(graph, RenderGraphResourceTypeStorageBuffer, storageBuffer);
+	VkPipelineStageFlags stages = ShaderStages(graph, pass);
+	VkAccessFlags access = VK_ACCESS_SHADER_READ_BIT;
+	if (stages != VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+	{
+		stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	}
+	AddAccess(graph, pass, resource, false, stages, access);
+}
+
+void RenderGraphWriteStorageBuffer(RenderGraph graph, int pass, StorageBuffer storageBuffer)
+{
+	int resource = FindResource(graph, RenderGraphResourceTypeStorageBuffer, storageBuffer);
+	AddAccess(graph, pass, resource, true, ShaderStages(graph, pass), VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void RenderGraphOutputFrameBuffer(RenderGraph graph, FrameBuffer frameBuffer)
+{
+	ValidateNotCompiled(graph);
+	graph->Resources[FindResource(graph, RenderGraphResourceTypeFrameBuffer, frameBuffer)].Output = true;
+}
+
+void RenderGraphOutputStorageBuffer(RenderGraph graph, StorageBuffer storageBuffer)
+{
+	ValidateNotCompiled(graph);
+	graph->Resources[FindResource(graph, RenderGraphResourceTypeStorageBuffer, storageBuffer)].Output = true;
+}
+
+static void CullPasses(RenderGraph graph)
+{
+	for (int i = 0; i < graph->ResourceCount; i++) { graph->Resources[i].Live = graph->Resources[i].Output; }
+	// A pass is needed if it writes something that's needed, then everything it uses is needed since the render pass loads its target
+	for (int i = graph->PassCount - 1; i >= 0; i--)
+	{
+		struct RenderGraphPass * pass = graph->Passes + i;
+		pass->Culled = true;
+		for (int j = 0; j < pass->AccessCount; j++)
+		{
+			if (pass->Accesses[j].Write && graph->Resources[pass->Accesses[j].Resource].Live) { pass->Culled = false; }
+		}
+		if (pass->Culled) { continue; }
+		for (int j = 0; j < pass->AccessCount; j++) { graph->Resources[pass->Accesses[j].Resource].Live = true; }
+	}
+	
+	for (int i = 0; i < graph->ResourceCount; i++)
+	{
+		graph->Resources[i].FirstPass = -1;
+		graph->Resources[i].LastPass = -1;
+	}
+	for (int i = 0; i < graph->PassCount; i++)
+	{
+		if (graph->Passes[i].Culled) { continue; }
+		for (int j = 0; j < graph->Passes[i].AccessCount; j++)
+		{
+			struct RenderGraphAccess access = graph->Passes[i].Accesses[j];
+			struct RenderGraphResource * resource = graph->Resources + access.Resource;
+			if (resource->FirstPass == -1) { resource->FirstPass = i; }
+			resource->LastPass = i;
+			resource->UsedStages |= access.Stages;
+			if (access.Write) { resource->WrittenAccess |= access.Access & RenderGraphWriteAccess; }
+		}
+	}
+	// Outputs are used after every pass
+	for (int i = 0; i < graph->ResourceCount; i++)
+	{
+		if (graph->Resources[i].Output && graph->Resources[i].FirstPass != -1) { graph->Resources[i].LastPass = graph->PassCount; }
+	}
+}
+
+static void AliasTransients(RenderGraph graph)
+{
+	// Each transient framebuffer has a color and a depth-stencil texture, which share the lifetime of the framebuffer
+	graph->AliasCount = 0;
+	graph->Aliases = malloc(2 * graph->ResourceCount * sizeof(struct RenderGraphAlias));
+	for (int i = 0; i < graph->ResourceCount; i++)
+	{
+		struct RenderGraphResource * resource = graph->Resources + i;
+		if (!resource->Transient || resource->FirstPass == -1) { continue; }
+		FrameBuffer frameBuffer = resource->Object;
+		Texture textures[] = { frameBuffer->ColorTexture, frameBuffer->DepthTexture };
+		for (int j = 0; j < 2; j++)
+		{
+			struct RenderGraphAlias * alias = graph->Aliases + graph->AliasCount++;
+			*alias = (struct RenderGraphAlias){ .Resource = i, .Texture = textures[j], .Block = -1, .Previous = -1 };
+			vkGetImageMemoryRequirements(Graphics.Device, textures[j]->Image, &alias->Requirements);
+		}
+	}
+	
+	// Textures are placed in the order they're first used, into the first memory block that is free by then
+	graph->BlockCount = 0;
+	graph->Blocks = malloc(graph->AliasCount * sizeof(struct RenderGraphBlock));
+	for (int placed = 0; placed < graph->AliasCount; placed++)
+	{
+		int next = -1;
+		for (int i = 0; i < graph->AliasCount; i++)
+		{
+			if (graph->Aliases[i].Block != -1) { continue; }
+			if (next == -1 || graph->Resources[graph->Aliases[i].Resource].FirstPass < graph->Resources[graph->Aliases[next].Resource].FirstPass) { next = i; }
+		}
+		struct RenderGraphAlias * alias = graph->Aliases + next;
+		struct RenderGraphResource * resource = graph->Resources + alias->Resource;
+	
+		int block = 0;
+		for (; block < graph->BlockCount; block++)
+		{
+			bool available = graph->Blocks[block].LastPass < resource->FirstPass;
+			bool compatible = (graph->Blocks[block].Requirements.memoryTypeBits & alias->Requirements.memoryTypeBits) != 0;
+			if (available && compatible) { break; }
+		}
+		if (block == graph->BlockCount)
+		{
+			graph->Blocks[graph->BlockCount++] = (struct RenderGraphBlock){ .Requirements = alias->Requirements, .LastAlias = -1 };
+		}
+		struct RenderGraphBlock * memoryBlock = graph->Blocks + block;
+		if (alias->Requirements.size > memoryBlock->Requirements.size) { memoryBlock->Requirements.size = alias->Requirements.size; }
+		if (alias->Requirements.alignment > memoryBlock->Requirements.alignment) { memoryBlock->Requirements.alignment = alias->Requirements.alignment; }
+		memoryBlock->Requirements.memoryTypeBits &= alias->Requirements.memoryTypeBits;
+		memoryBlock->LastPass = resource->LastPass;
+		alias->Block = block;
+		alias->Previous = memoryBlock->LastAlias;
+		memoryBlock->LastAlias = next;
+	}
+	// The first texture in a block follows the last one from the previous frame
+	for (int i = 0; i < graph->AliasCount; i++)
+	{
+		if (graph->Aliases[i].Previous == -1) { graph->Aliases[i].Previous = graph->Blocks[graph->Aliases[i].Block].LastAlias; }
+	}
+	
+	VmaAllocationCreateInfo allocationInfo =
+	{
+		.usage = VMA_MEMORY_USAGE_GPU_ONLY,
+	};
+	for (int i = 0; i < graph->BlockCount; i++)
+	{
+		VkResult result = vmaAllocateMemory(Graphics.Allocator, &graph->Blocks[i].Requirements, &allocationInfo, &graph->Blocks[i].Allocation, NULL);
+		if (result != VK_SUCCESS)
+		{
+			log_fatal("Trying to compile a RenderGraph, but failed to allocate transient memory: %i\n", result);
+			exit(1);
+		}
+	}
+	for (int i = 0; i < graph->AliasCount; i += 2)
+	{
+		VmaAllocation color = graph->Blocks[graph->Aliases[i].Block].Allocation;
+		VmaAllocation depth = graph->Blocks[graph->Aliases[i + 1].Block].Allocation;
+		FrameBufferBindMemory(graph->Resources[graph->Aliases[i].Resource].Object, color, depth);
+	}
+}
+
+static void Synchronize(struct RenderGraphResource * resource, struct RenderGraphAccess access, VkPipelineStageFlags * sourceStages, VkPipelineStageFlags * destinationStages, VkMemoryBarrier * barrier)
+{
+	if (access.Write)
+	{
+		// A write waits for the reads before it to finish, and is ordered after the write before it
+		if (resource->ReadStages != 0 || resource->WriteStages != 0)
+		{
+			*sourceStages |= resource->ReadStages | resource->WriteStages;
+			*destinationStages |= access.Stages;
+			barrier->srcAccessMask |= resource->WriteAccess;
+			barrier->dstAccessMask |= resource->WriteAccess == 0 ? 0 : access.Access;
+		}
+		resource->WriteStages = access.Stages;
+		resource->WriteAccess = access.Access & RenderGraphWriteAccess;
+		resource->ReadStages = 0;
+		resource->VisibleStages = access.Stages;
+		resource->VisibleAccess = access.Access;
+		return;
+	}
+	
+	// Reads after a write only wait once for each stage and access that the write wasn't made visible to yet
+	bool visible = (access.Stages & ~resource->VisibleStages) == 0 && (access.Access & ~resource->VisibleAccess) == 0;
+	if (!visible && resource->WriteStages != 0)
+	{
+		*sourceStages |= resource->WriteStages;
+		*destinationStages |= access.Stages;
+		barrier->srcAccessMask |= resource->WriteAccess;
+		barrier->dstAccessMask |= access.Access;
+		resource->VisibleStages |= access.Stages;
+		resource->VisibleAccess |= access.Access;
+	}
+	resource->ReadStages |= access.Stages;
+}
+
+static void TransitionTransient(RenderGraph graph, struct RenderGraphPass * pass, int resource, struct RenderGraphAccess access)
+{
+	for (int i = 0; i < graph->AliasCount; i++)
+	{
+		struct RenderGraphAlias * alias = graph->Aliases + i;
+		if (alias->Resource != resource) { continue; }
+		// The texture takes over the memory from the texture that used it before, so the old contents are discarded
+		struct RenderGraphResource * previous = graph->Resources + graph->Aliases[alias->Previous].Resource;
+		pass->SourceStages |= previous->UsedStages;
+		// The render pass waits on the shader stages before it moves the texture out of its shader layout
+		pass->DestinationStages |= access.Stages | TextureShaderStages;
+		bool color = alias->Texture->Format == TextureFormatColor;
+		alias->Texture->Layout = TextureShaderLayout(alias->Texture->Format);
+		alias->Texture->Stages = TextureShaderStages;
+		alias->Texture->Access = 0;
+		pass->ImageBarriers[pass->ImageBarrierCount++] = (VkImageMemoryBarrier)
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = previous->WrittenAccess,
+			.dstAccessMask = access.Access | VK_ACCESS_SHADER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.newLayout = alias->Texture->Layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = alias->Texture->Image,
+			.subresourceRange =
+			{
+				.aspectMask = color ? VK_IMAGE_ASPECT_COLOR_BIT : VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+		};
+	}
+	struct RenderGraphResource * transient = graph->Resources + resource;
+	transient->WriteStages = 0;
+	transient->WriteAccess = 0;
+	transient->ReadStages = 0;
+	transient->VisibleStages = access.Stages;
+	transient->VisibleAccess = access.Access;
+}
+
+static void DeriveBarriers(RenderGraph graph)
+{
+	graph->OutputSourceStages = 0;
+	graph->OutputDestinationStages = 0;
+	graph->OutputBarrier = (VkMemoryBarrier){ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+	for (int i = 0; i < graph->PassCount; i++)
+	{
+		struct RenderGraphPass * pass = graph->Passes + i;
+		if (pass->Culled) { continue; }
+		pass->SourceStages = 0;
+		pass->DestinationStages = 0;
+		pass->Barrier = (VkMemoryBarrier){ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		pass->ImageBarrierCount = 0;
+		for (int j = 0; j < pass->AccessCount; j++)
+		{
+			struct RenderGraphAccess access = pass->Accesses[j];
+			struct RenderGraphResource * resource = graph->Resources + access.Resource;
+			bool firstAccess = resource->FirstPass == i;
+			for (int k = 0; k < j; k++) { firstAccess = firstAccess && pass->Accesses[k].Resource != access.Resource; }
+			if (resource->Transient && firstAccess) { TransitionTransient(graph, pass, access.Resource, access); }
+			Synchronize(resource, access, &pass->SourceStages, &pass->DestinationStages, &pass->Barrier);
+		}
+	}
+	for (int i = 0; i < graph->ResourceCount; i++)
+	{
+		struct RenderGraphResource * resource = graph->Resources + i;
+		if (!resource->Output || resource->FirstPass == -1) { continue; }
+		struct RenderGraphAccess access =
+		{
+			.Resource = i,
+			.Write = false,
+			.Stages = resource->Type == RenderGraphResourceTypeStorageBuffer ? RenderGraphStorageBufferOutputStages : RenderGraphFrameBufferOutputStages,
+			.Access = resource->Type == RenderGraphResourceTypeStorageBuffer ? RenderGraphStorageBufferOutputAccess : RenderGraphFrameBufferOutputAccess,
+		};
+		Synchronize(resource, access, &graph->OutputSourceStages, &graph->OutputDestinationStages, &graph->OutputBarrier);
+	}
+}
+
+void RenderGraphCompile(RenderGraph graph)
+{
+	ValidateNotCompiled(graph);
+	graph->Compiled = true;
+	
+	CullPasses(graph);
+	AliasTransients(graph);
+	for (int i = 0; i < graph->PassCount; i++)
+	{
+		graph->Passes[i].ImageBarriers = malloc(2 * graph->Passes[i].AccessCount * sizeof(VkImageMemoryBarrier));
+	}
+	// The first frame starts from nothing, after that each frame starts from the state the last one ended with
+	DeriveBarriers(graph);
+	DeriveBarriers(graph);
+}
+
+static void RecordBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags sourceStages, VkPipelineStageFlags destinationStages, VkMemoryBarrier * barrier, int imageBarrierCount, VkImageMemoryBarrier * imageBarriers)
+{
+	if (destinationStages == 0) { return; }
+	bool memory = barrier->srcAccessMask != 0 || barrier->dstAccessMask != 0;
+	sourceStages = sourceStages == 0 ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : sourceStages;
+	vkCmdPipelineBarrier(commandBuffer, sourceStages, destinationStages, 0, memory ? 1 : 0, barrier, 0, NULL, imageBarrierCount, imageBarriers);
+}
+
+void RenderGraphExecute(RenderGraph graph)
+{
+	if (!graph->Compiled) { RenderGraphCompile(graph); }
+	VkCommandBuffer commandBuffer = GraphicsCommandBuffer();
+	for (int i = 0; i < graph->PassCount; i++)
+	{
+		struct RenderGraphPass * pass = graph->Passes + i;
+		if (pass->Culled) { continue; }
+		RecordBarrier(commandBuffer, pass->SourceStages, pass->DestinationStages, &pass->Barrier, pass->ImageBarrierCount, pass->ImageBarriers);
+		GraphicsBeginTiming(pass->Name);
+		if (pass->Type == RenderGraphPassTypeRender)
+		{
+			GraphicsBegin(pass->Target);
+			pass->Execute(pass->Data);
+			GraphicsEnd();
+		}
+		else { pass->Execute(pass->Data); }
+		GraphicsEndTiming();
+	}
+	RecordBarrier(commandBuffer, graph->OutputSourceStages, graph->OutputDestinationStages, &graph->OutputBarrier, 0, NULL);
+}
+
+void RenderGraphQueueDestroy(RenderGraph graph)
+{
+	TimelineRetire(graph, (TimelineDestroyFunction)RenderGraphDestroy);
+}
+
+void RenderGraphDestroy(RenderGraph graph)
+{
+	for (int i = 0; i < graph->ResourceCount; i++)
+	{
+		if (graph->Resources[i].Transient) { FrameBufferDestroy(graph->Resources[i].Object); }
+	}
+	for (int i = 0; i < graph->BlockCount; i++) { vmaFreeMemory(Graphics.Allocator, graph->Blocks[i].Allocation); }
+	for (int i = 0; i < graph->PassCount; i++)
+	{
+		free(graph->Passes[i].Accesses);
+		free(graph->Passes[i].ImageBarriers);
+	}
+	free(graph->Resources);
+	free(graph->Passes);
+	free(graph->Aliases);
+	free(graph->Blocks);
+	free(graph);
+}
@@ -0,0 +1,179 @@
+#ifndef RenderGraph_h
+#define RenderGraph_h
+
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+#include <stdbool.h>
+#include "FrameBuffer.h"
+#include "Texture.h"
+#include "StorageBuffer.h"
+
+typedef enum RenderGraphPassType
+{
+	/// The pass renders to its target framebuffer, the function is called between GraphicsBegin and GraphicsEnd
+	RenderGraphPassTypeRender,
+	/// The pass dispatches compute pipelines with GraphicsDispatchInline
+	RenderGraphPassTypeCompute,
+} RenderGraphPassType;
+
+typedef enum RenderGraphResourceType
+{
+	RenderGraphResourceTypeFrameBuffer,
+	RenderGraphResourceTypeTexture,
+	RenderGraphResourceTypeStorageBuffer,
+} RenderGraphResourceType;
+
+/// Records the commands of a pass
+typedef void (* RenderGraphPassFunction)(void * data);
+
+typedef struct RenderGraph
+{
+	bool Compiled;
+	int ResourceCount;
+	int ResourceCapacity;
+	struct RenderGraphResource
+	{
+		RenderGraphResourceType Type;
+		void * Object;
+		bool Transient;
+		bool Output;
+		bool Live;
+		int FirstPass;
+		int LastPass;
+		VkPipelineStageFlags UsedStages;
+		VkAccessFlags WrittenAccess;
+		VkPipelineStageFlags WriteStages;
+		VkAccessFlags WriteAccess;
+		VkPipelineStageFlags ReadStages;
+		VkPipelineStageFlags VisibleStages;
+		VkAccessFlags VisibleAccess;
+	} * Resources;
+	int PassCount;
+	int PassCapacity;
+	struct RenderGraphPass
+	{
+		const char * Name;
+		RenderGraphPassType Type;
+		FrameBuffer Target;
+		RenderGraphPassFunction Execute;
+		void * Data;
+		bool Culled;
+		int AccessCount;
+		int AccessCapacity;
+		struct RenderGraphAccess
+		{
+			int Resource;
+			bool Write;
+			VkPipelineStageFlags Stages;
+			VkAccessFlags Access;
+		} * Accesses;
+		VkPipelineStageFlags SourceStages;
+		VkPipelineStageFlags DestinationStages;
+		VkMemoryBarrier Barrier;
+		int ImageBarrierCount;
+		VkImageMemoryBarrier * ImageBarriers;
+	} * Passes;
+	int AliasCount;
+	struct RenderGraphAlias
+	{
+		int Resource;
+		Texture Texture;
+		VkMemoryRequirements Requirements;
+		int Block;
+		int Previous;
+	} * Aliases;
+	int BlockCount;
+	struct RenderGraphBlock
+	{
+		VkMemoryRequirements Requirements;
+		int LastPass;
+		int LastAlias;
+		VmaAllocation Allocation;
+	} * Blocks;
+	VkPipelineStageFlags OutputSourceStages;
+	VkPipelineStageFlags OutputDestinationStages;
+	VkMemoryBarrier OutputBarrier;
+} * RenderGraph;
+
+/// Creates an empty render graph.
+/// Passes are added in the order they execute, with the resources they read and write.
+/// When the graph is compiled, passes that don't contribute to an output are culled, the barriers between the passes are derived,
+/// and transient framebuffers whose lifetimes don't overlap share memory.
+/// \return The render graph
+RenderGraph RenderGraphCreate(void);
+
+/// Creates a framebuffer that is owned by the graph and only lives during the passes that use it.
+/// Its memory may be shared with other transient framebuffers, so its contents are undefined at the first pass that uses it each frame and that pass should clear it.
+/// It must not be used outside of the graph's passes, and it's destroyed with the graph.
+/// \param graph The render graph
+/// \param config The framebuffer configuration
+/// \return The transient framebuffer
+FrameBuffer RenderGraphCreateTransient(RenderGraph graph, FrameBufferConfigure config);
+
+/// Adds a pass to the end of the graph.
+/// \param graph The render graph
+/// \param name The name of the pass, used for gpu timings, it must stay valid as long as the graph
+/// \param type The type of the pass
+/// \param target The framebuffer a render pass renders to, it's written by the pass. Ignored for compute passes
+/// \param execute The function that records the commands of the pass
+/// \param data The data that is passed to the function
+/// \return The index of the pass, used to declare what it reads and writes
+int RenderGraphAddPass(RenderGraph graph, const char * name, RenderGraphPassType type, FrameBuffer target, RenderGraphPassFunction execute, void * data);
+
+/// Declares that a pass samples the textures of a framebuffer.
+/// \param graph The render graph
+/// \param pass The index of the pass
+/// \param frameBuffer The framebuffer that's read
+void RenderGraphReadFrameBuffer(RenderGraph graph, int pass, FrameBuffer frameBuffer);
+
+/// Declares that a pass samples a texture.
+/// \param graph The render graph
+/// \param pass The index of the pass
+/// \param texture The texture that's read
+void RenderGraphReadTexture(RenderGraph graph, int pass, Texture texture);
+
+/// Declares that a pass reads a storage buffer, in shaders, as vertices or as indirect draws.
+/// \param graph The render graph
+/// \param pass The index of the pass
+/// \param storageBuffer The storage buffer that's read
+void RenderGraphReadStorageBuffer(RenderGraph graph, int pass, StorageBuffer storageBuffer);
+
+/// Declares that a pass writes a storage buffer in shaders.
+/// \param graph The render graph
+/// \param pass The index of the pass
+/// \param storageBuffer The storage buffer that's written
+void RenderGraphWriteStorageBuffer(RenderGraph graph, int pass, StorageBuffer storageBuffer);
+
+/// Marks a framebuffer as a result of the graph, like the framebuffer that's copied to the swapchain.
+/// The passes that don't contribute to any output are culled.
+/// \param graph The render graph
+/// \param frameBuffer The framebuffer that's used after the graph
+void RenderGraphOutputFrameBuffer(RenderGraph graph, FrameBuffer frameBuffer);
+
+/// Marks a storage buffer as a result of the graph.
+/// The passes that don't contribute to any output are culled.
+/// \param graph The render graph
+/// \param storageBuffer The storage buffer that's used after the graph
+void RenderGraphOutputStorageBuffer(RenderGraph graph, StorageBuffer storageBuffer);
+
+/// Culls the passes, derives the barriers and allocates the memory of the transient framebuffers.
+/// Passes can't be added after the graph is compiled, it's compiled at the first RenderGraphExecute if this isn't called.
+/// \param graph The render graph
+void RenderGraphCompile(RenderGraph graph);
+
+/// Records the passes that weren't culled along with their barriers.
+/// This should only be called after GraphicsAquireNextImage and outside of GraphicsBegin and GraphicsEnd.
+/// \param graph The render graph
+void RenderGraphExecute(RenderGraph graph);
+
+/// Places the render graph into a queue to be destroyed.
+/// This should only be called if the graph needs to be destroyed at render-time
+/// \param graph The render graph to destroy
+void RenderGraphQueueDestroy(RenderGraph graph);
+
+/// Destroys and frees the render graph and its transient framebuffers
+/// Don't call this unless it's at the initialize or the deinitialize of the application, otherwise use RenderGraphQueueDestroy
+/// \param graph The render graph to destroy
+void RenderGraphDestroy(RenderGraph graph);
+
+#endif
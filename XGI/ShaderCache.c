@@ -0,0 +1,281 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL_thread.h>
+#include "ShaderCache.h"
+#include "Graphics.h"
+#include "File.h"
+#include "log.h"
+
+struct ShaderCacheDependencies
+{
+	int Count;
+	int Capacity;
+	struct ShaderCacheDependency
+	{
+		char * Path;
+		/// Whether or not the file existed, candidates that didn't exist are recorded since creating them changes which file is included
+		bool Exists;
+		uint64_t Hash;
+	} * Dependencies;
+};
+
+uint64_t ShaderCacheHash(uint64_t hash, const void * data, unsigned long size)
+{
+	// FNV-1a
+	const unsigned char * bytes = data;
+	for (unsigned long i = 0; i < size; i++) { hash = (hash ^ bytes[i]) * 1099511628211ull; }
+	return hash;
+}
+
+static void * ReadFile(const char * path, unsigned long * size)
+{
+	File file = FileOpen(path, FileModeReadBinary);
+	*size = FileGetSize(file);
+	void * data = malloc(*size + 1);
+	if (*size > 0) { FileRead(file, 0, *size, data); }
+	FileClose(file);
+	((char *)data)[*size] = '\0';
+	return data;
+}
+
+static uint64_t HashFile(const char * path)
+{
+	unsigned long size;
+	void * content = ReadFile(path, &size);
+	uint64_t hash = ShaderCacheHash(ShaderCacheHashSeed, content, size);
+	free(content);
+	return hash;
+}
+
+static bool RecordCandidate(struct ShaderCacheDependencies * dependencies, const char * path)
+{
+	bool exists = FileExists(path);
+	for (int i = 0; i < dependencies->Count; i++)
+	{
+		if (strcmp(dependencies->Dependencies[i].Path, path) == 0) { return exists; }
+	}
+	if (dependencies->Count == dependencies->Capacity)
+	{
+		dependencies->Capacity = dependencies->Capacity == 0 ? 4 : 2 * dependencies->Capacity;
+		dependencies->Dependencies = realloc(dependencies->Dependencies, dependencies->Capacity * sizeof(struct ShaderCacheDependency));
+	}
+	char * dependencyPath = malloc(strlen(path) + 1);
+	strcpy(dependencyPath, path);
+	dependencies->Dependencies[dependencies->Count++] = (struct ShaderCacheDependency)
+	{
+		.Path = dependencyPath,
+		.Exists = exists,
+		.Hash = exists ? HashFile(path) : 0,
+	};
+	return exists;
+}
+
+static char * ResolveInclude(struct ShaderCacheDependencies * dependencies, const char * requested, int type, const char * requesting)
+{
+	// Relative includes are looked up next to the file that includes them first, then from the working directory like standard includes
+	const char * slash = strrchr(requesting, '/');
+	if (type == shaderc_include_type_relative && slash != NULL)
+	{
+		int directoryLength = (int)(slash - requesting) + 1;
+		char * path = malloc(directoryLength + strlen(requested) + 1);
+		memcpy(path, requesting, directoryLength);
+		strcpy(path + directoryLength, requested);
+		if (RecordCandidate(dependencies, path)) { return path; }
+		free(path);
+	}
+	if (!RecordCandidate(dependencies, requested)) { return NULL; }
+	char * path = malloc(strlen(requested) + 1);
+	strcpy(path, requested);
+	return path;
+}
+
+static shaderc_include_result * IncludeResolve(void * userData, const char * requested, int type, const char * requesting, size_t depth)
+{
+	(void)depth;
+	struct ShaderCacheDependencies * dependencies = userData;
+	shaderc_include_result * result = malloc(sizeof(shaderc_include_result));
+	char * path = ResolveInclude(dependencies, requested, type, requesting);
+	if (path == NULL)
+	{
+		// An empty source name tells shaderc that the include failed, the content is the error message
+		const char * message = "Failed to find the included file";
+		*result = (shaderc_include_result){ .source_name = "", .source_name_length = 0, .content = message, .content_length = strlen(message) };
+		return result;
+	}
+	
+	unsigned long size;
+	char * content = ReadFile(path, &size);
+	*result = (shaderc_include_result)
+	{
+		.source_name = path,
+		.source_name_length = strlen(path),
+		.content = content,
+		.content_length = size,
+		.user_data = path,
+	};
+	return result;
+}
+
+static void IncludeRelease(void * userData, shaderc_include_result * result)
+{
+	(void)userData;
+	if (result->user_data != NULL)
+	{
+		free(result->user_data);
+		free((void *)result->content);
+	}
+	free(result);
+}
+
+static uint64_t SourceKey(shaderc_shader_kind kind, const char * source, unsigned long sourceSize, const char * name)
+{
+	// The name is part of the key since relative includes are resolved from it
+	unsigned int spirvVersion, spirvRevision;
+	shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+	uint32_t options[] = { ShaderCacheVersion, spirvVersion, spirvRevision, kind };
+	uint64_t key = ShaderCacheHash(ShaderCacheHashSeed, options, sizeof(options));
+	key = ShaderCacheHash(key, "main", strlen("main") + 1);
+	key = ShaderCacheHash(key, name, strlen(name) + 1);
+	return ShaderCacheHash(key, source, sourceSize);
+}
+
+static void * LoadCached(const char * path, uint64_t key, unsigned long * spirvSize)
+{
+	if (!FileExists(path)) { return NULL; }
+	unsigned long size;
+	unsigned char * data = ReadFile(path, &size);
+	ShaderCacheHeader header;
+	if (size < sizeof(header)) { free(data); return NULL; }
+	memcpy(&header, data, sizeof(header));
+	if (header.Magic != ShaderCacheMagic || header.Version != ShaderCacheVersion || header.Key != key) { free(data); return NULL; }
+	
+	// The SPIR-V is only valid if every candidate include path still exists or doesn't exist like it did, with the same contents
+	unsigned long offset = sizeof(header);
+	for (int i = 0; i < header.DependencyCount; i++)
+	{
+		uint32_t pathLength;
+		uint32_t existed;
+		uint64_t hash;
+		if (offset + sizeof(pathLength) > size) { free(data); return NULL; }
+		memcpy(&pathLength, data + offset, sizeof(pathLength));
+		offset += sizeof(pathLength);
+		if (offset + pathLength + sizeof(existed) + sizeof(hash) > size) { free(data); return NULL; }
+		char * dependencyPath = malloc(pathLength + 1);
+		memcpy(dependencyPath, data + offset, pathLength);
+		dependencyPath[pathLength] = '\0';
+		memcpy(&existed, data + offset + pathLength, sizeof(existed));
+		memcpy(&hash, data + offset + pathLength + sizeof(existed), sizeof(hash));
+		offset += pathLength + sizeof(existed) + sizeof(hash);
+	
+		bool exists = FileExists(dependencyPath);
+		bool valid = exists == (existed != 0) && (!exists || HashFile(dependencyPath) == hash);
+		free(dependencyPath);
+		if (!valid) { free(data); return NULL; }
+	}
+	if (offset + header.SpirvSize != size) { free(data); return NULL; }
+	
+	void * spirv = malloc(header.SpirvSize);
+	memcpy(spirv, data + offset, header.SpirvSize);
+	*spirvSize = header.SpirvSize;
+	free(data);
+	return spirv;
+}
+
+static void StoreCached(const char * path, uint64_t key, struct ShaderCacheDependencies dependencies, const void * spirv, unsigned long spirvSize)
+{
+	ShaderCacheHeader header =
+	{
+		.Magic = ShaderCacheMagic,
+		.Version = ShaderCacheVersion,
+		.Key = key,
+		.DependencyCount = dependencies.Count,
+		.SpirvSize = (uint32_t)spirvSize,
+	};
+	unsigned long size = sizeof(header) + spirvSize;
+	for (int i = 0; i < dependencies.Count; i++) { size += sizeof(uint32_t) + strlen(dependencies.Dependencies[i].Path) + sizeof(uint32_t) + sizeof(uint64_t); }
+	
+	// Files can only be written from their start, so the entry is built in memory first
+	unsigned char * data = malloc(size);
+	unsigned long offset = 0;
+	memcpy(data + offset, &header, sizeof(header));
+	offset += sizeof(header);
+	for (int i = 0; i < dependencies.Count; i++)
+	{
+		uint32_t pathLength = (uint32_t)strlen(dependencies.Dependencies[i].Path);
+		memcpy(data + offset, &pathLength, sizeof(pathLength));
+		offset += sizeof(pathLength);
+		memcpy(data + offset, dependencies.Dependencies[i].Path, pathLength);
+		offset += pathLength;
+		uint32_t exists = dependencies.Dependencies[i].Exists;
+		memcpy(data + offset, &exists, sizeof(exists));
+		offset += sizeof(exists);
+		memcpy(data + offset, &dependencies.Dependencies[i].Hash, sizeof(uint64_t));
+		offset += sizeof(uint64_t);
+	}
+	memcpy(data + offset, spirv, spirvSize);
+	
+	// It's written next to the entry and renamed over it, so a launch that's stopped while writing doesn't leave a partial entry
+	char temporaryPath[1040];
+	// Pipelines are created on several threads, so each thread writes its own temporary file
+	snprintf(temporaryPath, sizeof(temporaryPath), "%s.%lu.tmp", path, SDL_ThreadID());
+	// Storing is best effort, a read only cache directory shouldn't stop the shader from being used
+	FILE * file = fopen(temporaryPath, "wb");
+	if (file == NULL)
+	{
+		log_warn("Failed to open %s to save the compiled shader.\n", temporaryPath);
+		free(data);
+		return;
+	}
+	bool written = fwrite(data, 1, size, file) == size;
+	written &= fclose(file) == 0;
+	free(data);
+	if (!written)
+	{
+		log_warn("Failed to write the compiled shader to %s.\n", temporaryPath);
+		remove(temporaryPath);
+		return;
+	}
+#ifdef _WIN32
+	// Renaming doesn't replace an existing file on Windows
+	remove(path);
+#endif
+	if (rename(temporaryPath, path) != 0) { log_warn("Failed to save the compiled shader to %s.\n", path); }
+}
+
+void * ShaderCacheCompile(shaderc_shader_kind kind, const char * source, unsigned long sourceSize, const char * name, unsigned long * spirvSize)
+{
+	uint64_t key = SourceKey(kind, source, sourceSize, name);
+	char path[1024];
+	if (Graphics.CacheDirectory != NULL)
+	{
+		snprintf(path, sizeof(path), "%s/%016llx.spv", Graphics.CacheDirectory, (unsigned long long)key);
+		void * spirv = LoadCached(path, key, spirvSize);
+		if (spirv != NULL)
+		{
+			log_debug("Loaded shader %s from the cache.\n", name);
+			return spirv;
+		}
+	}
+	
+	// Options are created for each compile so shaders can be compiled on several threads at once
+	struct ShaderCacheDependencies dependencies = { 0 };
+	shaderc_compile_options_t options = shaderc_compile_options_initialize();
+	shaderc_compile_options_set_include_callbacks(options, IncludeResolve, IncludeRelease, &dependencies);
+	shaderc_compilation_result_t result = shaderc_compile_into_spv(Graphics.ShaderCompiler, source, sourceSize, kind, name, "main", options);
+	shaderc_compile_options_release(options);
+	if (shaderc_result_get_num_errors(result) > 0)
+	{
+		log_fatal("Error while compiling shader:\n%s\n", shaderc_result_get_error_message(result));
+		exit(1);
+	}
+	*spirvSize = shaderc_result_get_length(result);
+	void * spirv = malloc(*spirvSize);
+	memcpy(spirv, shaderc_result_get_bytes(result), *spirvSize);
+	shaderc_result_release(result);
+	
+	if (Graphics.CacheDirectory != NULL) { StoreCached(path, key, dependencies, spirv, *spirvSize); }
+	for (int i = 0; i < dependencies.Count; i++) { free(dependencies.Dependencies[i].Path); }
+	free(dependencies.Dependencies);
+	return spirv;
+}
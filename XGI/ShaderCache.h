@@ -0,0 +1,40 @@
+#ifndef ShaderCache_h
+#define ShaderCache_h
+
+#include <shaderc/shaderc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ShaderCacheMagic 0x53494758
+#define ShaderCacheVersion 2
+#define ShaderCacheHashSeed 14695981039346656037ull
+
+typedef struct ShaderCacheHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	/// The hash of the source, kind, entry point and compile options
+	uint64_t Key;
+	uint32_t DependencyCount;
+	uint32_t SpirvSize;
+} ShaderCacheHeader;
+
+/// Hashes a block of memory, hashes are chained by passing the previous hash in.
+/// \param hash The hash to continue from, ShaderCacheHashSeed to start a new one
+/// \param data The memory to hash
+/// \param size The size in bytes of the memory
+/// \return The new hash
+uint64_t ShaderCacheHash(uint64_t hash, const void * data, unsigned long size);
+
+/// Compiles a GLSL shader into SPIR-V, #include directives are resolved relative to the file that includes them.
+/// If GraphicsConfigure.CacheDirectory is set, the SPIR-V is stored there and later compiles of the same source reuse it,
+/// as long as none of the files it included have changed and none of its includes would now resolve to a different file.
+/// \param kind The kind of shader to compile
+/// \param source The GLSL source
+/// \param sourceSize The size in bytes of the source
+/// \param name The name of the source, the path of the file if it's loaded from one
+/// \param spirvSize The size in bytes of the SPIR-V that's returned
+/// \return The SPIR-V, it's owned by the caller
+void * ShaderCacheCompile(shaderc_shader_kind kind, const char * source, unsigned long sourceSize, const char * name, unsigned long * spirvSize);
+
+#endif
@@ -1,5 +1,7 @@
 #include "StorageBuffer.h"
 #include "Graphics.h"
+#include "Upload.h"
+#include "Timeline.h"
 #include "log.h"
 
 StorageBuffer StorageBufferCreate(struct Pipeline * pipeline, int binding, int instanceCount)
@@ -42,25 +44,16 @@ StorageBuffer StorageBufferCreate(struct Pipeline * pipeline, int binding, int i
 	
 	storageBuffer->Size = size;
 	
-	VkBufferCreateInfo stagingInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size = size,
-		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-	};
-	VmaAllocationCreateInfo stagingAllocationInfo =
-	{
-		.usage = VMA_MEMORY_USAGE_CPU_ONLY,
-	};
-	vmaCreateBuffer(Graphics.Allocator, &stagingInfo, &stagingAllocationInfo, &storageBuffer->StagingBuffer, &storageBuffer->StagingAllocation, NULL);
-	
+	// The buffer is shared by the graphics, compute and transfer queues without ownership transfers
+	bool shared = Graphics.SharedQueueCount > 1;
 	VkBufferCreateInfo bufferInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.size = size,
-		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		.sharingMode = shared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = shared ? Graphics.SharedQueueCount : 0,
+		.pQueueFamilyIndices = Graphics.SharedQueueIndices,
 	};
 	VmaAllocationCreateInfo allocationInfo =
 	{
@@ -75,116 +68,139 @@ StorageBuffer StorageBufferCreate(struct Pipeline * pipeline, int binding, int i
 		.commandPool = Graphics.CommandPool,
 		.commandBufferCount = 1,
 	};
-	vkAllocateCommandBuffers(Graphics.Device, &commandAllocateInfo, &storageBuffer->UploadCommandBuffer);
 	vkAllocateCommandBuffers(Graphics.Device, &commandAllocateInfo, &storageBuffer->DownloadCommandBuffer);
 	
-	VkFenceCreateInfo fenceInfo =
+	return storageBuffer;
+}
+
+static void CreateHostBuffer(StorageBuffer storageBuffer)
+{
+	// The host copy is cached, it's written by the mapped variables and copied into on the graphics queue by downloads
+	VkBufferCreateInfo bufferInfo =
 	{
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = storageBuffer->Size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 	};
-	vkCreateFence(Graphics.Device, &fenceInfo, NULL, &storageBuffer->UploadFence);
-	fenceInfo.flags = 0;
-	vkCreateFence(Graphics.Device, &fenceInfo, NULL, &storageBuffer->DownloadFence);
-	
-	return storageBuffer;
+	VmaAllocationCreateInfo allocationInfo =
+	{
+		.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		.usage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+	};
+	VmaAllocationInfo info;
+	VkResult result = vmaCreateBuffer(Graphics.Allocator, &bufferInfo, &allocationInfo, &storageBuffer->HostBuffer, &storageBuffer->HostAllocation, &info);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to map a StorageBuffer, but failed to create the host buffer: %i\n", result);
+		exit(1);
+	}
+	storageBuffer->HostData = info.pMappedData;
+	memset(storageBuffer->HostData, 0, storageBuffer->Size);
 }
 
-void * StorageBufferMapVariable(StorageBuffer storageBuffer, const char * variable)
+static void FindVariable(StorageBuffer storageBuffer, const char * variable, unsigned long * offset, unsigned long * size)
 {
-	void * data;
-	vmaMapMemory(Graphics.Allocator, storageBuffer->StagingAllocation, &data);
-	unsigned long offset = 0;
+	*offset = 0;
+	*size = storageBuffer->Size;
 	for (int i = 0; i < storageBuffer->Info.member_count; i++)
 	{
 		if (strcmp(storageBuffer->Info.members[i].name, variable) == 0)
 		{
-			offset = storageBuffer->Info.members[i].offset;
+			*offset = storageBuffer->Info.members[i].offset;
+			bool runtimeArray = storageBuffer->Info.members[i].type_description->op == SpvOpTypeRuntimeArray;
+			*size = runtimeArray ? storageBuffer->Size - *offset : storageBuffer->Info.members[i].size;
 		}
 	}
-	return (unsigned char *)data + offset;
+}
+
+void * StorageBufferMapVariable(StorageBuffer storageBuffer, const char * variable)
+{
+	unsigned long offset, size;
+	FindVariable(storageBuffer, variable, &offset, &size);
+	if (storageBuffer->HostBuffer == VK_NULL_HANDLE) { CreateHostBuffer(storageBuffer); }
+	return storageBuffer->HostData + offset;
 }
 
 void StorageBufferUnmapVariable(StorageBuffer storageBuffer)
 {
-	vmaUnmapMemory(Graphics.Allocator, storageBuffer->StagingAllocation);
+	// The host buffer is persistently mapped
 }
 
 void StorageBufferUpload(StorageBuffer storageBuffer)
 {
-	vkWaitForFences(Graphics.Device, 1, &storageBuffer->UploadFence, VK_TRUE, UINT64_MAX);
-	vkResetFences(Graphics.Device, 1, &storageBuffer->UploadFence);
-	
-	VkCommandBufferBeginInfo beginInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
-	
-	vkBeginCommandBuffer(storageBuffer->UploadCommandBuffer, &beginInfo);
-	VkBufferCopy copyInfo =
-	{
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = storageBuffer->Size,
-	};
-	vkCmdCopyBuffer(storageBuffer->UploadCommandBuffer, storageBuffer->StagingBuffer, storageBuffer->Buffer, 1, &copyInfo);
-	vkEndCommandBuffer(storageBuffer->UploadCommandBuffer);
-	
-	VkSubmitInfo submitInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &storageBuffer->UploadCommandBuffer,
-		.signalSemaphoreCount = 0,
-		.pSignalSemaphores = NULL,
-	};
-	vkQueueSubmit(Graphics.GraphicsQueue, 1, &submitInfo, storageBuffer->UploadFence);
+	if (storageBuffer->HostBuffer == VK_NULL_HANDLE) { return; }
+	// The copy runs when the batch is submitted, so the host data is staged now to keep later writes out of it
+	UploadStaging staging = UploadAllocateStaging(storageBuffer->Size);
+	memcpy(staging.Data, storageBuffer->HostData, storageBuffer->Size);
+	UploadBuffer(staging.Buffer, staging.Offset, storageBuffer->Buffer, 0, storageBuffer->Size, false);
+	UploadReleaseStaging(staging);
+}
+
+void StorageBufferUploadVariable(StorageBuffer storageBuffer, const char * variable, const void * data, unsigned long size)
+{
+	unsigned long offset, variableSize;
+	FindVariable(storageBuffer, variable, &offset, &variableSize);
+	if (size > variableSize) { size = variableSize; }
+	if (size == 0) { return; }
+	// A mapped host copy is kept up to date so a later StorageBufferUpload doesn't revert the variable
+	if (storageBuffer->HostBuffer != VK_NULL_HANDLE) { memcpy(storageBuffer->HostData + offset, data, size); }
+	UploadStaging staging = UploadAllocateStaging(size);
+	memcpy(staging.Data, data, size);
+	UploadBuffer(staging.Buffer, staging.Offset, storageBuffer->Buffer, offset, size, false);
+	UploadReleaseStaging(staging);
 }
 
 void StorageBufferDownload(StorageBuffer storageBuffer)
 {
+	// Pending uploads have to land before the buffer is read back
+	UploadWait();
+	// Compute runs on its own queue, so the copy doesn't wait on it by submission order
+	uint64_t computeValue = 0;
+	for (int i = 0; i < Graphics.FrameResourceCount; i++)
+	{
+		if (Graphics.FrameResources[i].ComputeValue > computeValue) { computeValue = Graphics.FrameResources[i].ComputeValue; }
+	}
+	TimelineWait(computeValue);
+	if (storageBuffer->HostBuffer == VK_NULL_HANDLE) { CreateHostBuffer(storageBuffer); }
+	
 	VkCommandBufferBeginInfo beginInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 	};
 	
-	vkBeginCommandBuffer(storageBuffer->UploadCommandBuffer, &beginInfo);
+	vkBeginCommandBuffer(storageBuffer->DownloadCommandBuffer, &beginInfo);
 	VkBufferCopy copyInfo =
 	{
 		.srcOffset = 0,
 		.dstOffset = 0,
 		.size = storageBuffer->Size,
 	};
-	vkCmdCopyBuffer(storageBuffer->UploadCommandBuffer, storageBuffer->Buffer, storageBuffer->StagingBuffer, 1, &copyInfo);
-	vkEndCommandBuffer(storageBuffer->UploadCommandBuffer);
+	vkCmdCopyBuffer(storageBuffer->DownloadCommandBuffer, storageBuffer->Buffer, storageBuffer->HostBuffer, 1, &copyInfo);
+	vkEndCommandBuffer(storageBuffer->DownloadCommandBuffer);
 	
 	VkSubmitInfo submitInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 		.commandBufferCount = 1,
-		.pCommandBuffers = &storageBuffer->UploadCommandBuffer,
+		.pCommandBuffers = &storageBuffer->DownloadCommandBuffer,
 		.signalSemaphoreCount = 0,
 		.pSignalSemaphores = NULL,
 	};
-	vkQueueSubmit(Graphics.GraphicsQueue, 1, &submitInfo, storageBuffer->DownloadFence);
-	vkWaitForFences(Graphics.Device, 1, &storageBuffer->DownloadFence, VK_TRUE, UINT64_MAX);
+	TimelineWait(TimelineSubmit(Graphics.GraphicsQueue, &submitInfo, false));
+	vmaInvalidateAllocation(Graphics.Allocator, storageBuffer->HostAllocation, 0, VK_WHOLE_SIZE);
 }
 
 void StorageBufferQueueDestroy(StorageBuffer storageBuffer)
 {
-	ListPush(Graphics.FrameResources[Graphics.FrameIndex].Queues[GraphicsQueueDestroyStorageBuffer], storageBuffer);
+	TimelineRetire(storageBuffer, (TimelineDestroyFunction)StorageBufferDestroy);
 }
 
 void StorageBufferDestroy(StorageBuffer storageBuffer)
 {
-	vkWaitForFences(Graphics.Device, 1, &storageBuffer->UploadFence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(Graphics.Device, storageBuffer->UploadFence, NULL);
-	vkDestroyFence(Graphics.Device, storageBuffer->DownloadFence, NULL);
-	vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, 1, &storageBuffer->UploadCommandBuffer);
 	vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, 1, &storageBuffer->DownloadCommandBuffer);
-	vmaDestroyBuffer(Graphics.Allocator, storageBuffer->StagingBuffer, storageBuffer->StagingAllocation);
+	if (storageBuffer->HostBuffer != VK_NULL_HANDLE) { vmaDestroyBuffer(Graphics.Allocator, storageBuffer->HostBuffer, storageBuffer->HostAllocation); }
 	vmaDestroyBuffer(Graphics.Allocator, storageBuffer->Buffer, storageBuffer->Allocation);
 	free(storageBuffer);
 }
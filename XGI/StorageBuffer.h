@@ -4,6 +4,7 @@
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 #include "Pipeline.h"
+#include "List.h"
 
 struct Pipeline;
 
@@ -11,18 +12,17 @@ typedef struct StorageBuffer
 {
 	SpvReflectBlockVariable Info;
 	unsigned long Size;
-	VkBuffer StagingBuffer;
-	VmaAllocation StagingAllocation;
 	VkBuffer Buffer;
 	VmaAllocation Allocation;
-	VkCommandBuffer UploadCommandBuffer;
+	VkBuffer HostBuffer;
+	VmaAllocation HostAllocation;
+	unsigned char * HostData;
 	VkCommandBuffer DownloadCommandBuffer;
-	VkFence UploadFence;
-	VkFence DownloadFence;
 } * StorageBuffer;
 
 /// Creates a storage buffer for use in shaders.
 /// The buffer can work for multiple pipelines and bindings, it just needs to view one as a template for the variable structure.
+/// The buffer can also hold the draw commands for GraphicsRenderIndirect and GraphicsRenderIndexedIndirectCount.
 /// \param pipeline The template pipeline used to determine variable locations
 /// \param binding The binding in the pipeline to make the template for.
 /// \param instances The number of instances to use for array variables.
@@ -31,20 +31,30 @@ StorageBuffer StorageBufferCreate(struct Pipeline * pipeline, int binding, int i
 
 /// Returns a pointer to the memory for the storage buffer, at the offset of the given variable.
 /// Only one variable should be mapped at a time, do not call this again unless StorageBufferUnmapVariable has been called.
+/// The first map creates a host copy of the buffer that keeps its contents between uploads and is overwritten by StorageBufferDownload.
 /// \param storageBuffer The storage buffer to map memory to
 /// \param variable The name of the variable to map from the template pipeline binding supplied
 /// \return A pointer to the memory of the storage buffer
 void * StorageBufferMapVariable(StorageBuffer storageBuffer, const char * variable);
 
-/// Must be called after StorageBufferMapVertices.
+/// Must be called after StorageBufferMapVariable.
 /// \param storageBuffer The storage buffer to unmap.
 void StorageBufferUnmapVariable(StorageBuffer storageBuffer);
 
-/// Pushes the memory staged in StorageBufferMapVariable to the GPU for use in shaders.
+/// Pushes the host copy written through StorageBufferMapVariable to the GPU for use in shaders.
+/// Nothing is copied if the buffer has never been mapped or downloaded.
 /// \param storageBuffer The storage buffer to upload
 void StorageBufferUpload(StorageBuffer storageBuffer);
 
-/// Retrieves the memory from the gpu into the staging buffer so it may be read from StorageBufferMapVariable.
+/// Copies a variable to the GPU through the shared staging memory.
+/// Buffers that are only written with this never keep a host copy.
+/// \param storageBuffer The storage buffer to upload to
+/// \param variable The name of the variable to write from the template pipeline binding supplied
+/// \param data A pointer to the memory to copy
+/// \param size The number of bytes to copy from the start of the variable, it's clamped to the variable's size
+void StorageBufferUploadVariable(StorageBuffer storageBuffer, const char * variable, const void * data, unsigned long size);
+
+/// Retrieves the memory from the gpu into the host copy so it may be read from StorageBufferMapVariable.
 /// \param storageBuffer The storage buffer to download
 void StorageBufferDownload(StorageBuffer storageBuffer);
 
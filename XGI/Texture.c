@@ -5,6 +5,8 @@
 #include "Texture.h"
 #include "Graphics.h"
 #include "File.h"
+#include "Upload.h"
+#include "Timeline.h"
 #include "log.h"
 
 TextureData TextureDataFromFile(const char * fileName)
@@ -36,7 +38,7 @@ void TextureDataDestroy(TextureData data)
 	stbi_image_free(data.Pixels);
 }
 
-static void CreateImage(Texture texture)
+static void CreateImage(Texture texture, bool unbound)
 {
 	VkImageUsageFlags usage = texture->Format == TextureFormatColor ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
 	VkImageCreateInfo imageInfo =
@@ -62,8 +64,10 @@ static void CreateImage(Texture texture)
 	{
 		.usage = VMA_MEMORY_USAGE_GPU_ONLY,
 	};
-	VkResult result = vmaCreateImage(Graphics.Allocator, &imageInfo, &allocationInfo, &texture->Image, &texture->Allocation, NULL);
-
+	VkResult result;
+	if (unbound) { result = vkCreateImage(Graphics.Device, &imageInfo, NULL, &texture->Image); }
+	else { result = vmaCreateImage(Graphics.Allocator, &imageInfo, &allocationInfo, &texture->Image, &texture->Allocation, NULL); }
+	
 	if (result != VK_SUCCESS)
 	{
 		log_fatal("Failed to create image: %i", result);
@@ -71,142 +75,30 @@ static void CreateImage(Texture texture)
 	}
 }
 
-static void TransitionImageLayout(Texture texture)
+static void CopyImageData(Texture texture, TextureConfigure config)
 {
-	VkCommandBuffer commandBuffer;
-	VkCommandBufferAllocateInfo commandAllocateInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandPool = Graphics.CommandPool,
-		.commandBufferCount = 1,
-	};
-	vkAllocateCommandBuffers(Graphics.Device, &commandAllocateInfo, &commandBuffer);
-	VkCommandBufferBeginInfo beginInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-	
 	VkImageAspectFlags imageAspect = texture->Format == TextureFormatColor ? VK_IMAGE_ASPECT_COLOR_BIT : VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-	VkImageMemoryBarrier barrier =
+	if (!config.LoadFromData)
 	{
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image = texture->Image,
-		.subresourceRange =
-		{
-			.aspectMask = imageAspect,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-		},
-	};
-	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
-	vkEndCommandBuffer(commandBuffer);
+		UploadImage(VK_NULL_HANDLE, 0, texture->Image, imageAspect, texture->Width, texture->Height, texture->Layout);
+		return;
+	}
 	
-	VkFence fence;
-	VkFenceCreateInfo fenceInfo = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-	vkCreateFence(Graphics.Device, &fenceInfo, NULL, &fence);
-	VkSubmitInfo submitInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &commandBuffer,
-	};
-	vkQueueSubmit(Graphics.GraphicsQueue, 1, &submitInfo, fence);
-	vkWaitForFences(Graphics.Device, 1, &fence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(Graphics.Device, fence, NULL);
-	vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, 1, &commandBuffer);
-}
-
-static void CopyImageData(Texture texture, TextureConfigure config)
-{
 	texture->Width = config.Data.Width;
 	texture->Height = config.Data.Height;
 	unsigned int size = texture->Width * texture->Height * 4;
 	
-	VkBuffer stagingBuffer;
-	VmaAllocation stagingAllocation;
-	VkBufferCreateInfo stagingInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size = size,
-		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-	};
-	VmaAllocationCreateInfo stagingAllocationInfo =
-	{
-		.usage = VMA_MEMORY_USAGE_CPU_ONLY,
-	};
-	vmaCreateBuffer(Graphics.Allocator, &stagingInfo, &stagingAllocationInfo, &stagingBuffer, &stagingAllocation, NULL);
-	
-	void * data;
-	vmaMapMemory(Graphics.Allocator, stagingAllocation, &data);
-	memcpy(data, config.Data.Pixels, size);
-	vmaUnmapMemory(Graphics.Allocator, stagingAllocation);
-	
-	VkCommandBuffer commandBuffer;
-	VkCommandBufferAllocateInfo commandAllocateInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandPool = Graphics.CommandPool,
-		.commandBufferCount = 1,
-	};
-	vkAllocateCommandBuffers(Graphics.Device, &commandAllocateInfo, &commandBuffer);
-	VkCommandBufferBeginInfo beginInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-	
-	VkBufferImageCopy copy =
-	{
-		.bufferOffset = 0,
-		.bufferImageHeight = 0,
-		.bufferRowLength = 0,
-		.imageOffset = { 0, 0, 0 },
-		.imageExtent = { texture->Width, texture->Height, 1 },
-		.imageSubresource =
-		{
-			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.mipLevel = 0,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-		}
-	};
-	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, texture->Image, VK_IMAGE_LAYOUT_GENERAL, 1, &copy);
-	
-	vkEndCommandBuffer(commandBuffer);
-	VkSubmitInfo submitInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &commandBuffer,
-		.signalSemaphoreCount = 0,
-		.pSignalSemaphores = NULL,
-	};
-	VkFence fence;
-	VkFenceCreateInfo fenceInfo = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-	vkCreateFence(Graphics.Device, &fenceInfo, NULL, &fence);
-	vkQueueSubmit(Graphics.GraphicsQueue, 1, &submitInfo, fence);
+	UploadStaging staging = UploadAllocateStaging(size);
+	memcpy(staging.Data, config.Data.Pixels, size);
 	
-	vkWaitForFences(Graphics.Device, 1, &fence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(Graphics.Device, fence, NULL);
-	vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, 1, &commandBuffer);
-	vmaDestroyBuffer(Graphics.Allocator, stagingBuffer, stagingAllocation);
+	// The copy is submitted with the next frame, the staging memory is reused once the copy has finished
+	UploadImage(staging.Buffer, staging.Offset, texture->Image, imageAspect, texture->Width, texture->Height, texture->Layout);
+	UploadReleaseStaging(staging);
 }
 
 static void CreateImageView(Texture texture)
 {
-	VkImageAspectFlags imageAspect = texture->Format == TextureFormatColor ? VK_IMAGE_ASPECT_COLOR_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+	VkImageAspectFlags imageAspect = texture->Format == TextureFormatDepthStencil ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
 	VkImageViewCreateInfo createInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -257,32 +149,115 @@ static void CreateSampler(Texture texture, TextureConfigure config)
 
 Texture TextureCreate(TextureConfigure config)
 {
+	if (config.Unbound && config.LoadFromData)
+	{
+		log_fatal("Trying to create a Texture object without memory, but it can't be loaded from data.\n");
+		exit(1);
+	}
 	Texture texture = malloc(sizeof(struct Texture));
 	*texture = (struct Texture)
 	{
 		.Width = config.LoadFromData ? config.Data.Width : config.Width,
 		.Height = config.LoadFromData ? config.Data.Height : config.Height,
 		.Format = config.Format,
+		.External = false,
+		.IdleLayout = TextureShaderLayout(config.Format),
+		// Unbound textures are transitioned by whoever binds their memory
+		.Layout = config.Unbound ? VK_IMAGE_LAYOUT_UNDEFINED : TextureShaderLayout(config.Format),
+		.Stages = TextureShaderStages,
+		.Access = 0,
 	};
 	
-	CreateImage(texture);
-	TransitionImageLayout(texture);
-	if (config.LoadFromData) { CopyImageData(texture, config); }
-	CreateImageView(texture);
+	CreateImage(texture, config.Unbound);
 	CreateSampler(texture, config);
+	if (config.Unbound) { return texture; }
+	CopyImageData(texture, config);
+	CreateImageView(texture);
 	
 	return texture;
 }
 
+Texture TextureCreateFromImage(VkImage image, VkFormat format, unsigned int width, unsigned int height, VkImageLayout idleLayout)
+{
+	Texture texture = malloc(sizeof(struct Texture));
+	*texture = (struct Texture)
+	{
+		.Width = width,
+		.Height = height,
+		.Format = (TextureFormat)format,
+		.Image = image,
+		.External = true,
+		.IdleLayout = idleLayout,
+		.Layout = idleLayout,
+		.Stages = 0,
+		.Access = 0,
+		.Allocation = VK_NULL_HANDLE,
+		.Sampler = VK_NULL_HANDLE,
+	};
+	CreateImageView(texture);
+	return texture;
+}
+
+void TextureBindMemory(Texture texture, VmaAllocation allocation)
+{
+	if (texture->Allocation != VK_NULL_HANDLE || texture->ImageView != VK_NULL_HANDLE)
+	{
+		log_fatal("Trying to bind memory to a Texture object that already has memory.\n");
+		exit(1);
+	}
+	VkResult result = vmaBindImageMemory(Graphics.Allocator, allocation, texture->Image);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Failed to bind texture memory: %i", result);
+		exit(1);
+	}
+	CreateImageView(texture);
+}
+
+void TextureTransition(Texture texture, VkCommandBuffer commandBuffer, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	const VkAccessFlags writeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	if (texture->Layout == layout && (texture->Access & writeAccess) == 0 && (access & writeAccess) == 0)
+	{
+		texture->Stages |= stages;
+		return;
+	}
+	
+	VkImageMemoryBarrier barrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = texture->Access & writeAccess,
+		.dstAccessMask = access,
+		.oldLayout = texture->Layout,
+		.newLayout = layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = texture->Image,
+		.subresourceRange =
+		{
+			.aspectMask = texture->Format == TextureFormatDepthStencil ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+	};
+	VkPipelineStageFlags sourceStages = texture->Stages == 0 ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : texture->Stages;
+	vkCmdPipelineBarrier(commandBuffer, sourceStages, stages, 0, 0, NULL, 0, NULL, 1, &barrier);
+	texture->Layout = layout;
+	texture->Stages = stages;
+	texture->Access = access;
+}
+
 void TextureQueueDestroy(Texture texture)
 {
-	ListPush(Graphics.FrameResources[Graphics.FrameIndex].Queues[GraphicsQueueDestroyTexture], texture);
+	TimelineRetire(texture, (TimelineDestroyFunction)TextureDestroy);
 }
 
 void TextureDestroy(Texture texture)
 {
 	vkDestroySampler(Graphics.Device, texture->Sampler, NULL);
 	vkDestroyImageView(Graphics.Device, texture->ImageView, NULL);
-	vmaDestroyImage(Graphics.Allocator, texture->Image, texture->Allocation);
+	if (!texture->External) { vmaDestroyImage(Graphics.Allocator, texture->Image, texture->Allocation); }
 	free(texture);
 }
@@ -29,6 +29,17 @@ typedef enum TextureFormat
 	TextureFormatCount,
 } TextureFormat;
 
+/// The stages that may sample a texture or copy from it while it's in its shader layout
+#define TextureShaderStages (VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT)
+
+/// Gets the layout that textures of a format rest in between uses, it's the layout they're sampled in.
+/// \param format The format of the texture
+/// \return The layout of the texture outside of render passes and copies
+static inline VkImageLayout TextureShaderLayout(TextureFormat format)
+{
+	return format == TextureFormatDepthStencil ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
 typedef enum TextureFilter
 {
 	/// Linearly interpolates sampling when the texture is scaled up
@@ -74,6 +85,9 @@ typedef struct TextureConfigure
 	bool LoadFromData;
 	/// The texture data object used if LoadFromData is true
 	TextureData Data;
+	/// Whether or not the texture is created without memory, so the memory can be shared with other textures.
+	/// The texture can't be used until its memory is bound with TextureBindMemory, and it can't be loaded from data.
+	bool Unbound;
 } TextureConfigure;
 
 typedef struct Texture
@@ -81,6 +95,14 @@ typedef struct Texture
 	unsigned int Width, Height;
 	TextureFormat Format;
 	VkImage Image;
+	/// Whether or not the image is owned by something else, like the swapchain
+	bool External;
+	/// The layout the image is left in between uses
+	VkImageLayout IdleLayout;
+	/// The layout the image is in after the commands recorded so far, along with the stages and access of its last use
+	VkImageLayout Layout;
+	VkPipelineStageFlags Stages;
+	VkAccessFlags Access;
 	VmaAllocation Allocation;
 	VkImageView ImageView;
 	VkSampler Sampler;
@@ -91,6 +113,33 @@ typedef struct Texture
 /// \return The texture object created
 Texture TextureCreate(TextureConfigure config);
 
+/// Creates a color texture object around an image that is owned by something else, like a swapchain image.
+/// The texture can be rendered to and copied to, the image isn't destroyed with the texture.
+/// \param image The image to use
+/// \param format The format of the image, it doesn't need to be one of the texture formats
+/// \param width The width of the image
+/// \param height The height of the image
+/// \param idleLayout The layout the image is in now, and that it's left in between uses
+/// \return The texture object created
+Texture TextureCreateFromImage(VkImage image, VkFormat format, unsigned int width, unsigned int height, VkImageLayout idleLayout);
+
+/// Binds memory to a texture that was created unbound and creates its image view.
+/// The memory is still owned by the caller, and the contents and layout of the texture are undefined until it's transitioned.
+/// \param texture The texture to bind the memory to
+/// \param allocation The memory to bind, it must fit the memory requirements of the texture's image
+void TextureBindMemory(Texture texture, VmaAllocation allocation);
+
+/// Records a barrier that moves a texture from its current layout to another, waiting on the texture's last use.
+/// Nothing is recorded if both the last use and the next only read in the same layout.
+/// Textures must be moved back to their idle layout when they're done, since that's the layout they're sampled and rendered from.
+/// This should only be called outside of GraphicsBegin and GraphicsEnd.
+/// \param texture The texture to transition
+/// \param commandBuffer The command buffer to record the barrier into
+/// \param layout The layout to move the texture to
+/// \param stages The stages that will use the texture next
+/// \param access The access that the next use has
+void TextureTransition(Texture texture, VkCommandBuffer commandBuffer, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access);
+
 /// Places the texture into a queue to be destroyed.
 /// This should only be called if the texture needs to be destroyed at render-time
 /// \param texture The texture to destroy
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "Timeline.h"
+#include "Graphics.h"
+#include "log.h"
+
+struct Timeline Timeline = { 0 };
+
+void TimelineInitialize()
+{
+	Timeline.SubmittedValue = 0;
+	Timeline.CompletedValue = 0;
+	Timeline.PendingCount = 0;
+	Timeline.PendingCapacity = 0;
+	Timeline.Pending = NULL;
+	Timeline.FreeFences = ListCreate();
+	Timeline.RetiredCount = 0;
+	Timeline.RetiredCapacity = 0;
+	Timeline.FrameRetiredCount = 0;
+	Timeline.Retired = NULL;
+}
+
+static VkFence AcquireFence()
+{
+	if (Timeline.FreeFences->Count > 0)
+	{
+		VkFence fence = ListIndex(Timeline.FreeFences, Timeline.FreeFences->Count - 1);
+		ListPop(Timeline.FreeFences);
+		return fence;
+	}
+	VkFenceCreateInfo fenceInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = 0,
+	};
+	VkFence fence;
+	VkResult result = vkCreateFence(Graphics.Device, &fenceInfo, NULL, &fence);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to submit to a queue, but failed to create VkFence: %i\n", result);
+		exit(1);
+	}
+	return fence;
+}
+
+uint64_t TimelineSubmit(VkQueue queue, const VkSubmitInfo * submitInfo, bool endsFrame)
+{
+	VkFence fence = AcquireFence();
+	VkResult result = vkQueueSubmit(queue, 1, submitInfo, fence);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to submit to a queue, but failed to submit: %i\n", result);
+		exit(1);
+	}
+	
+	if (Timeline.PendingCount == Timeline.PendingCapacity)
+	{
+		Timeline.PendingCapacity = Timeline.PendingCapacity == 0 ? 16 : 2 * Timeline.PendingCapacity;
+		Timeline.Pending = realloc(Timeline.Pending, Timeline.PendingCapacity * sizeof(struct TimelinePending));
+	}
+	uint64_t value = ++Timeline.SubmittedValue;
+	Timeline.Pending[Timeline.PendingCount++] = (struct TimelinePending)
+	{
+		.Value = value,
+		.Fence = fence,
+	};
+	
+	if (endsFrame)
+	{
+		// The objects retired during the frame are at the end of the retire queue
+		for (int i = Timeline.RetiredCount - Timeline.FrameRetiredCount; i < Timeline.RetiredCount; i++) { Timeline.Retired[i].Value = value; }
+		Timeline.FrameRetiredCount = 0;
+	}
+	return value;
+}
+
+uint64_t TimelineCompletedValue()
+{
+	int count = 0;
+	for (int i = 0; i < Timeline.PendingCount; i++)
+	{
+		struct TimelinePending pending = Timeline.Pending[i];
+		if (vkGetFenceStatus(Graphics.Device, pending.Fence) == VK_SUCCESS)
+		{
+			vkResetFences(Graphics.Device, 1, &pending.Fence);
+			ListPush(Timeline.FreeFences, pending.Fence);
+		}
+		else { Timeline.Pending[count++] = pending; }
+	}
+	Timeline.PendingCount = count;
+	// Submits to different queues can finish out of order, so the timeline only reaches the oldest unfinished submit
+	Timeline.CompletedValue = count == 0 ? Timeline.SubmittedValue : Timeline.Pending[0].Value - 1;
+	return Timeline.CompletedValue;
+}
+
+void TimelineWait(uint64_t value)
+{
+	if (value <= Timeline.CompletedValue) { return; }
+	for (int i = 0; i < Timeline.PendingCount && Timeline.Pending[i].Value <= value; i++)
+	{
+		vkWaitForFences(Graphics.Device, 1, &Timeline.Pending[i].Fence, VK_TRUE, UINT64_MAX);
+	}
+	TimelineCompletedValue();
+}
+
+void TimelineRetire(void * object, TimelineDestroyFunction destroy)
+{
+	if (Timeline.RetiredCount == Timeline.RetiredCapacity)
+	{
+		Timeline.RetiredCapacity = Timeline.RetiredCapacity == 0 ? 16 : 2 * Timeline.RetiredCapacity;
+		Timeline.Retired = realloc(Timeline.Retired, Timeline.RetiredCapacity * sizeof(struct TimelineRetired));
+	}
+	// The value is set once the frame is submitted
+	Timeline.Retired[Timeline.RetiredCount++] = (struct TimelineRetired)
+	{
+		.Value = UINT64_MAX,
+		.Object = object,
+		.Destroy = destroy,
+	};
+	Timeline.FrameRetiredCount++;
+}
+
+bool TimelineRetiring(void * object)
+{
+	for (int i = 0; i < Timeline.RetiredCount; i++)
+	{
+		if (Timeline.Retired[i].Object == object) { return true; }
+	}
+	return false;
+}
+
+void TimelineCollect()
+{
+	uint64_t completed = TimelineCompletedValue();
+	// Objects are retired in frame order, so the first unfinished object ends the collection
+	int count = 0;
+	for (; count < Timeline.RetiredCount && Timeline.Retired[count].Value <= completed; count++)
+	{
+		Timeline.Retired[count].Destroy(Timeline.Retired[count].Object);
+	}
+	for (int i = count; i < Timeline.RetiredCount; i++) { Timeline.Retired[i - count] = Timeline.Retired[i]; }
+	Timeline.RetiredCount -= count;
+}
+
+void TimelineDeinitialize()
+{
+	vkDeviceWaitIdle(Graphics.Device);
+	for (int i = 0; i < Timeline.RetiredCount; i++) { Timeline.Retired[i].Destroy(Timeline.Retired[i].Object); }
+	for (int i = 0; i < Timeline.PendingCount; i++) { vkDestroyFence(Graphics.Device, Timeline.Pending[i].Fence, NULL); }
+	for (int i = 0; i < Timeline.FreeFences->Count; i++) { vkDestroyFence(Graphics.Device, ListIndex(Timeline.FreeFences, i), NULL); }
+	ListDestroy(Timeline.FreeFences);
+	free(Timeline.Pending);
+	free(Timeline.Retired);
+}
@@ -0,0 +1,71 @@
+#ifndef Timeline_h
+#define Timeline_h
+
+#include <vulkan/vulkan.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "List.h"
+
+/// Destroys an object once the gpu is done with it
+typedef void (* TimelineDestroyFunction)(void * object);
+
+struct Timeline
+{
+	uint64_t SubmittedValue;
+	uint64_t CompletedValue;
+	int PendingCount;
+	int PendingCapacity;
+	struct TimelinePending
+	{
+		uint64_t Value;
+		VkFence Fence;
+	} * Pending;
+	List FreeFences;
+	int RetiredCount;
+	int RetiredCapacity;
+	int FrameRetiredCount;
+	struct TimelineRetired
+	{
+		uint64_t Value;
+		void * Object;
+		TimelineDestroyFunction Destroy;
+	} * Retired;
+} extern Timeline;
+
+/// This should not be called by the user, it is called in GraphicsInitialize
+void TimelineInitialize(void);
+
+/// Submits work to a queue and gives the submit the next value on the timeline.
+/// The timeline reaches the value once the submit and every submit before it have finished.
+/// \param queue The queue to submit to
+/// \param submitInfo The work to submit
+/// \param endsFrame Whether or not this submit ends the frame, objects retired since the last frame are destroyed once it finishes
+/// \return The value of the submit
+uint64_t TimelineSubmit(VkQueue queue, const VkSubmitInfo * submitInfo, bool endsFrame);
+
+/// Checks which submits have finished without waiting on the gpu.
+/// \return The highest value that every submit up to has finished
+uint64_t TimelineCompletedValue(void);
+
+/// Waits until the timeline reaches a value.
+/// \param value The value to wait for, 0 returns immediately
+void TimelineWait(uint64_t value);
+
+/// Places an object into the retire queue, it's destroyed once the frame being recorded has finished on the gpu.
+/// \param object The object to destroy
+/// \param destroy The function that destroys the object
+void TimelineRetire(void * object, TimelineDestroyFunction destroy);
+
+/// Checks if an object was already placed into the retire queue.
+/// \param object The object to look for
+/// \return Whether or not the object is waiting to be destroyed
+bool TimelineRetiring(void * object);
+
+/// Destroys every retired object that the gpu has finished with.
+/// This should not be called by the user, it's called in GraphicsUpdate.
+void TimelineCollect(void);
+
+/// This should not be called by the user, it is called in GraphicsDeinitialize
+void TimelineDeinitialize(void);
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include "UniformBuffer.h"
 #include "Graphics.h"
+#include "Timeline.h"
 
 UniformBuffer UniformBufferCreate(Pipeline pipeline, int binding)
 {
@@ -25,11 +26,15 @@ UniformBuffer UniformBufferCreate(Pipeline pipeline, int binding)
 	if (!foundBinding) { abort(); }
 	
 	uniformBuffer->Size = uniformBuffer->Info.size;
+	bool shared = Graphics.SharedQueueCount > 1;
 	VkBufferCreateInfo bufferInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.size = uniformBuffer->Info.size,
 		.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		.sharingMode = shared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = shared ? Graphics.SharedQueueCount : 0,
+		.pQueueFamilyIndices = Graphics.SharedQueueIndices,
 	};
 	VmaAllocationCreateInfo allocationInfo =
 	{
@@ -59,7 +64,7 @@ void UniformBufferSetVariable(UniformBuffer uniformBuffer, const char * variable
 
 void UniformBufferQueueDestroy(UniformBuffer uniformBuffer)
 {
-	ListPush(Graphics.FrameResources[Graphics.FrameIndex].Queues[GraphicsQueueDestroyUniformBuffer], uniformBuffer);
+	TimelineRetire(uniformBuffer, (TimelineDestroyFunction)UniformBufferDestroy);
 }
 
 void UniformBufferDestroy(UniformBuffer uniformBuffer)
@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "Upload.h"
+#include "Graphics.h"
+#include "Timeline.h"
+#include "log.h"
+
+struct Upload Upload = { 0 };
+
+void UploadInitialize()
+{
+	VkCommandPoolCreateInfo createInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = Graphics.TransferQueueIndex,
+	};
+	VkResult result = vkCreateCommandPool(Graphics.Device, &createInfo, NULL, &Upload.CommandPool);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to initialize Graphics, but failed to create transfer VkCommandPool: %i\n", result);
+		exit(1);
+	}
+	
+	for (int i = 0; i < UploadBatchCount; i++)
+	{
+		VkCommandBufferAllocateInfo allocateInfo =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandPool = Upload.CommandPool,
+			.commandBufferCount = 1,
+		};
+		vkAllocateCommandBuffers(Graphics.Device, &allocateInfo, &Upload.Batches[i].CommandBuffer);
+	
+		VkSemaphoreCreateInfo semaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		vkCreateSemaphore(Graphics.Device, &semaphoreInfo, NULL, &Upload.Batches[i].Finished);
+		Upload.Batches[i].Value = 0;
+	
+		Upload.Batches[i].Recording = false;
+		Upload.Batches[i].StagingBuffers = ListCreate();
+		Upload.Batches[i].StagingAllocations = ListCreate();
+	}
+	Upload.BatchIndex = 0;
+	Upload.SubmittedValue = 0;
+	
+	VkBufferCreateInfo stagingInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = UploadStagingSize,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VmaAllocationCreateInfo stagingAllocationInfo =
+	{
+		.usage = VMA_MEMORY_USAGE_CPU_ONLY,
+		.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+	};
+	VmaAllocationInfo info;
+	result = vmaCreateBuffer(Graphics.Allocator, &stagingInfo, &stagingAllocationInfo, &Upload.StagingBuffer, &Upload.StagingAllocation, &info);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to initialize Graphics, but failed to create the staging buffer: %i\n", result);
+		exit(1);
+	}
+	Upload.StagingData = info.pMappedData;
+	Upload.StagingHead = 0;
+	Upload.OutstandingStagingCount = 0;
+	
+	Upload.BufferAcquireCount = 0;
+	Upload.BufferAcquireCapacity = 0;
+	Upload.BufferAcquires = NULL;
+	Upload.ImageAcquireCount = 0;
+	Upload.ImageAcquireCapacity = 0;
+	Upload.ImageAcquires = NULL;
+	Upload.AcquireCommandBuffers = malloc(Graphics.FrameResourceCount * sizeof(VkCommandBuffer));
+	VkCommandBufferAllocateInfo allocateInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandPool = Graphics.CommandPool,
+		.commandBufferCount = Graphics.FrameResourceCount,
+	};
+	vkAllocateCommandBuffers(Graphics.Device, &allocateInfo, Upload.AcquireCommandBuffers);
+}
+
+static void DestroyStaging(struct UploadBatch * batch)
+{
+	for (int i = 0; i < batch->StagingBuffers->Count; i++)
+	{
+		vmaDestroyBuffer(Graphics.Allocator, ListIndex(batch->StagingBuffers, i), ListIndex(batch->StagingAllocations, i));
+	}
+	ListClear(batch->StagingBuffers);
+	ListClear(batch->StagingAllocations);
+}
+
+static struct UploadBatch * BeginBatch()
+{
+	struct UploadBatch * batch = Upload.Batches + Upload.BatchIndex;
+	if (batch->Recording) { return batch; }
+	
+	// The batch was submitted UploadBatchCount flushes ago, so this rarely waits
+	TimelineWait(batch->Value);
+	DestroyStaging(batch);
+	// Staging memory that was allocated before the last flush but not yet copied from belongs to this batch too
+	batch->HasStaging = false;
+	batch->StagingBegin = Upload.OutstandingStagingCount > 0 ? Upload.OutstandingStagingBegin : Upload.StagingHead;
+	vkResetCommandBuffer(batch->CommandBuffer, 0);
+	VkCommandBufferBeginInfo beginInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	vkBeginCommandBuffer(batch->CommandBuffer, &beginInfo);
+	batch->Recording = true;
+	return batch;
+}
+
+static bool RangesOverlap(VkDeviceSize begin, VkDeviceSize end, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (begin == end) { return false; }
+	// Ranges of the ring that wrap around cover the end and the start of the buffer
+	if (begin < end) { return offset < end && offset + size > begin; }
+	return offset + size > begin || offset < end;
+}
+
+static UploadStaging AllocateTemporaryStaging(VkDeviceSize size)
+{
+	UploadStaging staging = { .Offset = 0, .Size = size };
+	VkBufferCreateInfo stagingInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VmaAllocationCreateInfo stagingAllocationInfo =
+	{
+		.usage = VMA_MEMORY_USAGE_CPU_ONLY,
+		.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+	};
+	VmaAllocationInfo info;
+	VkResult result = vmaCreateBuffer(Graphics.Allocator, &stagingInfo, &stagingAllocationInfo, &staging.Buffer, &staging.Allocation, &info);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to allocate %lu bytes of staging memory, but failed to create a buffer: %i\n", (unsigned long)size, result);
+		exit(1);
+	}
+	staging.Data = info.pMappedData;
+	return staging;
+}
+
+UploadStaging UploadAllocateStaging(VkDeviceSize size)
+{
+	struct UploadBatch * current = BeginBatch();
+	VkDeviceSize alignedSize = (size + UploadStagingAlignment - 1) / UploadStagingAlignment * UploadStagingAlignment;
+	if (alignedSize > UploadStagingSize) { return AllocateTemporaryStaging(size); }
+	
+	VkDeviceSize offset = Upload.StagingHead;
+	if (offset + alignedSize > UploadStagingSize) { offset = 0; }
+	// Memory that the current batch hasn't submitted yet can't be waited on, so the ring is full
+	bool currentFull = Upload.StagingHead != current->StagingBegin && offset + alignedSize == current->StagingBegin;
+	if (currentFull || RangesOverlap(current->StagingBegin, Upload.StagingHead, offset, alignedSize)) { return AllocateTemporaryStaging(size); }
+	for (int i = 0; i < UploadBatchCount; i++)
+	{
+		struct UploadBatch * batch = Upload.Batches + i;
+		if (batch == current || !batch->HasStaging) { continue; }
+		if (RangesOverlap(batch->StagingBegin, batch->StagingEnd, offset, alignedSize))
+		{
+			TimelineWait(batch->Value);
+			batch->HasStaging = false;
+		}
+	}
+	
+	Upload.StagingHead = offset + alignedSize;
+	if (Upload.OutstandingStagingCount++ == 0) { Upload.OutstandingStagingBegin = offset; }
+	return (UploadStaging)
+	{
+		.Buffer = Upload.StagingBuffer,
+		.Offset = offset,
+		.Size = size,
+		.Data = Upload.StagingData + offset,
+		.Allocation = NULL,
+	};
+}
+
+void UploadBuffer(VkBuffer source, VkDeviceSize sourceOffset, VkBuffer destination, VkDeviceSize destinationOffset, VkDeviceSize size, bool transferOwnership)
+{
+	struct UploadBatch * batch = BeginBatch();
+	VkBufferCopy copyInfo =
+	{
+		.srcOffset = sourceOffset,
+		.dstOffset = destinationOffset,
+		.size = size,
+	};
+	vkCmdCopyBuffer(batch->CommandBuffer, source, destination, 1, &copyInfo);
+	
+	if (!transferOwnership || Graphics.TransferQueueIndex == Graphics.GraphicsQueueIndex) { return; }
+	// The whole range is overwritten, so it doesn't need to be acquired back from the graphics queue before the copy
+	VkBufferMemoryBarrier release =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = 0,
+		.srcQueueFamilyIndex = Graphics.TransferQueueIndex,
+		.dstQueueFamilyIndex = Graphics.GraphicsQueueIndex,
+		.buffer = destination,
+		.offset = destinationOffset,
+		.size = size,
+	};
+	vkCmdPipelineBarrier(batch->CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &release, 0, NULL);
+	
+	if (Upload.BufferAcquireCount == Upload.BufferAcquireCapacity)
+	{
+		Upload.BufferAcquireCapacity = Upload.BufferAcquireCapacity == 0 ? 16 : 2 * Upload.BufferAcquireCapacity;
+		Upload.BufferAcquires = realloc(Upload.BufferAcquires, Upload.BufferAcquireCapacity * sizeof(VkBufferMemoryBarrier));
+	}
+	VkBufferMemoryBarrier * acquire = Upload.BufferAcquires + Upload.BufferAcquireCount++;
+	*acquire = release;
+	acquire->srcAccessMask = 0;
+	acquire->dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+}
+
+void UploadImage(VkBuffer source, VkDeviceSize sourceOffset, VkImage image, VkImageAspectFlags aspect, unsigned int width, unsigned int height, VkImageLayout layout)
+{
+	struct UploadBatch * batch = BeginBatch();
+	VkImageMemoryBarrier barrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = source != VK_NULL_HANDLE ? VK_ACCESS_TRANSFER_WRITE_BIT : 0,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = source != VK_NULL_HANDLE ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange =
+		{
+			.aspectMask = aspect,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+	};
+	vkCmdPipelineBarrier(batch->CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+	
+	if (source != VK_NULL_HANDLE)
+	{
+		VkBufferImageCopy copy =
+		{
+			.bufferOffset = sourceOffset,
+			.bufferImageHeight = 0,
+			.bufferRowLength = 0,
+			.imageOffset = { 0, 0, 0 },
+			.imageExtent = { width, height, 1 },
+			.imageSubresource =
+			{
+				.aspectMask = aspect,
+				.mipLevel = 0,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			}
+		};
+		vkCmdCopyBufferToImage(batch->CommandBuffer, source, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+		
+		// The transition to the final layout is ordered before the semaphore the graphics queue waits on
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = layout;
+	}
+	
+	if (Graphics.TransferQueueIndex == Graphics.GraphicsQueueIndex)
+	{
+		if (source != VK_NULL_HANDLE) { vkCmdPipelineBarrier(batch->CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier); }
+		return;
+	}
+	// The release and acquire must describe the same layout transition, an image that wasn't copied to is already in its layout
+	if (source == VK_NULL_HANDLE) { barrier.oldLayout = layout; }
+	barrier.srcQueueFamilyIndex = Graphics.TransferQueueIndex;
+	barrier.dstQueueFamilyIndex = Graphics.GraphicsQueueIndex;
+	vkCmdPipelineBarrier(batch->CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+	
+	if (Upload.ImageAcquireCount == Upload.ImageAcquireCapacity)
+	{
+		Upload.ImageAcquireCapacity = Upload.ImageAcquireCapacity == 0 ? 16 : 2 * Upload.ImageAcquireCapacity;
+		Upload.ImageAcquires = realloc(Upload.ImageAcquires, Upload.ImageAcquireCapacity * sizeof(VkImageMemoryBarrier));
+	}
+	VkImageMemoryBarrier * acquire = Upload.ImageAcquires + Upload.ImageAcquireCount++;
+	*acquire = barrier;
+	acquire->srcAccessMask = 0;
+	acquire->dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+}
+
+void UploadReleaseStaging(UploadStaging staging)
+{
+	struct UploadBatch * batch = BeginBatch();
+	if (staging.Allocation != NULL)
+	{
+		ListPush(batch->StagingBuffers, staging.Buffer);
+		ListPush(batch->StagingAllocations, staging.Allocation);
+		return;
+	}
+	Upload.OutstandingStagingCount--;
+}
+
+VkSemaphore UploadFlush(bool signal)
+{
+	struct UploadBatch * batch = Upload.Batches + Upload.BatchIndex;
+	if (!batch->Recording) { return VK_NULL_HANDLE; }
+	batch->Recording = false;
+	batch->StagingEnd = Upload.StagingHead;
+	batch->HasStaging = batch->StagingBegin != batch->StagingEnd;
+	Upload.BatchIndex = (Upload.BatchIndex + 1) % UploadBatchCount;
+	
+	VkResult result = vkEndCommandBuffer(batch->CommandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		log_fatal("Trying to submit uploads, but failed to record transfer command buffer: %i\n", result);
+		exit(1);
+	}
+	VkSubmitInfo submitInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &batch->CommandBuffer,
+		.signalSemaphoreCount = signal ? 1 : 0,
+		.pSignalSemaphores = &batch->Finished,
+	};
+	batch->Value = TimelineSubmit(Graphics.TransferQueue, &submitInfo, false);
+	Upload.SubmittedValue = batch->Value;
+	return signal ? batch->Finished : VK_NULL_HANDLE;
+}
+
+VkCommandBuffer UploadRecordAcquire()
+{
+	if (Upload.BufferAcquireCount == 0 && Upload.ImageAcquireCount == 0) { return VK_NULL_HANDLE; }
+	
+	VkCommandBuffer commandBuffer = Upload.AcquireCommandBuffers[Graphics.FrameIndex];
+	vkResetCommandBuffer(commandBuffer, 0);
+	VkCommandBufferBeginInfo beginInfo =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	// The source stages match the stages the upload semaphore is waited on at, so the acquire is ordered after the release
+	vkCmdPipelineBarrier(commandBuffer, UploadConsumerStages, UploadConsumerStages, 0, 0, NULL, Upload.BufferAcquireCount, Upload.BufferAcquires, Upload.ImageAcquireCount, Upload.ImageAcquires);
+	vkEndCommandBuffer(commandBuffer);
+	
+	Upload.BufferAcquireCount = 0;
+	Upload.ImageAcquireCount = 0;
+	return commandBuffer;
+}
+
+void UploadWait()
+{
+	UploadFlush(false);
+	TimelineWait(Upload.SubmittedValue);
+	for (int i = 0; i < UploadBatchCount; i++) { Upload.Batches[i].HasStaging = false; }
+}
+
+void UploadDeinitialize()
+{
+	UploadWait();
+	for (int i = 0; i < UploadBatchCount; i++)
+	{
+		DestroyStaging(Upload.Batches + i);
+		ListDestroy(Upload.Batches[i].StagingBuffers);
+		ListDestroy(Upload.Batches[i].StagingAllocations);
+		vkDestroySemaphore(Graphics.Device, Upload.Batches[i].Finished, NULL);
+		vkFreeCommandBuffers(Graphics.Device, Upload.CommandPool, 1, &Upload.Batches[i].CommandBuffer);
+	}
+	free(Upload.BufferAcquires);
+	free(Upload.ImageAcquires);
+	vmaDestroyBuffer(Graphics.Allocator, Upload.StagingBuffer, Upload.StagingAllocation);
+	vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, Graphics.FrameResourceCount, Upload.AcquireCommandBuffers);
+	free(Upload.AcquireCommandBuffers);
+	vkDestroyCommandPool(Graphics.Device, Upload.CommandPool, NULL);
+}
@@ -0,0 +1,116 @@
+#ifndef Upload_h
+#define Upload_h
+
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+#include <stdbool.h>
+#include "List.h"
+
+#define UploadBatchCount 4
+#define UploadStagingSize (32 * 1024 * 1024)
+#define UploadStagingAlignment 256
+
+/// The stages that can consume uploaded data, the graphics submit waits on uploads at these stages
+#define UploadConsumerStages (VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT)
+
+typedef struct UploadStaging
+{
+	/// The buffer that holds the staging memory
+	VkBuffer Buffer;
+	/// The offset of the staging memory in the buffer
+	VkDeviceSize Offset;
+	/// The size of the staging memory
+	VkDeviceSize Size;
+	/// The persistently mapped staging memory
+	void * Data;
+	/// The allocation of a temporary buffer if it didn't fit in the staging ring, otherwise NULL
+	VmaAllocation Allocation;
+} UploadStaging;
+
+struct Upload
+{
+	VkCommandPool CommandPool;
+	struct UploadBatch
+	{
+		VkCommandBuffer CommandBuffer;
+		VkSemaphore Finished;
+		uint64_t Value;
+		bool Recording;
+		bool HasStaging;
+		VkDeviceSize StagingBegin;
+		VkDeviceSize StagingEnd;
+		List StagingBuffers;
+		List StagingAllocations;
+	} Batches[UploadBatchCount];
+	int BatchIndex;
+	uint64_t SubmittedValue;
+	
+	VkBuffer StagingBuffer;
+	VmaAllocation StagingAllocation;
+	unsigned char * StagingData;
+	VkDeviceSize StagingHead;
+	int OutstandingStagingCount;
+	VkDeviceSize OutstandingStagingBegin;
+	
+	int BufferAcquireCount;
+	int BufferAcquireCapacity;
+	VkBufferMemoryBarrier * BufferAcquires;
+	int ImageAcquireCount;
+	int ImageAcquireCapacity;
+	VkImageMemoryBarrier * ImageAcquires;
+	VkCommandBuffer * AcquireCommandBuffers;
+} extern Upload;
+
+/// This should not be called by the user, it is called in GraphicsInitialize
+void UploadInitialize(void);
+
+/// Sub-allocates persistently mapped staging memory from the staging ring.
+/// If the ring is full, a temporary buffer is created instead.
+/// The memory stays reserved until it is handed back with UploadReleaseStaging.
+/// \param size The number of bytes to allocate
+/// \return The staging memory
+UploadStaging UploadAllocateStaging(VkDeviceSize size);
+
+/// Records a copy from staging memory into a device local buffer, the copy is submitted at the next flush.
+/// \param source The staging buffer to copy from
+/// \param sourceOffset The offset in the staging buffer to copy from
+/// \param destination The buffer to copy to
+/// \param destinationOffset The offset in the destination buffer to copy to
+/// \param size The number of bytes to copy
+/// \param transferOwnership Whether or not the destination is exclusively owned by the graphics queue and must be released to it
+void UploadBuffer(VkBuffer source, VkDeviceSize sourceOffset, VkBuffer destination, VkDeviceSize destinationOffset, VkDeviceSize size, bool transferOwnership);
+
+/// Records the transition of a new image to the layout it's used in, and optionally a copy into it.
+/// The image is released to the graphics queue after the copy.
+/// \param source The staging buffer to copy from, or VK_NULL_HANDLE to only transition the image
+/// \param sourceOffset The offset in the staging buffer to copy from
+/// \param image The image to upload to
+/// \param aspect The aspects of the image
+/// \param width The width of the image
+/// \param height The height of the image
+/// \param layout The layout the image is left in
+void UploadImage(VkBuffer source, VkDeviceSize sourceOffset, VkImage image, VkImageAspectFlags aspect, unsigned int width, unsigned int height, VkImageLayout layout);
+
+/// Hands staging memory back to the upload engine once every copy from it has been recorded.
+/// The memory is reused once the copies from it have finished.
+/// \param staging The staging memory to release
+void UploadReleaseStaging(UploadStaging staging);
+
+/// Submits the recorded copies to the transfer queue.
+/// This should not be called by the user, it's called before compute and graphics commands are submitted.
+/// \param signal Whether or not a semaphore should be signaled, it must be waited on by the next submit
+/// \return The semaphore to wait on, or VK_NULL_HANDLE if there was nothing to submit
+VkSemaphore UploadFlush(bool signal);
+
+/// Records the graphics queue side of the ownership transfers of everything uploaded since the last call.
+/// This should not be called by the user, it's called in GraphicsPresent.
+/// \return The command buffer to submit before the graphics commands, or VK_NULL_HANDLE if there's nothing to acquire
+VkCommandBuffer UploadRecordAcquire(void);
+
+/// Submits the recorded copies and waits for every copy to finish.
+void UploadWait(void);
+
+/// This should not be called by the user, it is called in GraphicsDeinitialize
+void UploadDeinitialize(void);
+
+#endif
@@ -3,23 +3,19 @@
 #include <vk_mem_alloc.h>
 #include "Graphics.h"
 #include "VertexBuffer.h"
+#include "Upload.h"
+#include "Timeline.h"
 
-VertexLayout VertexLayoutCreate(int attributeCount, VertexAttribute * attributes)
+static unsigned int AddAttributes(VertexLayout layout, unsigned int binding, int attributeCount, VertexAttribute * attributes, unsigned int * location)
 {
-	VertexLayout layout = malloc(sizeof(struct VertexLayout));
-	*layout = (struct VertexLayout)
-	{
-		.AttributeCount = attributeCount,
-		.Attributes = malloc(attributeCount * sizeof(VkVertexInputAttributeDescription)),
-	};
-	int size = 0;
+	unsigned int size = 0;
 	for (int i = 0; i < attributeCount; i++)
 	{
-		layout->Attributes[i] = (VkVertexInputAttributeDescription)
+		layout->Attributes[layout->AttributeCount++] = (VkVertexInputAttributeDescription)
 		{
-			.binding = 0,
+			.binding = binding,
 			.format = (VkFormat)attributes[i],
-			.location = i,
+			.location = (*location)++,
 			.offset = size,
 		};
 		switch (attributes[i])
@@ -35,16 +31,41 @@ VertexLayout VertexLayoutCreate(int attributeCount, VertexAttribute * attributes
 			case VertexAttributeDouble: size += 8; break;
 		}
 	}
-	layout->Binding = (VkVertexInputBindingDescription)
+	return size;
+}
+
+VertexLayout VertexLayoutCreateInstanced(int attributeCount, VertexAttribute * attributes, int instanceAttributeCount, VertexAttribute * instanceAttributes)
+{
+	VertexLayout layout = malloc(sizeof(struct VertexLayout));
+	*layout = (struct VertexLayout)
+	{
+		.BindingCount = instanceAttributeCount > 0 ? 2 : 1,
+		.AttributeCount = 0,
+		.Attributes = malloc((attributeCount + instanceAttributeCount) * sizeof(VkVertexInputAttributeDescription)),
+	};
+	unsigned int location = 0;
+	layout->Size = AddAttributes(layout, 0, attributeCount, attributes, &location);
+	layout->InstanceSize = AddAttributes(layout, 1, instanceAttributeCount, instanceAttributes, &location);
+	layout->Bindings[0] = (VkVertexInputBindingDescription)
 	{
 		.binding = 0,
-		.stride = size,
+		.stride = layout->Size,
 		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
 	};
-	layout->Size = size;
+	layout->Bindings[1] = (VkVertexInputBindingDescription)
+	{
+		.binding = 1,
+		.stride = layout->InstanceSize,
+		.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+	};
 	return layout;
 }
 
+VertexLayout VertexLayoutCreate(int attributeCount, VertexAttribute * attributes)
+{
+	return VertexLayoutCreateInstanced(attributeCount, attributes, 0, NULL);
+}
+
 void VertexLayoutDestroy(VertexLayout layout)
 {
 	free(layout->Attributes);
@@ -63,19 +84,6 @@ VertexBuffer VertexBufferCreate(int vertexCount, int vertexSize, int indexCount)
 	
 	unsigned long size = vertexCount * vertexSize + 4 * indexCount;
 	
-	VkBufferCreateInfo stagingInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size = size,
-		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-	};
-	VmaAllocationCreateInfo stagingAllocationInfo =
-	{
-		.usage = VMA_MEMORY_USAGE_CPU_ONLY,
-	};
-	vmaCreateBuffer(Graphics.Allocator, &stagingInfo, &stagingAllocationInfo, &vertexBuffer->StagingBuffer, &vertexBuffer->StagingAllocation, NULL);
-	
 	VkBufferCreateInfo bufferInfo =
 	{
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -90,29 +98,14 @@ VertexBuffer VertexBufferCreate(int vertexCount, int vertexSize, int indexCount)
 	};
 	vmaCreateBuffer(Graphics.Allocator, &bufferInfo, &allocationInfo, &vertexBuffer->VertexBuffer, &vertexBuffer->VertexAllocation, NULL);
 	
-	VkCommandBufferAllocateInfo commandAllocateInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandPool = Graphics.CommandPool,
-		.commandBufferCount = 1,
-	};
-	vkAllocateCommandBuffers(Graphics.Device, &commandAllocateInfo, &vertexBuffer->CommandBuffer);
-	
-	VkFenceCreateInfo fenceInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
-	};
-	vkCreateFence(Graphics.Device, &fenceInfo, NULL, &vertexBuffer->UploadFence);
-	
 	return vertexBuffer;
 }
 
 void * VertexBufferMapVertices(VertexBuffer vertexBuffer, unsigned int ** indices)
 {
-	void * data;
-	vmaMapMemory(Graphics.Allocator, vertexBuffer->StagingAllocation, &data);
+	// The host copy is only kept for buffers that are mapped, so their contents persist between uploads
+	if (vertexBuffer->HostData == NULL) { vertexBuffer->HostData = calloc(1, vertexBuffer->VertexCount * vertexBuffer->VertexSize + 4 * vertexBuffer->IndexCount); }
+	void * data = vertexBuffer->HostData;
 	if (vertexBuffer->IndexCount > 0 && indices != NULL)
 	{
 		*indices = (unsigned int *)((unsigned char *)data + vertexBuffer->VertexCount * vertexBuffer->VertexSize);
@@ -122,52 +115,36 @@ void * VertexBufferMapVertices(VertexBuffer vertexBuffer, unsigned int ** indice
 
 void VertexBufferUnmapVertices(VertexBuffer vertexBuffer)
 {
-	vmaUnmapMemory(Graphics.Allocator, vertexBuffer->StagingAllocation);
+	// The host copy stays mapped until the vertex buffer is destroyed
 }
 
 void VertexBufferUpload(VertexBuffer vertexBuffer)
 {
-	vkWaitForFences(Graphics.Device, 1, &vertexBuffer->UploadFence, VK_TRUE, UINT64_MAX);
-	vkResetFences(Graphics.Device, 1, &vertexBuffer->UploadFence);
-	
-	VkCommandBufferBeginInfo beginInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
-	
-	vkBeginCommandBuffer(vertexBuffer->CommandBuffer, &beginInfo);
-	VkBufferCopy copyInfo =
-	{
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = vertexBuffer->VertexCount * vertexBuffer->VertexSize + 4 * vertexBuffer->IndexCount,
-	};
-	vkCmdCopyBuffer(vertexBuffer->CommandBuffer, vertexBuffer->StagingBuffer, vertexBuffer->VertexBuffer, 1, &copyInfo);
-	vkEndCommandBuffer(vertexBuffer->CommandBuffer);
-	
-	VkSubmitInfo submitInfo =
-	{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &vertexBuffer->CommandBuffer,
-		.signalSemaphoreCount = 0,
-		.pSignalSemaphores = NULL,
-	};
-	vkQueueSubmit(Graphics.GraphicsQueue, 1, &submitInfo, vertexBuffer->UploadFence);
+	if (vertexBuffer->HostData == NULL) { return; }
+	unsigned int * indices = (unsigned int *)(vertexBuffer->HostData + vertexBuffer->VertexCount * vertexBuffer->VertexSize);
+	VertexBufferUploadData(vertexBuffer, vertexBuffer->HostData, vertexBuffer->IndexCount > 0 ? indices : NULL);
+}
+
+void VertexBufferUploadData(VertexBuffer vertexBuffer, const void * vertices, const unsigned int * indices)
+{
+	unsigned long vertexSize = vertexBuffer->VertexCount * vertexBuffer->VertexSize;
+	unsigned long size = vertexSize + 4 * vertexBuffer->IndexCount;
+	// The copy runs when the batch is submitted, so the data is staged now to keep later writes out of it
+	UploadStaging staging = UploadAllocateStaging(size);
+	memcpy(staging.Data, vertices, vertexSize);
+	if (vertexBuffer->IndexCount > 0 && indices != NULL) { memcpy((unsigned char *)staging.Data + vertexSize, indices, 4 * vertexBuffer->IndexCount); }
+	UploadBuffer(staging.Buffer, staging.Offset, vertexBuffer->VertexBuffer, 0, size, true);
+	UploadReleaseStaging(staging);
 }
 
 void VertexBufferQueueDestroy(VertexBuffer vertexBuffer)
 {
-	ListPush(Graphics.FrameResources[Graphics.FrameIndex].Queues[GraphicsQueueDestroyVertexBuffer], vertexBuffer);
+	TimelineRetire(vertexBuffer, (TimelineDestroyFunction)VertexBufferDestroy);
 }
 
 void VertexBufferDestroy(VertexBuffer vertexBuffer)
 {
-	vkWaitForFences(Graphics.Device, 1, &vertexBuffer->UploadFence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(Graphics.Device, vertexBuffer->UploadFence, NULL);
-	vkFreeCommandBuffers(Graphics.Device, Graphics.CommandPool, 1, &vertexBuffer->CommandBuffer);
-	vmaDestroyBuffer(Graphics.Allocator, vertexBuffer->StagingBuffer, vertexBuffer->StagingAllocation);
+	free(vertexBuffer->HostData);
 	vmaDestroyBuffer(Graphics.Allocator, vertexBuffer->VertexBuffer, vertexBuffer->VertexAllocation);
 	free(vertexBuffer);
 }
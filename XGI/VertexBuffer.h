@@ -29,10 +29,12 @@ typedef enum VertexAttribute
 
 typedef struct VertexLayout
 {
-	VkVertexInputBindingDescription Binding;
+	unsigned int BindingCount;
+	VkVertexInputBindingDescription Bindings[2];
 	unsigned int AttributeCount;
 	VkVertexInputAttributeDescription * Attributes;
 	unsigned int Size;
+	unsigned int InstanceSize;
 } * VertexLayout;
 
 /// Creates a vertex layout object used for pipelines
@@ -41,6 +43,15 @@ typedef struct VertexLayout
 /// \return The created vertex layout object
 VertexLayout VertexLayoutCreate(int attributeCount, VertexAttribute * attributes);
 
+/// Creates a vertex layout object with a second binding that advances once per instance instead of once per vertex.
+/// The instance attributes are placed at the shader locations after the vertex attributes, and are read from the instance buffer given when rendering.
+/// \param attributeCount The number of per-vertex attributes in the layout
+/// \param attributes An array of per-vertex attributes
+/// \param instanceAttributeCount The number of per-instance attributes in the layout
+/// \param instanceAttributes An array of per-instance attributes
+/// \return The created vertex layout object
+VertexLayout VertexLayoutCreateInstanced(int attributeCount, VertexAttribute * attributes, int instanceAttributeCount, VertexAttribute * instanceAttributes);
+
 /// Destroys a vertex layout object
 /// \param layout The vertex layout to destroy
 void VertexLayoutDestroy(VertexLayout layout);
@@ -50,12 +61,10 @@ typedef struct VertexBuffer
 	int VertexCount;
 	int VertexSize;
 	int IndexCount;
-	VkBuffer StagingBuffer;
-	VmaAllocation StagingAllocation;
+	/// The contents written through VertexBufferMapVertices, NULL until it's first called
+	unsigned char * HostData;
 	VkBuffer VertexBuffer;
 	VmaAllocation VertexAllocation;
-	VkCommandBuffer CommandBuffer;
-	VkFence UploadFence;
 } * VertexBuffer;
 
 /// Creates a vertex buffer combined with an index buffer used for rendering.
@@ -84,6 +93,13 @@ void VertexBufferUnmapVertices(VertexBuffer vertexBuffer);
 /// \param vertexBuffer The vertexbuffer to upload
 void VertexBufferUpload(VertexBuffer vertexBuffer);
 
+/// Copies vertices and indices to the GPU through the shared staging memory.
+/// Unlike VertexBufferMapVertices this doesn't keep a copy on the cpu, so it's meant for static meshes.
+/// \param vertexBuffer The vertexbuffer to upload to
+/// \param vertices A pointer to vertexCount * vertexSize bytes of vertices
+/// \param indices A pointer to indexCount indices, or NULL if the index buffer is disabled
+void VertexBufferUploadData(VertexBuffer vertexBuffer, const void * vertices, const unsigned int * indices);
+
 /// Places the vertex buffer into a queue to be destroyed.
 /// This should only be called if the vertex buffer needs to be destroyed at render-time
 /// \param vertexBuffer The vertex buffer to destroy
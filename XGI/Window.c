@@ -13,7 +13,7 @@ void WindowInitialize(WindowConfigure flags)
 	Window.Height = flags.Height;
 	Window.Running = true;
 	
-	unsigned int orFlags = SDL_WINDOW_VULKAN;
+	unsigned int orFlags = flags.Headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_VULKAN;
 	orFlags |= flags.AlwaysOnTop ? SDL_WINDOW_ALWAYS_ON_TOP : orFlags;
 	orFlags |= flags.Borderless ? SDL_WINDOW_BORDERLESS : orFlags;
 	orFlags |= flags.FullScreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : orFlags;
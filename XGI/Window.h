@@ -38,6 +38,9 @@ typedef struct WindowConfigure
 	bool MouseCapture;
 	/// Whether or not the window is always on top
 	bool AlwaysOnTop;
+	/// Whether or not the window is created without Vulkan support.
+	/// This is set by XGIInitialize when GraphicsConfigure.Headless is true
+	bool Headless;
 } WindowConfigure;
 
 struct Window
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <SDL2/SDL_cpuinfo.h>
+#include "Worker.h"
+#include "log.h"
+
+struct Worker Worker = { 0 };
+
+static int WorkerThread(void * data)
+{
+	SDL_LockMutex(Worker.Mutex);
+	while (true)
+	{
+		while (Worker.JobStart == Worker.JobCount && !Worker.Stopping) { SDL_CondWait(Worker.JobAvailable, Worker.Mutex); }
+		if (Worker.JobStart == Worker.JobCount) { break; }
+		struct WorkerJob job = Worker.Jobs[Worker.JobStart++];
+		if (Worker.JobStart == Worker.JobCount)
+		{
+			Worker.JobStart = 0;
+			Worker.JobCount = 0;
+		}
+		SDL_UnlockMutex(Worker.Mutex);
+	
+		job.Function(job.Data);
+	
+		// Waiters check their flag while holding the mutex, so the broadcast can't be missed between their check and their wait
+		SDL_LockMutex(Worker.Mutex);
+		SDL_CondBroadcast(Worker.JobFinished);
+	}
+	SDL_UnlockMutex(Worker.Mutex);
+	return 0;
+}
+
+void WorkerInitialize()
+{
+	Worker.ThreadCount = SDL_GetCPUCount() > 1 ? SDL_GetCPUCount() - 1 : 1;
+	Worker.Threads = malloc(Worker.ThreadCount * sizeof(SDL_Thread *));
+	Worker.Mutex = SDL_CreateMutex();
+	Worker.JobAvailable = SDL_CreateCond();
+	Worker.JobFinished = SDL_CreateCond();
+	Worker.Stopping = false;
+	Worker.JobStart = 0;
+	Worker.JobCount = 0;
+	Worker.JobCapacity = 0;
+	Worker.Jobs = NULL;
+	for (int i = 0; i < Worker.ThreadCount; i++)
+	{
+		Worker.Threads[i] = SDL_CreateThread(WorkerThread, "XGI Worker", NULL);
+		if (Worker.Threads[i] == NULL)
+		{
+			log_fatal("Failed to create a worker thread: %s\n", SDL_GetError());
+			exit(1);
+		}
+	}
+	log_info("Started %i worker threads.\n", Worker.ThreadCount);
+}
+
+void WorkerSubmit(WorkerFunction function, void * data)
+{
+	SDL_LockMutex(Worker.Mutex);
+	if (Worker.JobCount == Worker.JobCapacity)
+	{
+		Worker.JobCapacity = Worker.JobCapacity == 0 ? 64 : 2 * Worker.JobCapacity;
+		Worker.Jobs = realloc(Worker.Jobs, Worker.JobCapacity * sizeof(struct WorkerJob));
+	}
+	Worker.Jobs[Worker.JobCount++] = (struct WorkerJob){ .Function = function, .Data = data };
+	SDL_CondSignal(Worker.JobAvailable);
+	SDL_UnlockMutex(Worker.Mutex);
+}
+
+void WorkerSignal(SDL_atomic_t * flag)
+{
+	SDL_LockMutex(Worker.Mutex);
+	SDL_AtomicSet(flag, 1);
+	SDL_CondBroadcast(Worker.JobFinished);
+	SDL_UnlockMutex(Worker.Mutex);
+}
+
+void WorkerWait(SDL_atomic_t * flag)
+{
+	SDL_LockMutex(Worker.Mutex);
+	while (SDL_AtomicGet(flag) == 0) { SDL_CondWait(Worker.JobFinished, Worker.Mutex); }
+	SDL_UnlockMutex(Worker.Mutex);
+}
+
+void WorkerDeinitialize()
+{
+	SDL_LockMutex(Worker.Mutex);
+	Worker.Stopping = true;
+	SDL_CondBroadcast(Worker.JobAvailable);
+	SDL_UnlockMutex(Worker.Mutex);
+	for (int i = 0; i < Worker.ThreadCount; i++) { SDL_WaitThread(Worker.Threads[i], NULL); }
+	free(Worker.Threads);
+	free(Worker.Jobs);
+	SDL_DestroyCond(Worker.JobFinished);
+	SDL_DestroyCond(Worker.JobAvailable);
+	SDL_DestroyMutex(Worker.Mutex);
+}
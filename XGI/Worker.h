@@ -0,0 +1,51 @@
+#ifndef Worker_h
+#define Worker_h
+
+#include <stdbool.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_atomic.h>
+
+/// Runs a job on a worker thread
+typedef void (* WorkerFunction)(void * data);
+
+struct Worker
+{
+	int ThreadCount;
+	SDL_Thread ** Threads;
+	SDL_mutex * Mutex;
+	SDL_cond * JobAvailable;
+	SDL_cond * JobFinished;
+	bool Stopping;
+	int JobStart;
+	int JobCount;
+	int JobCapacity;
+	struct WorkerJob
+	{
+		WorkerFunction Function;
+		void * Data;
+	} * Jobs;
+} extern Worker;
+
+/// This should not be called by the user, it is called in GraphicsInitialize.
+/// Starts one worker thread for every core except the main thread's.
+void WorkerInitialize(void);
+
+/// Queues a job to run on the next free worker thread, jobs start in the order they're submitted.
+/// \param function The function that runs the job
+/// \param data The data that is passed to the function
+void WorkerSubmit(WorkerFunction function, void * data);
+
+/// Sets a flag and wakes the threads that are waiting on it, for flags that are set outside of a job.
+/// \param flag The flag to set
+void WorkerSignal(SDL_atomic_t * flag);
+
+/// Blocks until a flag is set, either by a job before it returns or with WorkerSignal.
+/// \param flag The flag to wait on, the wait ends once it's nonzero
+void WorkerWait(SDL_atomic_t * flag);
+
+/// This should not be called by the user, it is called in GraphicsDeinitialize.
+/// Finishes every queued job then stops the worker threads.
+void WorkerDeinitialize(void);
+
+#endif
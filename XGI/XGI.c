@@ -10,6 +10,7 @@ void XGIInitialize(WindowConfigure windowFlags, GraphicsConfigure graphicsFlags)
 		log_fatal("Failed to initialize SDL\n");
 		exit(1);
 	}
+	windowFlags.Headless = graphicsFlags.Headless;
 	WindowInitialize(windowFlags);
 	GraphicsInitialize(graphicsFlags);
 	EventHandlerInitialize();
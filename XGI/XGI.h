@@ -1,6 +1,9 @@
 #ifndef XGI_h
 #define XGI_h
 
+#include "CommandRecorder.h"
+#include "Culling.h"
+#include "RenderGraph.h"
 #include "EventHandler.h"
 #include "File.h"
 #include "FrameBuffer.h"